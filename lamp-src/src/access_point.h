@@ -27,9 +27,14 @@ public:
         stop();
     }
 
-    void start(const std::string& ssid, const std::string& password) {
+    /// @brief Start AP
+    /// @param scan true - AP + STA mode, the STA interface is used by WiFiScanner while the AP serves
+    void start(const std::string& ssid, const std::string& password, bool scan = false) {
         
         _ap =esp_netif_create_default_wifi_ap();
+        if (scan) {
+            _sta = esp_netif_create_default_wifi_sta();
+        }
 
         wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
         ESP_ERROR_CHECK(esp_wifi_init(&cfg));
@@ -45,7 +50,7 @@ public:
             wifi_config.ap.authmode = WIFI_AUTH_OPEN;
         }
 
-        ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_AP));
+        ESP_ERROR_CHECK(esp_wifi_set_mode(scan ? WIFI_MODE_APSTA : WIFI_MODE_AP));
         ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &wifi_config));
         ESP_ERROR_CHECK(esp_wifi_start());
 
@@ -69,6 +74,10 @@ public:
             esp_netif_destroy(_ap);
             _ap = nullptr;
         }
+        if (_sta) {
+            esp_netif_destroy(_sta);
+            _sta = nullptr;
+        }
 
        
 
@@ -91,6 +100,7 @@ private:
     esp_event_handler_instance_t _instanceAnyId;
     bool _coreinit{false};
     esp_netif_t * _ap{nullptr};
+    esp_netif_t * _sta{nullptr};
 
     static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
         WiFiAccessPoint* wifiAccessPoint = static_cast<WiFiAccessPoint*>(arg);
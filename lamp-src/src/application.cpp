@@ -7,10 +7,15 @@
 
 #include "application.h"
 #include "hardware.h"
-#include "content_file.h"
+#include "asset_store.h"
 #include "driver/uart.h"
 #include "button.h"
 #include "key_val.h"
+#include "config.h"
+#include "warm_state.h"
+#include "history_log.h"
+#include "boot_phases.h"
+#include "esp_timer.h"
 
 // global application instance as singleton and instance acquisition.
 
@@ -21,7 +26,7 @@ Application *Application::getInstance()
     return &instance;
 }
 
-Application::Application() :    _heartBeat(HEART_BEAT_LED), 
+Application::Application() :    _statusLed(HEART_BEAT_LED), 
                                 _btnTask(A_BUTTON, B_BUTTON, FLASH_BUTTON)
 {
 }
@@ -36,37 +41,46 @@ void Application::checkRenewAP()
      // reset AP check
     Button b1(A_BUTTON);
     Button b2(B_BUTTON);
-    KeyVal& kv = KeyVal::getInstance();
    
     if (b1.isPressed() && b2.isPressed()) {
-		kv.writeString(literals::kv_ssid, "");
+		Config::getInstance().update([](ConfigRecord &c) {
+			Config::setString(c.ssid, "");
+		});
     }
 }
 
 void Application::init()
 {
-    // Begin initialization of core functions so that individual 
-    // wrappers no longer need to execute
-    
-    // initi file system
-    ConentFile::initFS();
+    // Only what the 2.4 GHz link & buttons need runs before their tasks,
+    // web assets & the network stack are prepared while they already work
+    BootPhases::mark(BootPhase::Init);
+
+    // state from RTC memory after a soft reset, before anything reads NVS
+    WarmState::getInstance().restore();
+
+    // serial line & LCS12 - the module starts while NVS is read
+    gpio_set_direction(LSC_SET, GPIO_MODE_OUTPUT);
+	gpio_set_direction(LSC_CS, GPIO_MODE_OUTPUT);
+	gpio_set_level(LSC_CS, 0);
+	gpio_set_level(LSC_SET, 1);
+    const int64_t lcsReadyUs = esp_timer_get_time() + _lcsStartUs;
 
     // initialize NVS
     KeyVal& kv = KeyVal::getInstance();
     kv.init(literals::kv_namespace ,true, false);
 
-    // initialize newtwork interfaces
-    ESP_ERROR_CHECK(esp_netif_init());
+    // configuration - RTC copy after a soft reset, single NVS read on cold boot, tasks use the RAM copy
+    Config::getInstance().load();
+    BootPhases::mark(BootPhase::Config);
 
-    // default event loop
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    // lamp history - subscribe lamp state before the first one, the log is scanned in run()
+    HistoryLog::getInstance().subscribe();
 
-    // serial line & LCS12
-    gpio_set_direction(LSC_SET, GPIO_MODE_OUTPUT);
-	gpio_set_direction(LSC_CS, GPIO_MODE_OUTPUT);
-	gpio_set_level(LSC_CS, 0);
-	gpio_set_level(LSC_SET, 1);
-    vTaskDelay(100 / portTICK_PERIOD_MS); 
+    // per-pin GPIO interrupts (buttons)
+    ESP_ERROR_CHECK(gpio_install_isr_service(0));
+
+    // status LED patterns
+    _statusLed.init();
  
 	 const uart_config_t uart_config = {
         .baud_rate = 9600,
@@ -79,9 +93,13 @@ void Application::init()
     };
 
    
-    uart_driver_install(LCS_UART, 2048, 0, 0, NULL, 0); 
+    QueueHandle_t uartQueue = NULL;
+    uart_driver_install(LCS_UART, 2048, 0, LC12STask::_uartQueueDepth, &uartQueue, 0); 
     uart_param_config(LCS_UART, &uart_config);
     uart_set_pin(LCS_UART, LSC_TX_PIN, LSC_RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    // RX works at once, the first transmit waits for the rest of the module start
+    _lcs12cTask.attachUart(uartQueue, lcsReadyUs);
+    BootPhases::mark(BootPhase::Uart);
 
     checkRenewAP();
 
@@ -89,29 +107,66 @@ void Application::init()
 
 void Application::run()
 {
-    // task create
+    // task create - static stacks, priority & core from task_config
     do
     {
-        if (!_heartBeat.init(literals::tsk_led, tskIDLE_PRIORITY + 1ul, configMINIMAL_STACK_SIZE*10))
-            break;
+        // 2.4 GHz link & buttons first - the lamp is controllable before Wi-Fi is up
+        if (!_lcs12cTask.init<task_config::lcs>())
+           break;
 
-        if (!_wifiTask.init(literals::tsk_web, tskIDLE_PRIORITY + 1ul, 4086))
+        if (!_btnTask.init<task_config::button>())
+           break;
+
+        BootPhases::mark(BootPhase::RfTasks);
+
+        // lamp history - index of the log partition, states meanwhile wait in RAM
+        HistoryLog::getInstance().init();
+
+        // web assets - mapped archive, no file system
+        AssetStore::getInstance().init();
+        BootPhases::mark(BootPhase::Assets);
+
+        // initialize newtwork interfaces
+        ESP_ERROR_CHECK(esp_netif_init());
+
+        // default event loop
+        ESP_ERROR_CHECK(esp_event_loop_create_default());
+        BootPhases::mark(BootPhase::Network);
+
+        if (!_wifiTask.init<task_config::wifi>())
             break;
 
-        if (!_webTask.init(literals::tsk_wifi, tskIDLE_PRIORITY + 1ul, 4086))
+        if (!_webTask.init<task_config::web>())
             break;
 
-        if (!_lcs12cTask.init(literals::tsk_lcs, tskIDLE_PRIORITY + 1ul, 4086))
+        if (!_udpTask.init<task_config::udp>())
            break;
 
-        if (!_btnTask.init(literals::btn_lcs, tskIDLE_PRIORITY + 1ul, 4086)) 
+        if (!_dmxTask.init<task_config::dmx>())
            break;
 
+        if (!_mqttTask.init<task_config::mqtt>())
+           break;
+
+        BootPhases::mark(BootPhase::Tasks);
+
     } while (false);
     
     
 }
 
+void Application::forEachTask(std::function<void(RPTask &)> fn)
+{
+    RPTask *tasks[] = {&_wifiTask, &_webTask, &_lcs12cTask, &_btnTask, &_udpTask, &_dmxTask, &_mqttTask};
+    for (auto task : tasks)
+    {
+        if (task->task() != NULL)
+        {
+            fn(*task);
+        }
+    }
+}
+
 void Application::done()
 {
     // fail 
@@ -9,14 +9,19 @@
 
 #include "freertos/FreeRTOS.h"
 #include <memory>
+#include <functional>
 #include <atomic>
 #include <stdio.h>
-#include "led_task.h"
+#include "status_led.h"
 #include "web_task.h"
 #include "wifi_task.h"
 #include "lcs12c_task.h"
 #include "button_task.h"
+#include "udp_task.h"
+#include "dmx_task.h"
+#include "mqtt_task.h"
 #include "literals.h"
+#include "task_config.h"
 
 /**
  * @brief application class - singleton
@@ -49,15 +54,18 @@ public:
     void done();
 
     
-    /**
-     * @brief Get heart beat task access
-     *
-     * @return LedTask*
-     */
-    LedTask *getLEDTask() { return &_heartBeat; }
     WebTask *getWebTask() { return &_webTask;}
     WifiTask *getWifiTask() { return &_wifiTask;}
     LC12STask *getLcsTask() { return &_lcs12cTask;}
+    UdpTask *getUdpTask() { return &_udpTask;}
+    DmxTask *getDmxTask() { return &_dmxTask;}
+    MqttTask *getMqttTask() { return &_mqttTask;}
+
+    /**
+     * @brief Calls fn for every running task (diagnostics)
+     *
+     */
+    void forEachTask(std::function<void(RPTask &)> fn);
     
     /**
      * Singleton
@@ -78,11 +86,16 @@ private:
 
     void checkRenewAP();
 
+    static constexpr int64_t _lcsStartUs{100000};   ///< LC12S start after CS & SET [us]
+
 
-    LedTask     _heartBeat;         ///< led task instance
+    StatusLed   _statusLed;        ///< status LED (RMT)
     WebTask     _webTask;          ///< web interface
     WifiTask    _wifiTask;         ///< wifi AP / client  
     LC12STask   _lcs12cTask;       ///< 2.4 GHz link 
     ButtonTask  _btnTask;          ///< button task X, A, B 
+    UdpTask     _udpTask;          ///< binary UDP control
+    DmxTask     _dmxTask;          ///< Art-Net / E1.31 receiver
+    MqttTask    _mqttTask;         ///< MQTT client
    
 };
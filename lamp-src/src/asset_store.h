@@ -0,0 +1,160 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   asset_store.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_log.h"
+
+/// @brief Web asset
+struct Asset {
+    const char *data;               ///< content, memory mapped flash
+    size_t size;                    ///< bytes
+    const char *mime;               ///< Content-Type
+};
+
+/// @brief Read-only web assets from a packed archive in the "assets" partition
+///
+/// The archive is built by tools/pack_assets.py. It is memory mapped once at
+/// boot and never changes - there are no file handles, an asset is a pointer into
+/// flash shared by all requests and sent without a copy. Lookup is one hash and a
+/// short linear probe in the open-addressed index built by the tool.
+///
+/// Layout (little endian):
+///   Header   magic "LPAK", version, slots (power of 2), count, size, CRC32 of the rest
+///   Entry[slots]  FNV-1a hash of the path (0 - empty slot), offsets of path, data, MIME type
+///   strings (NUL terminated) & data (4 byte aligned)
+class AssetStore {
+public:
+    static AssetStore &getInstance() {
+        static AssetStore instance;
+        return instance;
+    }
+
+    AssetStore(AssetStore const &) = delete;
+    void operator=(AssetStore const &) = delete;
+
+    /// @brief Map & validate the archive
+    /// @return true if usable
+    bool init() {
+        if (_base) {
+            return true;
+        }
+
+        const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, _label);
+        if (!part) {
+            ESP_LOGE("AssetStore", "no '%s' partition", _label);
+            return false;
+        }
+
+        Header hdr;
+        if (esp_partition_read(part, 0, &hdr, sizeof(hdr)) != ESP_OK || hdr.magic != _magic || hdr.version != _version) {
+            ESP_LOGE("AssetStore", "no asset archive, flash tools/pack_assets.py output");
+            return false;
+        }
+        if (hdr.size > part->size || hdr.slots == 0 || (hdr.slots & (hdr.slots - 1)) != 0 ||
+            sizeof(Header) + hdr.slots * sizeof(Entry) > hdr.size) {
+            ESP_LOGE("AssetStore", "corrupted header");
+            return false;
+        }
+
+        const void *ptr = nullptr;
+        if (esp_partition_mmap(part, 0, hdr.size, ESP_PARTITION_MMAP_DATA, &ptr, &_handle) != ESP_OK) {
+            ESP_LOGE("AssetStore", "mmap failed");
+            return false;
+        }
+        const auto *base = static_cast<const uint8_t *>(ptr);
+        if (esp_rom_crc32_le(0, base + sizeof(Header), hdr.size - sizeof(Header)) != hdr.crc) {
+            ESP_LOGE("AssetStore", "CRC mismatch");
+            esp_partition_munmap(_handle);
+            return false;
+        }
+
+        _base = base;
+        _size = hdr.size;
+        _slots = hdr.slots;
+        _entries = reinterpret_cast<const Entry *>(base + sizeof(Header));
+        ESP_LOGI("AssetStore", "%u assets, %u bytes", static_cast<unsigned>(hdr.count), static_cast<unsigned>(hdr.size));
+        return true;
+    }
+
+    /// @brief Look up an asset
+    /// @param path URI path, e.g. "/index.html"
+    /// @param asset output
+    /// @return false if not found
+    bool find(const char *path, Asset &asset) const {
+        if (!_base) {
+            return false;
+        }
+        const uint32_t h = hash(path);
+        for (uint32_t i = 0; i < _slots; ++i) {
+            const Entry &e = _entries[(h + i) & (_slots - 1)];
+            if (e.hash == 0) {
+                return false;
+            }
+            if (e.hash == h && std::strcmp(string(e.name), path) == 0) {
+                asset.data = reinterpret_cast<const char *>(_base + e.data);
+                asset.size = e.length;
+                asset.mime = string(e.mime);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// @brief FNV-1a, 0 is reserved for the empty slot - same as tools/pack_assets.py
+    static uint32_t hash(const char *path) {
+        uint32_t h = 0x811C9DC5u;
+        for (; *path; ++path) {
+            h ^= static_cast<uint8_t>(*path);
+            h *= 0x01000193u;
+        }
+        return h ? h : 1;
+    }
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t slots;             ///< index slots, power of 2
+        uint32_t count;             ///< assets
+        uint32_t size;              ///< archive bytes
+        uint32_t crc;               ///< CRC32 of the bytes after the header
+        uint32_t reserved;
+    };
+
+    struct Entry {
+        uint32_t hash;              ///< path hash, 0 - empty slot
+        uint32_t name;              ///< path offset
+        uint32_t data;              ///< content offset
+        uint32_t length;            ///< content bytes
+        uint32_t mime;              ///< MIME type offset
+    };
+
+    static_assert(sizeof(Header) == 24 && sizeof(Entry) == 20, "archive layout");
+
+    AssetStore() = default;
+
+    /// @brief String at offset, offsets are checked by the CRC only - the tool writes valid ones
+    const char *string(uint32_t offset) const {
+        return offset < _size ? reinterpret_cast<const char *>(_base + offset) : "";
+    }
+
+    static constexpr const char *_label{"assets"};
+    static constexpr uint32_t _magic{0x4B41504Cu};     ///< "LPAK"
+    static constexpr uint16_t _version{1};
+
+    const uint8_t *_base{nullptr};                     ///< mapped archive
+    size_t _size{0};
+    uint32_t _slots{0};
+    const Entry *_entries{nullptr};
+    esp_partition_mmap_handle_t _handle{};
+};
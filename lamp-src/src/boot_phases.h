@@ -0,0 +1,91 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   boot_phases.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include "esp_timer.h"
+#include "esp_log.h"
+
+/// @brief Boot phases, in the usual order of completion
+enum class BootPhase : uint8_t {
+	Init,			///< Application::init() entered
+	Config,			///< NVS & configuration loaded
+	Uart,			///< LC12S UART installed
+	RfTasks,		///< 2.4 GHz & button tasks created
+	RfReady,		///< LC12S task dispatching - RX & button commands are processed
+	Assets,			///< web asset archive mapped
+	Network,		///< netif & default event loop
+	Tasks,			///< all tasks created
+	FirstRf,		///< first RF frame received or sent
+	GotIp,			///< first IP address
+	FirstHttp,		///< first answered HTTP request
+	Count
+};
+
+/// @brief Time of every boot phase since boot [us]
+///
+/// Each phase is recorded once, by whichever task completes it first, and logged.
+/// Phases of independent tasks overlap - the 2.4 GHz link does not wait for Wi-Fi.
+class BootPhases
+{
+public:
+	static constexpr uint32_t _rfBudgetMs{250};		///< target, boot to RfReady
+
+	/// @brief Record the phase, later calls are ignored
+	/// @param p phase
+	static void mark(BootPhase p)
+	{
+		auto &slot = _us[static_cast<size_t>(p)];
+		if (slot.load(std::memory_order_relaxed) != 0) {
+			return;
+		}
+		int64_t none = 0;
+		const int64_t now = esp_timer_get_time();
+		if (!slot.compare_exchange_strong(none, now)) {
+			return;
+		}
+
+		const int ms = static_cast<int>(now / 1000);
+		if (p == BootPhase::RfReady && ms > static_cast<int>(_rfBudgetMs)) {
+			ESP_LOGW("Boot", "%s %d ms, over budget %u ms", name(p), ms, static_cast<unsigned>(_rfBudgetMs));
+		} else {
+			ESP_LOGI("Boot", "%s %d ms", name(p), ms);
+		}
+	}
+
+	/// @brief Time of the phase since boot [us], 0 - not yet
+	static int64_t get(BootPhase p)
+	{
+		return _us[static_cast<size_t>(p)].load(std::memory_order_relaxed);
+	}
+
+	/// @brief Phase name for logs & /debug/boot
+	static const char *name(BootPhase p)
+	{
+		static const char *names[] = {
+			"init",
+			"config",
+			"uart",
+			"rf_tasks",
+			"rf_ready",
+			"assets",
+			"network",
+			"tasks",
+			"first_rf_frame",
+			"got_ip",
+			"first_http",
+		};
+		static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(BootPhase::Count), "phase names");
+		return names[static_cast<size_t>(p)];
+	}
+
+private:
+	static inline std::atomic<int64_t> _us[static_cast<size_t>(BootPhase::Count)]{};
+};
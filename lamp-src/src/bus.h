@@ -0,0 +1,155 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   bus.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "rptask.h"
+
+/// @brief Topic traits, specialized next to the message type
+///
+/// Publishing or subscribing a type without specialization does not compile.
+/// A specialization defines:
+///   static constexpr const char *name;        metrics label
+///   static constexpr bool latest;             state topic - mailbox holds the newest message only
+///   static constexpr size_t depth;            mailbox length, 1 for state topics
+///   static constexpr size_t subscribers;      max. subscribers
+template <typename T>
+struct Topic;
+
+/// @brief Publish / subscribe of small POD messages between tasks
+///
+/// Every subscriber owns a fixed mailbox (FreeRTOS queue). The message is copied
+/// into each mailbox, nothing is allocated. State topics overwrite the unread
+/// message (xQueueOverwrite), event topics drop the message when the mailbox
+/// is full and count the drop. A subscriber without a task registers a handler,
+/// which runs in the publisher's task and must not block. Subscription is done
+/// in constructors, before the tasks are started - the subscriber list is not locked.
+template <typename T>
+class Bus
+{
+	static_assert(std::is_trivially_copyable<T>::value, "bus messages are copied by value");
+	static_assert(sizeof(T) <= 16, "bus messages are small");
+
+public:
+	/// @brief Handler subscriber
+	using Handler = void (*)(const T &msg, void *ctx);
+
+	/// @brief Add subscriber mailbox
+	/// @param queue mailbox of Topic<T>::depth items of T
+	/// @return true if subscribed
+	static bool subscribe(QueueHandle_t queue)
+	{
+		if (!queue || _count >= _subs.size()) {
+			ESP_LOGE("bus", "%s: subscribe failed", Topic<T>::name);
+			return false;
+		}
+		_subs[_count++] = Subscriber{queue, nullptr, nullptr};
+		return true;
+	}
+
+	/// @brief Add handler subscriber
+	/// @param fn called from publish(), must not block
+	/// @param ctx handler context
+	/// @return true if subscribed
+	static bool subscribe(Handler fn, void *ctx)
+	{
+		if (!fn || _count >= _subs.size()) {
+			ESP_LOGE("bus", "%s: subscribe failed", Topic<T>::name);
+			return false;
+		}
+		_subs[_count++] = Subscriber{nullptr, fn, ctx};
+		return true;
+	}
+
+	/// @brief Copy message to all subscribers, never blocks
+	/// @param msg message
+	static void publish(const T &msg)
+	{
+		for (size_t i = 0; i < _count; ++i) {
+			const auto &sub = _subs[i];
+			if (sub.fn) {
+				sub.fn(msg, sub.ctx);
+			} else if constexpr (Topic<T>::latest) {
+				xQueueOverwrite(sub.queue, &msg);
+			} else if (xQueueSendToBack(sub.queue, &msg, 0) != pdTRUE) {
+				_drops.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/// @brief Messages dropped on full mailboxes
+	static uint32_t drops()
+	{
+		return _drops.load(std::memory_order_relaxed);
+	}
+
+	/// @brief Number of subscribers
+	static size_t subscribers()
+	{
+		return _count;
+	}
+
+private:
+	struct Subscriber {
+		QueueHandle_t queue;	///< mailbox
+		Handler fn;				///< or handler
+		void *ctx;
+	};
+
+	static inline std::array<Subscriber, Topic<T>::subscribers> _subs{};		///< mailboxes & handlers
+	static inline size_t _count{0};											///< subscribed mailboxes
+	static inline std::atomic<uint32_t> _drops{0};							///< full mailbox drops
+};
+
+/// @brief Subscriber mailbox with static storage, subscribed on construction
+template <typename T>
+class Mailbox
+{
+	static_assert(!Topic<T>::latest || Topic<T>::depth == 1, "state topic mailbox holds one message");
+
+public:
+	Mailbox()
+	{
+		_queue = _mem.create();
+		Bus<T>::subscribe(_queue);
+	}
+
+	/// @brief Queue handle - Reactor::listen / on
+	QueueHandle_t handle() const { return _queue; }
+
+	/// @brief Take message
+	/// @param msg output
+	/// @param wait ticks to wait
+	/// @return true if received
+	bool receive(T &msg, TickType_t wait = 0)
+	{
+		return xQueueReceive(_queue, &msg, wait) == pdTRUE;
+	}
+
+private:
+	QueueMemory<T, Topic<T>::depth> _mem;	///< static queue storage
+	QueueHandle_t _queue{nullptr};
+};
+
+/// @brief List of topics for diagnostics
+template <typename... T>
+struct TopicList
+{
+	/// @brief Call fn(name, subscribers, drops) for every topic
+	template <typename F>
+	static void forEach(F fn)
+	{
+		(fn(Topic<T>::name, Bus<T>::subscribers(), Bus<T>::drops()), ...);
+	}
+};
@@ -0,0 +1,225 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   button_fsm.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+/// @brief Button gesture
+struct ButtonEvent {
+	enum class Type : uint8_t {
+		Click,		///< press & release before long press / repeat
+		LongPress,	///< held for longPressMs, button without repeat
+		Repeat,		///< held, auto-repeat button
+		Chord		///< both chord buttons held for longPressMs
+	};
+
+	Type type;			///< gesture
+	uint8_t button;		///< button index, the first button of a chord
+	uint16_t count;		///< repeat number, 1 ...
+};
+
+/// @brief Button gestures from debounced edges
+///
+/// No hardware and no OS dependency - the input is a timeline of debounced
+/// edges and clock ticks in milliseconds, so it can be driven by synthetic
+/// timelines on a host. The caller feeds edges, calls tick() at the deadline()
+/// and gets events through the emit callback.
+///
+/// Repeat interval starts at repeatStartMs and shrinks by accelPercent with every
+/// repeat down to repeatMinMs. Chord buttons pressed together (before any of them
+/// produced an event) give one Chord event and no clicks. There is no double-click
+/// gesture, so a click is emitted on release without waiting for a second one.
+template <size_t N>
+class ButtonFsm
+{
+public:
+	/// @brief Gesture timing
+	struct Timing {
+		uint32_t longPressMs{800};		///< long press & chord hold
+		uint32_t repeatDelayMs{400};	///< hold before the first repeat
+		uint32_t repeatStartMs{250};	///< first repeat interval
+		uint32_t repeatMinMs{40};		///< fastest repeat interval
+		uint8_t accelPercent{80};		///< next interval = interval * accelPercent / 100
+	};
+
+	explicit ButtonFsm(const Timing &timing = Timing{}) : _timing(timing) {}
+
+	/// @brief Held button repeats instead of a long press
+	/// @param button index
+	/// @param on auto-repeat
+	void repeat(size_t button, bool on)
+	{
+		_keys[button].repeat = on;
+	}
+
+	/// @brief Define chord of two buttons
+	void chord(size_t a, size_t b)
+	{
+		_chordA = a;
+		_chordB = b;
+	}
+
+	/// @brief Debounced level of the button
+	/// @return true if pressed
+	bool pressed(size_t button) const
+	{
+		return _keys[button].state != State::Idle;
+	}
+
+	/// @brief Debounced edge
+	/// @param button index
+	/// @param down true - pressed, false - released
+	/// @param now time [ms]
+	/// @param emit callable(const ButtonEvent&)
+	template <typename F>
+	void edge(size_t button, bool down, uint32_t now, F &&emit)
+	{
+		auto &key = _keys[button];
+		if (down) {
+			if (key.state != State::Idle) {
+				return;
+			}
+			key.state = State::Down;
+			key.count = 0;
+			key.next = now + (key.repeat ? _timing.repeatDelayMs : _timing.longPressMs);
+
+			if (isChord(button)) {
+				auto &other = _keys[button == _chordA ? _chordB : _chordA];
+				if (other.state == State::Down) {
+					key.state = other.state = State::Chord;
+					key.next = other.next = now + _timing.longPressMs;
+				}
+			}
+			return;
+		}
+
+		switch (key.state) {
+			case State::Down:
+				emit(ButtonEvent{ButtonEvent::Type::Click, static_cast<uint8_t>(button), 0});
+				break;
+			case State::Chord:
+				// chord released early - nothing from the other button either
+				_keys[button == _chordA ? _chordB : _chordA].state = State::Consumed;
+				break;
+			default:
+				break;
+		}
+		key.state = State::Idle;
+	}
+
+	/// @brief Debounced level sample, a lost or repeated sample is resolved against the current level
+	/// @param button index
+	/// @param down true - pressed
+	/// @param now time [ms]
+	/// @param emit callable(const ButtonEvent&)
+	template <typename F>
+	void level(size_t button, bool down, uint32_t now, F &&emit)
+	{
+		if (down != pressed(button)) {
+			edge(button, down, now, emit);
+		}
+	}
+
+	/// @brief Time based gestures
+	/// @param now time [ms]
+	/// @param emit callable(const ButtonEvent&)
+	template <typename F>
+	void tick(uint32_t now, F &&emit)
+	{
+		for (size_t i = 0; i < N; ++i) {
+			auto &key = _keys[i];
+			if (!due(key, now)) {
+				continue;
+			}
+
+			switch (key.state) {
+				case State::Down:
+					if (key.repeat) {
+						key.state = State::Held;
+						key.interval = _timing.repeatStartMs;
+						key.count = 1;
+						key.next = now + key.interval;
+						emit(ButtonEvent{ButtonEvent::Type::Repeat, static_cast<uint8_t>(i), key.count});
+					} else {
+						key.state = State::Consumed;
+						emit(ButtonEvent{ButtonEvent::Type::LongPress, static_cast<uint8_t>(i), 0});
+					}
+					break;
+				case State::Held:
+					key.count++;
+					key.interval = std::max<uint32_t>(_timing.repeatMinMs, key.interval * _timing.accelPercent / 100);
+					// late tick does not burst the missed repeats
+					key.next = now + key.interval;
+					emit(ButtonEvent{ButtonEvent::Type::Repeat, static_cast<uint8_t>(i), key.count});
+					break;
+				case State::Chord:
+					_keys[_chordA].state = _keys[_chordB].state = State::Consumed;
+					emit(ButtonEvent{ButtonEvent::Type::Chord, static_cast<uint8_t>(_chordA), 0});
+					break;
+				default:
+					break;
+			}
+		}
+	}
+
+	/// @brief Time to the next tick()
+	/// @param now time [ms]
+	/// @param ms output, 0 - overdue
+	/// @return false if nothing is pending
+	bool deadline(uint32_t now, uint32_t &ms) const
+	{
+		bool pending = false;
+		for (const auto &key : _keys) {
+			if (key.state == State::Idle || key.state == State::Consumed) {
+				continue;
+			}
+			const int32_t left = static_cast<int32_t>(key.next - now);
+			const uint32_t wait = left > 0 ? static_cast<uint32_t>(left) : 0;
+			ms = pending ? std::min(ms, wait) : wait;
+			pending = true;
+		}
+		return pending;
+	}
+
+private:
+	enum class State : uint8_t {
+		Idle,		///< released
+		Down,		///< pressed, no event yet
+		Held,		///< repeating
+		Chord,		///< pressed together with the other chord button
+		Consumed	///< event done, waits for release
+	};
+
+	struct Key {
+		State state{State::Idle};
+		bool repeat{false};
+		uint16_t count{0};		///< repeats
+		uint32_t next{0};		///< next time event [ms]
+		uint32_t interval{0};	///< current repeat interval [ms]
+	};
+
+	bool isChord(size_t button) const
+	{
+		return _chordA < N && _chordB < N && (button == _chordA || button == _chordB);
+	}
+
+	static bool due(const Key &key, uint32_t now)
+	{
+		// wrap safe, the clock wraps after 49 days
+		return key.state != State::Idle && key.state != State::Consumed &&
+			   static_cast<int32_t>(now - key.next) >= 0;
+	}
+
+	Timing _timing;
+	std::array<Key, N> _keys{};
+	size_t _chordA{N};		///< no chord
+	size_t _chordB{N};
+};
@@ -1,4 +1,3 @@
-
 //
 // vim: ts=4 et
 // Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
@@ -11,39 +10,148 @@
 #include <math.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include "esp_log.h"
 #include "button_task.h"
 #include "application.h"
 
-ButtonTask::ButtonTask(gpio_num_t buttonA, gpio_num_t buttonB, gpio_num_t buttonX) : _ba(buttonA), _bb(buttonB), _b(buttonX)
+ButtonTask::ButtonTask(gpio_num_t buttonA, gpio_num_t buttonB, gpio_num_t buttonX) : Reactor(8)
 {
+	_inputs[A].pin = buttonA;
+	_inputs[B].pin = buttonB;
+	_inputs[X].pin = buttonX;
+	for (uint8_t i = 0; i < Count; ++i) {
+		_inputs[i].task = this;
+		_inputs[i].index = i;
+	}
+
+	_fsm.repeat(A, true);
+	_fsm.repeat(B, true);
+	_fsm.chord(A, B);
+
+	_queue = _queueMem.create();
+	listen(_queue);
 }
 
 ButtonTask::~ButtonTask()
 {
-    done();
+	done();
+	for (auto &in : _inputs) {
+		gpio_isr_handler_remove(in.pin);
+		if (in.timer) {
+			esp_timer_stop(in.timer);
+			esp_timer_delete(in.timer);
+		}
+	}
+	if (_queue)
+		vQueueDelete(_queue);
+}
+
+void ButtonTask::isr(void *arg)
+{
+	// edge - ignore the bouncing until the timer samples the level
+	auto *in = static_cast<Input *>(arg);
+	gpio_intr_disable(in->pin);
+	esp_timer_start_once(in->timer, _debounceMs * 1000);
+}
+
+void ButtonTask::debounced(void *arg)
+{
+	// esp_timer task context
+	auto *in = static_cast<Input *>(arg);
+	// enable before sampling - a later edge restarts the debounce
+	gpio_intr_enable(in->pin);
+	Edge edge{in->index, static_cast<uint8_t>(gpio_get_level(in->pin) == 0), nowMs()};
+	xQueueSendToBack(in->task->_queue, &edge, 0);
+}
+
+uint32_t ButtonTask::nowMs()
+{
+	return static_cast<uint32_t>(esp_timer_get_time() / 1000);
 }
 
 void ButtonTask::loop()
 {
-    while (true)
-    {
+	for (auto &in : _inputs) {
+		gpio_config_t io_conf{};
+		io_conf.intr_type = GPIO_INTR_ANYEDGE;
+		io_conf.mode = GPIO_MODE_INPUT;
+		io_conf.pin_bit_mask = (1ULL << in.pin);
+		io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
+		io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
+		gpio_config(&io_conf);
+
+		esp_timer_create_args_t args{};
+		args.callback = &ButtonTask::debounced;
+		args.arg = &in;
+		args.dispatch_method = ESP_TIMER_TASK;
+		args.name = "button";
+		if (esp_timer_create(&args, &in.timer) != ESP_OK) {
+			ESP_LOGE("ButtonTask", "timer create failed");
+			return;
+		}
+		// ISR service is installed by Application::init
+		gpio_isr_handler_add(in.pin, &ButtonTask::isr, &in);
+	}
+
+	auto emit = [this](const ButtonEvent &ev) {
+		handle(ev);
+	};
 
-        if (_b.click()) {
-           // X-BOOT button ON / OFF
-		   Application::getInstance()->getLcsTask()->command(LC12STask::Command::toggle);
-        } else {
-            if (_ba.isPressed()) {
-                Application::getInstance()->getLcsTask()->command(LC12STask::Command::incIntensity);
-                vTaskDelay(200 / portTICK_PERIOD_MS);
-            }
-            
-            if (_bb.isPressed()) {
-                Application::getInstance()->getLcsTask()->command(LC12STask::Command::decIntensity);
-                vTaskDelay(200 / portTICK_PERIOD_MS);
-            }
-        }
+	// a lost or repeated sample is resolved against the current level
+	on<Edge>(_queue, [this, &emit](const Edge &edge) {
+		_fsm.level(edge.button, edge.pressed, edge.ms, emit);
+		schedule();
+	});
 
-        vTaskDelay(50 / portTICK_PERIOD_MS);
-    }
+	onTimer([this, &emit]() {
+		_fsm.tick(nowMs(), emit);
+		schedule();
+	});
+
+	dispatch();
 }
 
+void ButtonTask::schedule()
+{
+	uint32_t ms = 0;
+	if (_fsm.deadline(nowMs(), ms)) {
+		// round up to whole ticks, an early wake-up would only re-arm
+		armTimer(ms + portTICK_PERIOD_MS - 1);
+	} else {
+		disarmTimer();
+	}
+}
+
+void ButtonTask::handle(const ButtonEvent &ev)
+{
+	auto *lcs = Application::getInstance()->getLcsTask();
+	const LCSOrigin origin{LCSSource::Button, 0};
+
+	if (ev.type == ButtonEvent::Type::Chord) {
+		// A+B held - learn ID of a remote controller
+		lcs->command(LC12STask::Command::learn, origin);
+		return;
+	}
+
+	switch (ev.button) {
+		case A:
+			if (ev.type == ButtonEvent::Type::Click || ev.type == ButtonEvent::Type::Repeat) {
+				lcs->command(LC12STask::Command::incIntensity, origin);
+			}
+			break;
+		case B:
+			if (ev.type == ButtonEvent::Type::Click || ev.type == ButtonEvent::Type::Repeat) {
+				lcs->command(LC12STask::Command::decIntensity, origin);
+			}
+			break;
+		case X:
+			if (ev.type == ButtonEvent::Type::Click) {
+				lcs->command(LC12STask::Command::toggle, origin);
+			} else if (ev.type == ButtonEvent::Type::LongPress) {
+				lcs->command(LC12STask::Command::off, origin);
+			}
+			break;
+		default:
+			break;
+	}
+}
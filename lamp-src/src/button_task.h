@@ -7,11 +7,18 @@
 
 #pragma once
 
+#include <array>
+#include "esp_timer.h"
 #include "hardware.h"
-#include "rptask.h"
-#include "button.h"
+#include "reactor.h"
+#include "button_fsm.h"
 
-class ButtonTask : public RPTask
+/// @brief Buttons - GPIO interrupt, esp_timer debounce, gestures by ButtonFsm
+///
+/// Any edge disables the pin interrupt and starts the debounce timer, the timer
+/// samples the settled level, enables the interrupt and posts the level to the task.
+/// The task never sleeps, it waits for an edge or the next gesture deadline.
+class ButtonTask : public Reactor
 {
 public:
 	ButtonTask(gpio_num_t buttonA, gpio_num_t buttonB, gpio_num_t buttonX);
@@ -21,7 +28,38 @@ protected:
 	void loop() override;
 
 private:
-	Button _ba;  ///< A - button
-	Button _bb;  ///< B - button
-	Button _b;	 ///< X-BOOT button
+	enum Index : uint8_t {
+		A,		///< intensity up, auto-repeat
+		B,		///< intensity down, auto-repeat
+		X,		///< X-BOOT, toggle & long press off
+		Count
+	};
+
+	/// @brief Debounced level
+	struct Edge {
+		uint8_t button;		///< Index
+		uint8_t pressed;	///< 1 - pressed
+		uint32_t ms;		///< sample time
+	};
+
+	/// @brief ISR & debounce timer context
+	struct Input {
+		ButtonTask *task{nullptr};
+		gpio_num_t pin{GPIO_NUM_NC};
+		uint8_t index{0};
+		esp_timer_handle_t timer{nullptr};
+	};
+
+	static void isr(void *arg);
+	static void debounced(void *arg);
+	static uint32_t nowMs();
+	void handle(const ButtonEvent &ev);
+	void schedule();
+
+	static constexpr uint32_t _debounceMs{20};
+
+	std::array<Input, Count> _inputs{};
+	ButtonFsm<Count> _fsm;
+	QueueHandle_t 	_queue;
+	QueueMemory<Edge, 8> _queueMem;		///< static queue storage
 };
@@ -0,0 +1,260 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   config.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_rom_crc.h"
+#include "key_val.h"
+#include "literals.h"
+#include "packet.h"
+#include "config_record.h"
+#include "warm_state.h"
+
+/// @brief Configuration loaded once at boot, read by copy
+///
+/// Tasks take a snapshot by get(), changes go through update(), which stores the
+/// whole record by the write-behind KeyVal. The last hue & intensity change with
+/// every switch off, they have their own u32 key so the record is rewritten only
+/// when the configuration really changes. Both are copied into WarmState with every
+/// change, a soft reset loads them without reading NVS.
+class Config {
+public:
+    static constexpr uint32_t _magic{0x4C43464Eu};     ///< "LCFN"
+    static constexpr uint16_t _version{3};
+    static constexpr const char *_key{"cfg"};
+    static constexpr const char *_levelKey{"level"};   ///< hue | intensity << 8
+
+    using UpdateFunc = std::function<void(ConfigRecord &)>;
+
+    static Config &getInstance() {
+        static Config instance;
+        return instance;
+    }
+
+    Config(Config const &) = delete;
+    void operator=(Config const &) = delete;
+
+    /// @brief Load record, migrate older record or legacy keys, call after KeyVal::init
+    ///
+    /// After a soft reset the RTC copy is used, NVS is read on cold boot only.
+    /// @return true if a valid record was found
+    bool load() {
+        if (loadWarm()) {
+            return true;
+        }
+
+        KeyVal &kv = KeyVal::getInstance();
+        ConfigRecord rec{};
+        size_t length = sizeof(rec);
+        bool ok = kv.readBlob(_key, &rec, length);
+
+        std::string larger;
+        if (!ok && length > sizeof(rec)) {
+            // written by a newer firmware - take the known prefix
+            larger.resize(length);
+            ok = kv.readBlob(_key, &larger[0], length);
+        }
+        const uint8_t *raw = larger.empty() ? reinterpret_cast<const uint8_t *>(&rec)
+                                            : reinterpret_cast<const uint8_t *>(larger.data());
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        defaults(_rec);
+        size_t size = 0;
+        if (ok && valid(raw, length, size)) {
+            std::memcpy(&_rec, raw, std::min(size, sizeof(_rec)));
+            loadLevel(kv);
+            if (_rec.version < _version) {
+                ESP_LOGI("Config", "migrated from version %u", static_cast<unsigned>(_rec.version));
+                store();
+            }
+            // newer record is kept as is until the first change
+            keepWarm();
+            return true;
+        }
+
+        if (ok) {
+            ESP_LOGE("Config", "corrupted record, using legacy keys");
+        }
+        migrateLegacy(kv);
+        loadLevel(kv);
+        store();
+        return false;
+    }
+
+    /// @brief Snapshot of the configuration
+    ConfigRecord get() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _rec;
+    }
+
+    /// @brief Change & store (deferred, never waits for flash)
+    /// @param fn modifies the record
+    void update(UpdateFunc fn) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        fn(_rec);
+        store();
+    }
+
+    /// @brief Last hue & intensity
+    void level(uint8_t &hue, uint8_t &intensity) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        hue = _hue;
+        intensity = _intensity;
+    }
+
+    /// @brief Store last hue & intensity (deferred), nothing is written if unchanged
+    void setLevel(uint8_t hue, uint8_t intensity) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (hue == _hue && intensity == _intensity) {
+            return;
+        }
+        _hue = hue;
+        _intensity = intensity;
+        KeyVal::getInstance().writeUint32(_levelKey, packLevel(_hue, _intensity));
+        keepWarm();
+    }
+
+    /// @brief Copy string into a fixed field, truncated
+    template <size_t N>
+    static void setString(char (&field)[N], const std::string &value) {
+        const size_t len = std::min(value.size(), N - 1);
+        std::memcpy(field, value.data(), len);
+        std::memset(field + len, 0, N - len);
+    }
+
+    /// @brief Dotted IPv4 to address, 0 if empty or invalid
+    static uint32_t parseIp(const std::string &value) {
+        esp_ip4_addr_t addr{0};
+        if (value.empty() || esp_netif_str_to_ip4(value.c_str(), &addr) != ESP_OK) {
+            return 0;
+        }
+        return addr.addr;
+    }
+
+private:
+    Config() = default;
+
+    static constexpr size_t _headerSize{offsetof(ConfigRecord, ip)};
+    static constexpr uint32_t _noLevel{0xFFFFFFFFu};   ///< level key missing
+
+    static uint32_t packLevel(uint8_t hue, uint8_t intensity) {
+        return hue | static_cast<uint32_t>(intensity) << 8;
+    }
+
+    static void defaults(ConfigRecord &rec) {
+        rec = ConfigRecord{};
+        rec.magic = _magic;
+        rec.version = _version;
+        rec.size = sizeof(ConfigRecord);
+    }
+
+    static uint32_t crc(const uint8_t *raw, size_t size) {
+        return esp_rom_crc32_le(0, raw + _headerSize, size - _headerSize);
+    }
+
+    /// @brief Check header & CRC
+    /// @param raw stored bytes
+    /// @param length stored length
+    /// @param size record size from the header
+    static bool valid(const uint8_t *raw, size_t length, size_t &size) {
+        ConfigRecord hdr;
+        if (length < _headerSize) {
+            return false;
+        }
+        std::memcpy(&hdr, raw, _headerSize);
+        size = hdr.size;
+        return hdr.magic == _magic && size >= _headerSize && size <= length &&
+               hdr.crc == crc(raw, size);
+    }
+
+    /// @brief Stores _rec as current version, called with the mutex held
+    void store() {
+        _rec.magic = _magic;
+        _rec.version = _version;
+        _rec.size = sizeof(ConfigRecord);
+        _rec.crc = crc(reinterpret_cast<const uint8_t *>(&_rec), sizeof(ConfigRecord));
+        KeyVal::getInstance().writeBlob(_key, &_rec, sizeof(ConfigRecord));
+        keepWarm();
+    }
+
+    /// @brief Copy into RTC memory, called with the mutex held
+    void keepWarm() {
+        WarmState::getInstance().setConfig(_rec, packLevel(_hue, _intensity));
+    }
+
+    /// @brief Soft reset - record & level from RTC memory, no NVS read
+    /// @return false - cold boot or a copy of another layout, use NVS
+    bool loadWarm() {
+        WarmState &warm = WarmState::getInstance();
+        ConfigRecord rec{};
+        uint32_t level = 0;
+        size_t size = 0;
+        if (!warm.warm() || !warm.getConfig(rec, level) ||
+            !valid(reinterpret_cast<const uint8_t *>(&rec), sizeof(rec), size) ||
+            size != sizeof(rec) || rec.version != _version) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _rec = rec;
+        _hue = static_cast<uint8_t>(level);
+        _intensity = static_cast<uint8_t>(level >> 8);
+        if (!warm.clean()) {
+            // panic or watchdog - KeyVal writes pending at the reset were lost, the copy has them
+            KeyVal::getInstance().writeUint32(_levelKey, level);
+            store();
+        }
+        return true;
+    }
+
+    /// @brief Read the level key, an older record or the legacy keys hold the first value
+    void loadLevel(KeyVal &kv) {
+        const uint32_t level = kv.readUint32(_levelKey, _noLevel);
+        if (level == _noLevel) {
+            _hue = _rec.hue;
+            _intensity = _rec.intensity;
+            kv.writeUint32(_levelKey, packLevel(_hue, _intensity));
+        } else {
+            _hue = static_cast<uint8_t>(level);
+            _intensity = static_cast<uint8_t>(level >> 8);
+        }
+    }
+
+    /// @brief First boot after the update - the former one key per value layout
+    void migrateLegacy(KeyVal &kv) {
+        setString(_rec.ssid, kv.readString(literals::kv_ssid));
+        setString(_rec.pass, kv.readString(literals::kv_passwd));
+        setString(_rec.mqtt, kv.readString(literals::kv_mqtt));
+        setString(_rec.dmx, kv.readString(literals::kv_dmx));
+        _rec.ip = parseIp(kv.readString(literals::kv_ip));
+        _rec.mask = parseIp(kv.readString(literals::kv_mask));
+        _rec.gw = parseIp(kv.readString(literals::kv_gtw));
+
+        const auto id = kv.readString(literals::kv_lampid);
+        if (!id.empty()) {
+            _rec.lampId = lamp::Packet::stringToID(id);
+            _rec.hasLampId = 1;
+        }
+        _rec.hue = static_cast<uint8_t>(kv.readUint32(literals::kv_lamhue, 0));
+        _rec.intensity = static_cast<uint8_t>(kv.readUint32(literals::kv_lampintnesity, 0));
+    }
+
+    mutable std::mutex _mutex;
+    ConfigRecord _rec{};
+    uint8_t _hue{0};                ///< last hue, _levelKey
+    uint8_t _intensity{0};          ///< last intensity, _levelKey
+};
@@ -0,0 +1,47 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   config_record.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+
+/// @brief Persistent configuration, one NVS blob
+///
+/// Layout rules - fields are only appended, never moved or resized. An older
+/// record (smaller size) is migrated by taking its prefix, the new fields keep
+/// their defaults. A newer record is read the same way by older firmware.
+struct ConfigRecord {
+    // header
+    uint32_t magic;                 ///< Config::_magic
+    uint16_t version;               ///< layout version of the writer
+    uint16_t size;                  ///< sizeof(ConfigRecord) of the writer
+    uint32_t crc;                   ///< CRC32 of the bytes after the header, up to size
+
+    // version 1
+    uint32_t ip;                    ///< static IP, 0 - DHCP
+    uint32_t mask;                  ///< static IP mask
+    uint32_t gw;                    ///< gateway
+    std::array<uint8_t, 7> lampId;  ///< learned lamp ID
+    uint8_t hasLampId;              ///< 1 - lampId is valid
+    uint8_t hue;                    ///< last hue, unused since version 3 - Config::_levelKey
+    uint8_t intensity;              ///< last intensity, unused since version 3
+    char ssid[33];                  ///< WiFi SSID, '\0' - not configured
+    char pass[65];                  ///< WiFi password
+    char mqtt[128];                 ///< MQTT broker URI
+    char dmx[300];                  ///< DMX mapping
+
+    // version 2
+    struct Network {
+        char ssid[33];              ///< '\0' - unused
+        char pass[65];
+    };
+    std::array<Network, 2> backup;  ///< fallback networks in priority order, DHCP only
+};
+
+static_assert(std::is_trivially_copyable<ConfigRecord>::value, "ConfigRecord is stored as bytes");
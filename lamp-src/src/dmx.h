@@ -0,0 +1,368 @@
+/*
+ * @file dmx.h
+ * @author Petr Vanek (petr@fotoventus.cz)
+ * @brief Art-Net / E1.31 (sACN) DMX receiver core, hardware independent
+ * @version 0.1
+ * @date 2024-03-11
+ *
+ * @copyright Copyright (c) 2024 Petr Vanek
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <array>
+#include <string>
+#include "packet.h"
+
+namespace lamp {
+
+/// @brief DMX universe data view into received datagram
+struct DmxData
+{
+    uint16_t universe{0};           ///< universe (Art-Net port address / sACN universe)
+    const uint8_t *data{nullptr};   ///< channel 1 is data[0]
+    size_t length{0};               ///< number of channels
+    uint8_t sequence{0};            ///< packet sequence number
+    bool sequenced{false};          ///< sequence is valid (Art-Net 0 - not used)
+};
+
+/// @brief Art-Net & E1.31 datagram decoder
+class DmxDecoder
+{
+public:
+    static constexpr uint16_t _artNetPort = 6454;   ///< Art-Net UDP port
+    static constexpr uint16_t _sacnPort = 5568;     ///< E1.31 UDP port
+
+    /// @brief Decode ArtDmx packet
+    /// 0 - 7 "Art-Net\0", 8 - 9 OpCode 0x5000 (LE), 10 - 11 ProtVer, 12 Sequence, 13 Physical,
+    /// 14 SubUni, 15 Net, 16 - 17 Length (BE), 18 - data
+    static bool artNet(const uint8_t *buf, size_t len, DmxData &out)
+    {
+        static const char id[8] = {'A', 'r', 't', '-', 'N', 'e', 't', '\0'};
+        if (len < 18 || memcmp(buf, id, sizeof(id)) != 0)
+        {
+            return false;
+        }
+        if (buf[8] != 0x00 || buf[9] != 0x50)
+        {
+            // not ArtDmx (OpPoll, ...)
+            return false;
+        }
+
+        size_t count = (static_cast<size_t>(buf[16]) << 8) | buf[17];
+        if (count > 512 || 18 + count > len)
+        {
+            return false;
+        }
+
+        out.universe = static_cast<uint16_t>(((buf[15] & 0x7F) << 8) | buf[14]);
+        out.data = buf + 18;
+        out.length = count;
+        out.sequence = buf[12];
+        out.sequenced = buf[12] != 0;
+        return true;
+    }
+
+    /// @brief Decode E1.31 data packet
+    /// 4 - 15 "ASC-E1.17", 18 - 21 root vector 4, 40 - 43 framing vector 2, 111 sequence, 112 options,
+    /// 113 - 114 universe (BE), 117 DMP vector 2, 123 - 124 property count, 125 start code, 126 - data
+    static bool sacn(const uint8_t *buf, size_t len, DmxData &out)
+    {
+        static const uint8_t id[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+        if (len < 126 || memcmp(buf + 4, id, sizeof(id)) != 0)
+        {
+            return false;
+        }
+        if (be32(buf + 18) != 0x00000004 || be32(buf + 40) != 0x00000002 || buf[117] != 0x02)
+        {
+            return false;
+        }
+        if (buf[112] & 0x40)
+        {
+            // stream terminated
+            return false;
+        }
+
+        size_t count = (static_cast<size_t>(buf[123]) << 8) | buf[124];
+        if (count < 1 || count > 513 || 125 + count > len || buf[125] != 0x00)
+        {
+            // start code must be 0 - dimmer data
+            return false;
+        }
+
+        out.universe = static_cast<uint16_t>((buf[113] << 8) | buf[114]);
+        out.data = buf + 126;
+        out.length = count - 1;
+        out.sequence = buf[111];
+        out.sequenced = true;
+        return true;
+    }
+
+private:
+    static uint32_t be32(const uint8_t *p)
+    {
+        return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+               (static_cast<uint32_t>(p[2]) << 8) | p[3];
+    }
+};
+
+/**
+ * @brief Maps DMX channels to lamps and decides what may be transmitted
+ *
+ * Only quantized changes are sent (lamp accepts 0x00 - 0x17) and the airtime of the
+ * 2.4 GHz link is limited by a token budget, so a 44 Hz DMX stream is reduced to
+ * the rate the LC12S can carry. Lamps are served round-robin when the budget is short.
+ *
+ * Configuration string: "<universe>/<duty %>/<lamp id>:<intensity ch>:<hue ch>,..."
+ * example: "1/50/c21c009d1b000e:1:2,c21c009d1b000f:3:4"
+ */
+template <size_t Lamps>
+class DmxMapper
+{
+public:
+    /// @brief Lamp output
+    struct Output
+    {
+        std::array<uint8_t, 7> id{};    ///< lamp ID
+        bool on{false};                 ///< intensity channel > 0
+        uint8_t intensity{0};           ///< 0x00 - 0x17
+        uint8_t hue{0};                 ///< 0x00 - 0x17
+    };
+
+    /// @brief Parse configuration
+    /// @param cfg configuration string
+    /// @param frameTimeUs airtime of one RF frame
+    /// @return true if valid
+    bool configure(const std::string &cfg, uint32_t frameTimeUs)
+    {
+        _count = 0;
+        _frameTimeUs = frameTimeUs;
+
+        const char *p = cfg.c_str();
+        char *end = nullptr;
+        _universe = static_cast<uint16_t>(strtoul(p, &end, 10));
+        if (end == p || *end != '/')
+        {
+            return false;
+        }
+        p = end + 1;
+        _duty = static_cast<uint32_t>(strtoul(p, &end, 10));
+        if (end == p || *end != '/' || _duty == 0 || _duty > 100)
+        {
+            return false;
+        }
+        p = end + 1;
+
+        while (*p && _count < Lamps)
+        {
+            auto &m = _map[_count];
+            const char *colon = strchr(p, ':');
+            if (!colon || colon - p != 14 || !hex(p, 14))
+            {
+                return false;
+            }
+            m.out.id = Packet::stringToID(std::string(p, 14));
+            m.chIntensity = static_cast<uint16_t>(strtoul(colon + 1, &end, 10));
+            if (*end != ':')
+            {
+                return false;
+            }
+            m.chHue = static_cast<uint16_t>(strtoul(end + 1, &end, 10));
+            if (m.chIntensity < 1 || m.chIntensity > 512 || m.chHue < 1 || m.chHue > 512)
+            {
+                return false;
+            }
+            m.dirty = false;
+            m.valid = false;
+            _count++;
+            if (*end == ',')
+            {
+                end++;
+            }
+            p = end;
+        }
+
+        _budgetUs = _burstUs;
+        _hasSequence = false;
+        return _count > 0;
+    }
+
+    /// @brief New DMX frame
+    /// @param dmx universe data
+    /// @return false if ignored - other universe or out of order
+    bool update(const DmxData &dmx)
+    {
+        if (dmx.universe != _universe || !inOrder(dmx))
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < _count; ++i)
+        {
+            auto &m = _map[i];
+            if (m.chIntensity > dmx.length || m.chHue > dmx.length)
+            {
+                continue;
+            }
+
+            Output o = m.out;
+            uint8_t level = dmx.data[m.chIntensity - 1];
+            o.on = level > 0;
+            o.intensity = quantize(level);
+            o.hue = quantize(dmx.data[m.chHue - 1]);
+
+            if (!m.valid || o.on != m.sent.on || (o.on && (o.intensity != m.sent.intensity || o.hue != m.sent.hue)))
+            {
+                m.out = o;
+                m.dirty = true;
+            }
+            else
+            {
+                // back to the transmitted value
+                m.dirty = false;
+            }
+        }
+        return true;
+    }
+
+    /// @brief Next lamp to transmit within the airtime budget
+    /// @param nowUs monotonic time
+    /// @param out lamp output
+    /// @return true if out should be sent now
+    bool next(int64_t nowUs, Output &out)
+    {
+        refill(nowUs);
+        if (_budgetUs < static_cast<int64_t>(_frameTimeUs))
+        {
+            return false;
+        }
+
+        for (size_t n = 0; n < _count; ++n)
+        {
+            size_t i = (_rr + n) % _count;
+            auto &m = _map[i];
+            if (m.dirty)
+            {
+                m.dirty = false;
+                m.valid = true;
+                m.sent = m.out;
+                out = m.out;
+                _rr = i + 1;
+                _budgetUs -= _frameTimeUs;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// @brief Time to wait for the next transmit slot
+    /// @return microseconds, 0 - slot available
+    uint32_t waitUs() const
+    {
+        if (_budgetUs >= static_cast<int64_t>(_frameTimeUs) || _duty == 0)
+        {
+            return 0;
+        }
+        return static_cast<uint32_t>((_frameTimeUs - _budgetUs) * 100 / _duty);
+    }
+
+    /// @brief Any change waiting for transmit slot
+    bool pending() const
+    {
+        for (size_t i = 0; i < _count; ++i)
+        {
+            if (_map[i].dirty)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint16_t universe() const { return _universe; }
+    size_t lamps() const { return _count; }
+
+private:
+    struct Mapping
+    {
+        Output out;             ///< latest value from DMX
+        Output sent;            ///< last transmitted value
+        uint16_t chIntensity{1};///< DMX channel (1 based)
+        uint16_t chHue{2};      ///< DMX channel (1 based)
+        bool dirty{false};      ///< out differs from sent
+        bool valid{false};      ///< sent is valid
+    };
+
+    /// @brief Check hex digits, stringToID must not get anything else
+    static bool hex(const char *p, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (!isxdigit(static_cast<unsigned char>(p[i])))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// @brief E1.31 6.7.2 - a frame up to 20 behind the last one is late (UDP reordering),
+    /// a bigger step back is a restarted source and is accepted
+    bool inOrder(const DmxData &dmx)
+    {
+        if (!dmx.sequenced)
+        {
+            return true;
+        }
+        if (_hasSequence)
+        {
+            int8_t diff = static_cast<int8_t>(dmx.sequence - _sequence);
+            if (diff <= 0 && diff > -20)
+            {
+                return false;
+            }
+        }
+        _sequence = dmx.sequence;
+        _hasSequence = true;
+        return true;
+    }
+
+    /// @brief 0 - 255 -> 0x00 - 0x17
+    static uint8_t quantize(uint8_t v)
+    {
+        return static_cast<uint8_t>((static_cast<uint32_t>(v) * 0x17 + 127) / 255);
+    }
+
+    /// @brief Airtime budget grows by duty % of elapsed time
+    void refill(int64_t nowUs)
+    {
+        if (_lastUs != 0 && nowUs > _lastUs)
+        {
+            _budgetUs += (nowUs - _lastUs) * _duty / 100;
+            if (_budgetUs > _burstUs)
+            {
+                _budgetUs = _burstUs;
+            }
+        }
+        _lastUs = nowUs;
+    }
+
+    static constexpr int64_t _burstUs = 100000;     ///< max. saved airtime
+
+    std::array<Mapping, Lamps> _map{};  ///< channel mapping
+    size_t _count{0};                   ///< configured lamps
+    size_t _rr{0};                      ///< round-robin position
+    uint16_t _universe{0};              ///< listened universe
+    uint32_t _duty{50};                 ///< RF duty cycle ceiling [%]
+    uint32_t _frameTimeUs{13540};       ///< airtime of one frame
+    int64_t _budgetUs{0};               ///< available airtime
+    int64_t _lastUs{0};                 ///< last refill
+    uint8_t _sequence{0};               ///< last accepted sequence
+    bool _hasSequence{false};           ///< _sequence is valid
+};
+
+} // namespace lamp
@@ -0,0 +1,183 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   dmx_task.cpp
+/// @author Petr Vanek
+
+#include <stdio.h>
+#include <memory.h>
+#include <math.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <algorithm>
+#include "lwip/sockets.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "dmx_task.h"
+#include "application.h"
+#include "config.h"
+#include "literals.h"
+
+DmxTask::DmxTask()
+{
+	_queue = _queueMem.create();
+}
+
+DmxTask::~DmxTask()
+{
+	done();
+	close();
+	if (_queue)
+		vQueueDelete(_queue);
+}
+
+void DmxTask::loop()
+{
+	bool active = false;
+	bool load = true;
+	int req = 0;
+
+	auto lcs = Application::getInstance()->getLcsTask();
+	lcs->notifyDrained(task());
+
+	while (true)
+	{
+		// configuration (re)load, without valid configuration wait for reload()
+		if (load || xQueueReceive(_queue, (void *)&req, active ? 0 : portMAX_DELAY) == pdTRUE)
+		{
+			load = false;
+			close();
+			active = _mapper.configure(Config::getInstance().get().dmx, LC12STask::_frameTimeUs) && open();
+			if (!active)
+			{
+				// wait for valid configuration
+				continue;
+			}
+			ESP_LOGI("DmxTask", "universe %u, %u lamps", _mapper.universe(), static_cast<unsigned>(_mapper.lamps()));
+		}
+
+		// a change waits for the LCS queue - sleep until it drains, datagrams meanwhile
+		// stay in the socket buffers; otherwise wait for data or the next transmit slot
+		uint32_t waitUs = _idleMs * 1000;
+		if (_mapper.pending())
+		{
+			ulTaskNotifyTake(pdTRUE, 0);
+			if (lcs->pending() > 0)
+			{
+				ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(_drainWaitMs));
+				waitUs = 0;
+			}
+			else
+			{
+				waitUs = _mapper.waitUs();
+			}
+		}
+		poll(waitUs);
+
+		// adaptive downsampling - only changes, within the RF airtime budget and
+		// only when the LCS queue is drained, otherwise the value is sent later
+		lamp::DmxMapper<_maxLamps>::Output out;
+		while (lcs->pending() == 0 && _mapper.next(esp_timer_get_time(), out))
+		{
+			lcs->direct(out.id, out.on, out.intensity, out.hue, LCSOrigin{LCSSource::Dmx, 0});
+		}
+	}
+}
+
+void DmxTask::poll(uint32_t waitUs)
+{
+	// the first select waits, the rest reads what has queued up - the mapper keeps the newest values
+	for (size_t n = 0; n < _maxBacklog; ++n)
+	{
+		struct timeval tv = {
+			.tv_sec = static_cast<time_t>(waitUs / 1000000),
+			.tv_usec = static_cast<suseconds_t>(waitUs % 1000000)
+		};
+
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(_artNet, &fds);
+		FD_SET(_sacn, &fds);
+		if (select(std::max(_artNet, _sacn) + 1, &fds, nullptr, nullptr, &tv) <= 0)
+		{
+			return;
+		}
+		if (FD_ISSET(_artNet, &fds)) receive(_artNet, true);
+		if (FD_ISSET(_sacn, &fds)) receive(_sacn, false);
+		waitUs = 0;
+	}
+}
+
+bool DmxTask::open()
+{
+	auto bindUdp = [](uint16_t port) -> int {
+		int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (sock < 0) {
+			return -1;
+		}
+		int reuse = 1;
+		setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+		struct sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		if (bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) {
+			::close(sock);
+			return -1;
+		}
+		return sock;
+	};
+
+	_artNet = bindUdp(lamp::DmxDecoder::_artNetPort);
+	_sacn = bindUdp(lamp::DmxDecoder::_sacnPort);
+	if (_artNet < 0 || _sacn < 0) {
+		ESP_LOGE("DmxTask", "socket failed");
+		close();
+		return false;
+	}
+
+	// E1.31 multicast group 239.255.<universe hi>.<universe lo>
+	struct ip_mreq mreq = {};
+	uint16_t u = _mapper.universe();
+	mreq.imr_multiaddr.s_addr = htonl(0xEFFF0000ul | u);
+	mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+	setsockopt(_sacn, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+	return true;
+}
+
+void DmxTask::close()
+{
+	if (_artNet >= 0) {
+		::close(_artNet);
+		_artNet = -1;
+	}
+	if (_sacn >= 0) {
+		::close(_sacn);
+		_sacn = -1;
+	}
+}
+
+void DmxTask::receive(int sock, bool artNet)
+{
+	int len = recv(sock, _buf, sizeof(_buf), 0);
+	if (len <= 0) {
+		return;
+	}
+
+	lamp::DmxData dmx;
+	bool ok = artNet ? lamp::DmxDecoder::artNet(_buf, len, dmx) : lamp::DmxDecoder::sacn(_buf, len, dmx);
+	if (ok) {
+		_mapper.update(dmx);
+	}
+}
+
+void DmxTask::reload()
+{
+	if (_queue)
+	{
+		int req = 1;
+		xQueueOverwrite(_queue, (void *)&req);
+	}
+}
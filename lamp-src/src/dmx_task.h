@@ -0,0 +1,42 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   dmx_task.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include "hardware.h"
+#include "rptask.h"
+#include "dmx.h"
+
+/// @brief Art-Net / E1.31 receiver driving lamps over LC12S
+class DmxTask : public RPTask
+{
+public:
+	DmxTask();
+	virtual ~DmxTask();
+	void reload();
+
+protected:
+	void loop() override;
+
+private:
+	bool open();
+	void close();
+	void poll(uint32_t waitUs);
+	void receive(int sock, bool artNet);
+
+	static constexpr size_t _maxLamps{8};		///< mapped lamps
+	static constexpr uint32_t _idleMs{1000};	///< select timeout without pending changes
+	static constexpr uint32_t _drainWaitMs{200};	///< LCS drain notification timeout, a full queue takes 135 ms
+	static constexpr size_t _maxBacklog{16};		///< datagrams read per wake-up
+
+	QueueHandle_t 			_queue;
+	QueueMemory<int, 1> _queueMem;		///< static queue storage
+	lamp::DmxMapper<_maxLamps> _mapper;
+	int 					_artNet{-1};		///< Art-Net socket
+	int 					_sacn{-1};			///< E1.31 socket
+	uint8_t 				_buf[640];			///< datagram buffer
+};
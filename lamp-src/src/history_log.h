@@ -0,0 +1,231 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   history_log.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <ctime>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "rptimer.h"
+#include "bus.h"
+#include "lcs_info.h"
+#include "history_ring.h"
+#include "metrics.h"
+#include "trace.h"
+
+/// @brief Append-only lamp history in the "history" partition
+///
+/// The partition is a HistoryRing of erase blocks, see there for the layout.
+///
+/// Lamp states come from the bus in the publisher's task; changes are only queued
+/// in RAM there and written from the FreeRTOS timer task, flash erase never stalls
+/// the 2.4 GHz link.
+class HistoryLog {
+    /// @brief Flash of the ring - the partition
+    struct Partition {
+        const esp_partition_t *part{nullptr};
+
+        bool read(size_t offset, void *dst, size_t len) {
+            return esp_partition_read(part, offset, dst, len) == ESP_OK;
+        }
+
+        bool write(size_t offset, const void *src, size_t len) {
+            if (esp_partition_write(part, offset, src, len) != ESP_OK) {
+                ESP_LOGE("HistoryLog", "write failed");
+                return false;
+            }
+            return true;
+        }
+
+        bool erase(size_t offset, size_t len) {
+            if (esp_partition_erase_range(part, offset, len) != ESP_OK) {
+                ESP_LOGE("HistoryLog", "erase failed");
+                return false;
+            }
+            return true;
+        }
+    };
+
+    using Ring = HistoryRing<Partition>;
+
+public:
+    /// @brief Read position, starts at the oldest record
+    using Cursor = Ring::Cursor;
+
+    static HistoryLog &getInstance() {
+        static HistoryLog instance;
+        return instance;
+    }
+
+    HistoryLog(HistoryLog const &) = delete;
+    void operator=(HistoryLog const &) = delete;
+
+    /// @brief Subscribe lamp state, call before the tasks start
+    ///
+    /// States published before init() are queued in RAM and written once the index is built.
+    void subscribe() {
+        _timer.init("history", pdMS_TO_TICKS(_flushMs), false);
+        Bus<LampState>::subscribe(&HistoryLog::onState, this);
+    }
+
+    /// @brief Find partition, build the index
+    ///
+    /// Reads the whole log once (256 kB), call after the 2.4 GHz & button tasks start.
+    /// @return true if the partition is usable
+    bool init() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_ring.isOpen()) {
+            return true;
+        }
+
+        const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, _label);
+        if (!part) {
+            ESP_LOGE("HistoryLog", "no '%s' partition", _label);
+            disable();
+            return false;
+        }
+        if (part->size / Ring::_blockSize < 2) {
+            ESP_LOGE("HistoryLog", "partition too small");
+            disable();
+            return false;
+        }
+        _partition.part = part;
+
+        const int64_t start = esp_timer_get_time();
+        if (!_ring.open(_partition, part->size / Ring::_blockSize)) {
+            disable();
+            return false;
+        }
+        ESP_LOGI("HistoryLog", "%u blocks, head %u, index built in %d ms", static_cast<unsigned>(_ring.blocks()),
+                 static_cast<unsigned>(_ring.headSeq()), static_cast<int>((esp_timer_get_time() - start) / 1000));
+
+        // states queued during the scan
+        _ready = true;
+        _timer.changePeriod(pdMS_TO_TICKS(_flushMs), 0);
+        return true;
+    }
+
+    /// @brief Read matching records, see HistoryRing::read()
+    size_t read(Cursor &cur, uint32_t from, uint32_t to, HistoryRecord *out, size_t max) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _ring.read(cur, from, to, out, max);
+    }
+
+    /// @brief Write queued records now, blocks on flash
+    /// @return true - success
+    bool flush() {
+        // index not built yet - keep the queue, don't wait for the scan in the timer task
+        if (!_ready) {
+            return false;
+        }
+
+        std::array<HistoryRecord, _pendingMax> batch;
+        size_t count = 0;
+        {
+            std::lock_guard<std::mutex> lock(_pendingMutex);
+            count = _pendingCount;
+            std::copy_n(_pending.begin(), count, batch.begin());
+            _pendingCount = 0;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_ring.isOpen()) {
+            return false;
+        }
+        TraceSpan span(TraceEvent::HistoryWrite, static_cast<uint16_t>(count));
+        bool ok = true;
+        for (size_t i = 0; i < count; ++i) {
+            ok = _ring.append(batch[i]) && ok;
+        }
+        return ok;
+    }
+
+private:
+    /// @brief Flush from the FreeRTOS timer task
+    class FlushTimer : public RPTimer {
+        void loop() override {
+            HistoryLog::getInstance().flush();
+        }
+    };
+
+    HistoryLog() = default;
+
+    static constexpr const char *_label{"history"};
+    static constexpr size_t _pendingMax{32};           ///< queued changes, more are dropped
+    static constexpr uint32_t _flushMs{1000};          ///< write delay, batches bursts
+    static constexpr time_t _clockValid{1700000000};   ///< SNTP has set the clock
+
+    static void onState(const LampState &state, void *ctx) {
+        static_cast<HistoryLog *>(ctx)->record(state);
+    }
+
+    /// @brief Queue a state change, runs in the publisher's task
+    void record(const LampState &state) {
+        if (_disabled) {
+            return;
+        }
+
+        HistoryRecord rec{};
+        const time_t now = time(nullptr);
+        if (now >= _clockValid) {
+            rec.time = static_cast<uint32_t>(now);
+            rec.flags = HistoryRecord::Clock;
+        } else {
+            rec.time = static_cast<uint32_t>(esp_timer_get_time() / 1000000);
+        }
+        rec.id = state.id;
+        rec.command = state.command;
+        rec.intensity = state.intensity;
+        rec.hue = state.hue;
+        rec.check = Ring::check(rec);
+
+        {
+            std::lock_guard<std::mutex> lock(_pendingMutex);
+            // repeated frames of the remote carry the same state
+            if (_hasLast && _last.id == rec.id && _last.command == rec.command &&
+                _last.intensity == rec.intensity && _last.hue == rec.hue) {
+                return;
+            }
+            _last = rec;
+            _hasLast = true;
+            if (_pendingCount >= _pending.size()) {
+                Metrics::add(Metric::DropHistory);
+                return;
+            }
+            _pending[_pendingCount++] = rec;
+        }
+        // a command to the timer task - no wait, a full timer queue leaves it to the next change
+        _timer.changePeriod(pdMS_TO_TICKS(_flushMs), 0);
+    }
+
+    /// @brief No usable partition - drop the queue, stop recording
+    void disable() {
+        _disabled = true;
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+        _pendingCount = 0;
+    }
+
+    Partition _partition;
+    Ring _ring;                                        ///< blocks & index
+    mutable std::mutex _mutex;                         ///< flash & index
+
+    std::mutex _pendingMutex;                          ///< queued records
+    std::array<HistoryRecord, _pendingMax> _pending{};
+    size_t _pendingCount{0};
+    HistoryRecord _last{};                             ///< last queued state
+    bool _hasLast{false};
+    FlushTimer _timer;
+    std::atomic<bool> _ready{false};                   ///< index built, flush writes
+    std::atomic<bool> _disabled{false};                ///< no usable partition
+};
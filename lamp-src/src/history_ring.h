@@ -0,0 +1,304 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   history_ring.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+
+/// @brief Lamp state change, 16 bytes in flash
+struct HistoryRecord {
+    enum Flag : uint8_t {
+        Clock = 0x01                ///< time is unix time, uptime [s] otherwise
+    };
+
+    uint32_t time;                  ///< unix time or uptime [s], see Clock
+    std::array<uint8_t, 7> id;      ///< lamp ID
+    uint8_t command;                ///< lamp::Packet::Command
+    uint8_t intensity;
+    uint8_t hue;
+    uint8_t flags;                  ///< Flag bits
+    uint8_t check;                  ///< HistoryRing::check(), detects torn writes
+};
+
+static_assert(sizeof(HistoryRecord) == 16, "HistoryRecord is a flash slot");
+static_assert(std::is_trivially_copyable<HistoryRecord>::value, "HistoryRecord is stored as bytes");
+
+/// @brief Ring of erase blocks with a RAM index, the flash part of HistoryLog
+///
+/// No hardware and no OS dependency - flash access is a template parameter, the
+/// caller serializes the calls. A block starts with a header (magic, block sequence
+/// number) followed by record slots, free slots are erased flash (0xFF). The oldest
+/// block is erased when the newest one is full, so every block is erased equally
+/// often. The index keeps sequence, time range and record count of each block - a
+/// query reads only the blocks overlapping the asked range.
+///
+/// Flash provides (offsets from the start of the ring):
+///   bool read(size_t offset, void *dst, size_t len);
+///   bool write(size_t offset, const void *src, size_t len);
+///   bool erase(size_t offset, size_t len);
+template <typename Flash>
+class HistoryRing {
+public:
+    static constexpr size_t _blockSize{4096};          ///< flash erase block
+    static constexpr size_t _maxBlocks{64};            ///< index size, 256 kB
+    static constexpr uint16_t _slots{_blockSize / sizeof(HistoryRecord) - 1};
+
+    /// @brief Read position, starts at the oldest record
+    struct Cursor {
+        uint32_t seq{0};            ///< block sequence number
+        uint16_t slot{0};           ///< next slot in the block
+    };
+
+    /// @brief Build the index, start the first block of an empty ring
+    /// @param flash flash access, kept until the ring is destroyed
+    /// @param blocks erase blocks of the ring, at least 2, more than _maxBlocks are unused
+    /// @return true if the ring is usable
+    bool open(Flash &flash, size_t blocks) {
+        _blocks = std::min(blocks, _maxBlocks);
+        if (_blocks < 2) {
+            return false;
+        }
+        _flash = &flash;
+
+        bool any = false;
+        for (size_t i = 0; i < _blocks; ++i) {
+            scan(i);
+            if (_index[i].valid && (!any || static_cast<int32_t>(_index[i].seq - _headSeq) > 0)) {
+                _head = i;
+                _headSeq = _index[i].seq;
+                any = true;
+            }
+        }
+        if (!any && !startBlock(0, 1)) {
+            _flash = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    bool isOpen() const {
+        return _flash != nullptr;
+    }
+
+    size_t blocks() const {
+        return _blocks;
+    }
+
+    /// @brief Sequence number of the block being written
+    uint32_t headSeq() const {
+        return _headSeq;
+    }
+
+    /// @brief Read matching records
+    ///
+    /// A time range selects records with unix time only - uptime records (written before
+    /// SNTP) can't be placed on the unix time line. Without a range all records are read.
+    /// @param cur position, advanced; a position in an overwritten block continues from the oldest record
+    /// @param from unix time >= [s], 0 - no lower bound
+    /// @param to unix time <= [s], UINT32_MAX - no upper bound
+    /// @param out output records
+    /// @param max capacity of out
+    /// @return records read, 0 - end of log
+    size_t read(Cursor &cur, uint32_t from, uint32_t to, HistoryRecord *out, size_t max) const {
+        if (!_flash) {
+            return 0;
+        }
+
+        const uint32_t oldest = oldestSeq();
+        if (static_cast<int32_t>(cur.seq - oldest) < 0) {
+            cur.seq = oldest;
+            cur.slot = 0;
+        }
+
+        const bool all = from == 0 && to == UINT32_MAX;
+        size_t n = 0;
+        std::array<HistoryRecord, _readBatch> batch;
+        while (n < max && static_cast<int32_t>(cur.seq - _headSeq) <= 0) {
+            const Summary *blk = find(cur.seq);
+            if (!blk || cur.slot >= blk->used || (!all && (blk->maxTime < from || blk->minTime > to))) {
+                if (cur.seq == _headSeq) {
+                    // end of log - the cursor stays in the head block, the next read continues with new records
+                    break;
+                }
+                // whole block is outside the range
+                cur.seq++;
+                cur.slot = 0;
+                continue;
+            }
+
+            const size_t count = std::min({batch.size(), static_cast<size_t>(blk->used - cur.slot), max - n});
+            if (!_flash->read(slotOffset(blk - _index.data(), cur.slot), batch.data(), count * sizeof(HistoryRecord))) {
+                break;
+            }
+            cur.slot += count;
+            for (size_t i = 0; i < count; ++i) {
+                const auto &rec = batch[i];
+                if (rec.check == check(rec) &&
+                    (all || ((rec.flags & HistoryRecord::Clock) && rec.time >= from && rec.time <= to))) {
+                    out[n++] = rec;
+                }
+            }
+        }
+        return n;
+    }
+
+    /// @brief Write record into the head block, the oldest block is overwritten when it is full
+    /// @return true - success
+    bool append(const HistoryRecord &rec) {
+        if (!_flash) {
+            return false;
+        }
+        if (!_index[_head].valid || _index[_head].used >= _slots) {
+            if (!startBlock((_head + 1) % _blocks, _headSeq + 1)) {
+                return false;
+            }
+        }
+        Summary &blk = _index[_head];
+        if (!_flash->write(slotOffset(_head, blk.used), &rec, sizeof(rec))) {
+            // the slot may be partially written, it is skipped by check
+            blk.used++;
+            return false;
+        }
+        blk.used++;
+        extend(blk, rec);
+        return true;
+    }
+
+    /// @brief Check byte of the record
+    static uint8_t check(const HistoryRecord &rec) {
+        const auto *raw = reinterpret_cast<const uint8_t *>(&rec);
+        uint8_t sum = 0x5A;         // an erased slot never matches
+        for (size_t i = 0; i < offsetof(HistoryRecord, check); ++i) {
+            sum ^= raw[i];
+        }
+        return sum;
+    }
+
+private:
+    /// @brief Block of the RAM index
+    struct Summary {
+        uint32_t seq{0};            ///< block sequence number
+        uint32_t minTime{0};        ///< unix time range of the Clock records
+        uint32_t maxTime{0};
+        uint16_t used{0};           ///< written slots
+        bool valid{false};          ///< header written
+    };
+
+    /// @brief Block header, one slot
+    struct Header {
+        uint32_t magic;
+        uint32_t seq;
+        uint32_t reserved[2];
+    };
+
+    static_assert(sizeof(Header) == sizeof(HistoryRecord), "header takes slot 0");
+
+    static constexpr uint32_t _magic{0x4C484931u};     ///< "LHI1"
+    static constexpr size_t _readBatch{16};            ///< records per flash read
+
+    size_t blockOffset(size_t block) const {
+        return block * _blockSize;
+    }
+
+    size_t slotOffset(size_t block, size_t slot) const {
+        return blockOffset(block) + (slot + 1) * sizeof(HistoryRecord);
+    }
+
+    uint32_t oldestSeq() const {
+        uint32_t oldest = _headSeq;
+        for (size_t i = 0; i < _blocks; ++i) {
+            if (_index[i].valid && static_cast<int32_t>(_index[i].seq - oldest) < 0) {
+                oldest = _index[i].seq;
+            }
+        }
+        return oldest;
+    }
+
+    /// @brief Block by sequence number, blocks follow the ring order
+    const Summary *find(uint32_t seq) const {
+        const size_t back = _headSeq - seq;
+        if (back >= _blocks) {
+            return nullptr;
+        }
+        const Summary &blk = _index[(_head + _blocks - back) % _blocks];
+        return blk.valid && blk.seq == seq ? &blk : nullptr;
+    }
+
+    /// @brief Rebuild the summary of a block from flash
+    void scan(size_t block) {
+        Summary &blk = _index[block];
+        blk = Summary{};
+
+        Header hdr;
+        if (!_flash->read(blockOffset(block), &hdr, sizeof(hdr)) || hdr.magic != _magic) {
+            return;
+        }
+        blk.valid = true;
+        blk.seq = hdr.seq;
+        blk.minTime = UINT32_MAX;
+
+        std::array<HistoryRecord, _readBatch> batch;
+        for (uint16_t slot = 0; slot < _slots; slot += batch.size()) {
+            const size_t count = std::min<size_t>(batch.size(), _slots - slot);
+            if (!_flash->read(slotOffset(block, slot), batch.data(), count * sizeof(HistoryRecord))) {
+                return;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                const auto &rec = batch[i];
+                if (erased(rec)) {
+                    // append-only - the first free slot ends the block
+                    return;
+                }
+                blk.used++;
+                if (rec.check == check(rec)) {
+                    extend(blk, rec);
+                }
+            }
+        }
+    }
+
+    static bool erased(const HistoryRecord &rec) {
+        const auto *raw = reinterpret_cast<const uint8_t *>(&rec);
+        return std::all_of(raw, raw + sizeof(rec), [](uint8_t b) { return b == 0xFF; });
+    }
+
+    /// @brief Erase block & write its header
+    bool startBlock(size_t block, uint32_t seq) {
+        _index[block] = Summary{};
+        if (!_flash->erase(blockOffset(block), _blockSize)) {
+            return false;
+        }
+        const Header hdr{_magic, seq, {UINT32_MAX, UINT32_MAX}};
+        if (!_flash->write(blockOffset(block), &hdr, sizeof(hdr))) {
+            return false;
+        }
+        _index[block].valid = true;
+        _index[block].seq = seq;
+        _index[block].minTime = UINT32_MAX;
+        _head = block;
+        _headSeq = seq;
+        return true;
+    }
+
+    /// @brief Time range of the block, uptime records are not on the unix time line
+    static void extend(Summary &blk, const HistoryRecord &rec) {
+        if (rec.flags & HistoryRecord::Clock) {
+            blk.minTime = std::min(blk.minTime, rec.time);
+            blk.maxTime = std::max(blk.maxTime, rec.time);
+        }
+    }
+
+    Flash *_flash{nullptr};
+    size_t _blocks{0};                                 ///< blocks in the ring
+    size_t _head{0};                                   ///< block being written
+    uint32_t _headSeq{0};                              ///< its sequence number
+    std::array<Summary, _maxBlocks> _index{};          ///< block summaries
+};
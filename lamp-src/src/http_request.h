@@ -7,41 +7,70 @@
 
 #pragma once
 
-
-#include "esp_http_server.h"
 #include <string>
 #include <cstring>
-
-#include <string>
+#include <cctype>
 #include <map>
-#include <sstream>
-#include <iostream>
 
 
 class HttpReqest
 {
 public:
 
+/// @brief Parse application/x-www-form-urlencoded body
+/// @param data body
+/// @return key - decoded value, pairs without '=' are skipped
 static std::map<std::string, std::string> parseFormData(const std::string& data) {
     std::map<std::string, std::string> form_data;
-    std::istringstream data_stream(data);
-    std::string pair;
+    size_t begin = 0;
 
-    while (std::getline(data_stream, pair, '&')) {
-        std::string::size_type pos = pair.find('=');
+    // pairs are scanned in place, only key & value are copied
+    while (begin <= data.size()) {
+        size_t end = data.find('&', begin);
+        if (end == std::string::npos) {
+            end = data.size();
+        }
+
+        const size_t pos = data.find('=', begin);
+        if (pos < end) {
+            form_data[data.substr(begin, pos - begin)] = urlDecode(data.data() + pos + 1, end - pos - 1);
+        }
+        begin = end + 1;
+    }
 
-        if (pos != std::string::npos) {
-            std::string key = pair.substr(0, pos);
-            std::string value = pair.substr(pos + 1);
+    return form_data;
+}
 
-            // Případné URL dekódování hodnoty zde
-            // ...
+/// @brief Decode application/x-www-form-urlencoded value
+/// @param data encoded value
+/// @return decoded value
+static std::string urlDecode(const std::string& data) {
+    return urlDecode(data.data(), data.size());
+}
 
-            form_data[key] = value;
+/// @brief Decode application/x-www-form-urlencoded value
+/// @param data encoded value
+/// @param size bytes
+/// @return decoded value, one allocation
+static std::string urlDecode(const char* data, size_t size) {
+    std::string rc;
+    rc.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+        if (data[i] == '+') {
+            rc += ' ';
+        } else if (data[i] == '%' && i + 2 < size && isxdigit(static_cast<unsigned char>(data[i + 1])) && isxdigit(static_cast<unsigned char>(data[i + 2]))) {
+            rc += static_cast<char>((hexValue(data[i + 1]) << 4) | hexValue(data[i + 2]));
+            i += 2;
+        } else {
+            rc += data[i];
         }
     }
+    return rc;
+}
 
-    return form_data;
+/// @brief Value of a hex digit, checked by the caller
+static int hexValue(char c) {
+    return isdigit(static_cast<unsigned char>(c)) ? c - '0' : (tolower(static_cast<unsigned char>(c)) - 'a' + 10);
 }
 
 std::string static getValue(const std::map<std::string, std::string>& map, const std::string& key) {
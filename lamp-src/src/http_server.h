@@ -11,11 +11,23 @@
 #include <functional>
 #include <memory>
 #include <list>
+#include <cstring>
+#include <atomic>
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "rate_limiter.h"
+#include "metrics.h"
+#include "trace.h"
+#include "boot_phases.h"
 
 class HttpServer {
 public:
     HttpServer() : _server(nullptr) {
         _config = HTTPD_DEFAULT_CONFIG();
+        // keep a socket reserve for the UI, the oldest idle connection is purged
+        _config.max_open_sockets = _defaultMaxOpenSockets;
+        _config.lru_purge_enable = true;
+        _config.max_uri_handlers = _maxUriHandlers;
     }
 
     ~HttpServer() {
@@ -23,6 +35,39 @@ public:
     }
 
     using HttpHandlerFunc = std::function<esp_err_t(httpd_req_t *req)>;
+    using RetryAfterFunc = std::function<uint32_t()>;
+    using RouteFunc = std::function<void(const std::string &uri, httpd_method_t method, uint32_t requests)>;
+
+    /// @brief Maximum of open sockets, lwip reserves 3 sockets for httpd internal use
+    /// @param count number of sockets, applied by next start()
+    /// @param lruPurge close the least recently used connection if no socket is free
+    void setMaxOpenSockets(uint16_t count, bool lruPurge = true) {
+        _config.max_open_sockets = count;
+        _config.lru_purge_enable = lruPurge;
+    }
+
+    /// @brief Placement of the httpd task, applied by next start()
+    /// @param priority task priority
+    /// @param core core id or tskNO_AFFINITY
+    /// @param stack stack size
+    void setTask(UBaseType_t priority, BaseType_t core, size_t stack) {
+        _config.task_priority = priority;
+        _config.core_id = core;
+        _config.stack_size = stack;
+    }
+
+    /// @brief Admission control of throttled handlers
+    /// @param ratePerSec requests per second per client
+    /// @param burst burst size per client
+    void setRateLimit(uint32_t ratePerSec, uint32_t burst) {
+        _limiter.configure(ratePerSec, burst);
+    }
+
+    /// @brief Source of the Retry-After value for rejected requests
+    /// @param retryAfter returns seconds
+    void setRetryAfter(RetryAfterFunc retryAfter) {
+        _retryAfter = retryAfter;
+    }
 
     bool start() {
         if (_server != nullptr) {
@@ -32,18 +77,31 @@ public:
         return (httpd_start(&_server, &_config) == ESP_OK);
     }
 
- bool registerUriHandler(const std::string& uri, httpd_method_t method, HttpHandlerFunc handler) {
+    /// @brief Register URI handler
+    /// @param uri URI
+    /// @param method HTTP method
+    /// @param handler handler
+    /// @param throttled true - handler is subject of per-client admission control
+    /// @return true if success
+    bool registerUriHandler(const std::string& uri, httpd_method_t method, HttpHandlerFunc handler, bool throttled = false) {
         if (!_server) return false;
 
-        _handlerList.push_back(std::make_shared<HttpHandlerFunc>(handler));
+        _handlerList.push_back(std::make_shared<Route>(uri, method, handler, throttled, this));
         auto& handlerWrapper = _handlerList.back();
 
         httpd_uri_t httpdUri = {
             .uri = uri.c_str(),
             .method = method,
             .handler = [](httpd_req_t *req) -> esp_err_t {
-                auto& handlerFunction = *static_cast<std::shared_ptr<HttpHandlerFunc>*>(req->user_ctx);
-                return handlerFunction->operator()(req);
+                auto& route = *static_cast<std::shared_ptr<Route>*>(req->user_ctx);
+                route->requests.fetch_add(1, std::memory_order_relaxed);
+                TraceSpan span(TraceEvent::HttpHandler);
+                if (route->throttled && !route->server->admit(req)) {
+                    return route->server->sendTooManyRequests(req);
+                }
+                const esp_err_t rc = route->handler(req);
+                BootPhases::mark(BootPhase::FirstHttp);
+                return rc;
             },
             .user_ctx = &handlerWrapper
         };
@@ -56,17 +114,84 @@ public:
         return true;
     }
 
+    /// @brief Reply 429 with Retry-After, used also for back-pressure from handlers
+    /// @param req request
+    /// @return ESP_OK
+    esp_err_t sendTooManyRequests(httpd_req_t *req) {
+        char retry[12];
+        snprintf(retry, sizeof(retry), "%u", static_cast<unsigned>(_retryAfter ? _retryAfter() : 1));
+        Metrics::add(Metric::HttpRejected);
+        httpd_resp_set_status(req, "429 Too Many Requests");
+        httpd_resp_set_hdr(req, "Retry-After", retry);
+        return httpd_resp_send(req, "", 0);
+    }
+
+    /// @brief Number of requests rejected by admission control
+    uint32_t rejected() const {
+        return _limiter.rejected();
+    }
+
+    /// @brief Request counters of registered handlers
+    /// @param fn called for every route
+    void forEachRoute(RouteFunc fn) const {
+        for (const auto& route : _handlerList) {
+            fn(route->uri, route->method, route->requests.load(std::memory_order_relaxed));
+        }
+    }
+
     void stop() {
         if (_server != nullptr) {
             httpd_stop(_server);
             _server = nullptr;
-            _handlerList.clear(); 
+            _handlerList.clear();
         }
     }
 
 
 private:
+
+    /// @brief Registered handler
+    struct Route {
+        Route(const std::string& u, httpd_method_t m, HttpHandlerFunc h, bool t, HttpServer *s)
+            : uri(u), method(m), handler(h), throttled(t), server(s) {}
+
+        std::string uri;                    ///< registered URI
+        httpd_method_t method;              ///< HTTP method
+        HttpHandlerFunc handler;            ///< user handler
+        bool throttled;                     ///< admission control
+        HttpServer *server;                 ///< owner
+        std::atomic<uint32_t> requests{0};  ///< handled requests
+    };
+
+    /// @brief Per-client admission, handlers run in the httpd task only
+    bool admit(httpd_req_t *req) {
+        return _limiter.admit(clientAddress(req), esp_timer_get_time());
+    }
+
+    /// @brief IPv4 address of the peer, IPv4-mapped IPv6 address is also accepted
+    static uint32_t clientAddress(httpd_req_t *req) {
+        struct sockaddr_storage addr;
+        socklen_t len = sizeof(addr);
+        if (getpeername(httpd_req_to_sockfd(req), reinterpret_cast<struct sockaddr *>(&addr), &len) != 0) {
+            return 0;
+        }
+
+        uint32_t ip = 0;
+        if (addr.ss_family == AF_INET) {
+            ip = reinterpret_cast<struct sockaddr_in *>(&addr)->sin_addr.s_addr;
+        } else if (addr.ss_family == AF_INET6) {
+            // last 4 bytes of ::ffff:a.b.c.d
+            memcpy(&ip, reinterpret_cast<struct sockaddr_in6 *>(&addr)->sin6_addr.s6_addr + 12, sizeof(ip));
+        }
+        return ip;
+    }
+
+    static constexpr uint16_t _maxUriHandlers{16};          ///< default 8 is not enough for control mode
+    static constexpr uint16_t _defaultMaxOpenSockets{5};    ///< the rest of CONFIG_LWIP_MAX_SOCKETS is left for UDP tasks
+
     httpd_handle_t _server;
     httpd_config_t _config;
-    std::list<std::shared_ptr<HttpHandlerFunc>> _handlerList; 
+    std::list<std::shared_ptr<Route>> _handlerList;
+    TokenBucketLimiter<8> _limiter;                         ///< per-client admission control
+    RetryAfterFunc _retryAfter{};                           ///< Retry-After source
 };
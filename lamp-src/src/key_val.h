@@ -8,12 +8,26 @@
 #pragma once
 
 #include <string>
+#include <algorithm>
 #include "nvs_flash.h"
 #include "nvs.h"
 #include <mutex>
+#include "esp_log.h"
+#include "esp_system.h"
+#include "rptimer.h"
+#include "trace.h"
+#include "pending_writes.h"
 
 
-/// @brief Key Value NVS storage
+/// @brief Key Value NVS storage, write-behind
+///
+/// Writes go to an in-RAM dirty set (PendingWrites) and return without touching the
+/// flash. The set is written with a single nvs_commit from the FreeRTOS timer task after a quiet
+/// period, at most _maxDelayMs after the first pending write, immediately when
+/// _flushCount keys are pending, on esp_restart (shutdown handler) or by flush().
+/// Reads see the pending values. A failed write or commit returns its keys to the
+/// dirty set (newer writes win) and retries after _retryMs. A brownout has no usable
+/// hook - at most the pending writes of the last _maxDelayMs are lost.
 class KeyVal {
 public:
     static KeyVal& getInstance() {
@@ -38,37 +52,40 @@ public:
             }
         }
 
-        esp_err_t ret = nvs_open(namespaceName.c_str(), readOnly ? NVS_READONLY : NVS_READWRITE, &_nvsHandle);
+        esp_err_t ret = nvs_open(namespaceName.c_str(), readOnly ? NVS_READONLY : NVS_READWRITE, &_nvs.handle);
         if (ret != ESP_OK) {
             return false;
         }
 
+        if (!readOnly) {
+            _timer.init("kvflush", pdMS_TO_TICKS(_quietMs), false);
+            esp_register_shutdown_handler([]() {
+                KeyVal::getInstance().flush();
+            });
+        }
+
         _isInitialized = true;
         return true;
     }
 
     void done() {
+        flush();
         std::lock_guard<std::mutex> lock(_mutex);
 
         if (_isInitialized) {
-            nvs_close(_nvsHandle);
+            _timer.done();
+            nvs_close(_nvs.handle);
             _isInitialized = false;
         }
     }
 
-    /// @brief Write number aka uint32_t
+    /// @brief Write number aka uint32_t, deferred
     /// @param key Key name
     /// @param value content
     /// @return true - success
     bool writeUint32(const std::string &key, uint32_t value)
     { 
-        std::lock_guard<std::mutex> lock(_mutex);
-        esp_err_t err = nvs_set_u32(this->_nvsHandle, key.c_str(), value);
-        if (err != ESP_OK) {
-            return false;
-        }
-        err = nvs_commit(this->_nvsHandle); 
-        return err == ESP_OK;
+        return stage(key, StoredValue{StoredValue::Kind::U32, value, {}});
     }
 
     /// @brief Write string
@@ -82,13 +99,39 @@ public:
 
     bool writeString(const char* key, const char* value)
     {
-        std::lock_guard<std::mutex> lock(_mutex);
-        esp_err_t err = nvs_set_str(this->_nvsHandle, key, value);
-        if (err != ESP_OK) {
-            return false;
+        return stage(key, StoredValue{StoredValue::Kind::Str, 0, value});
+    }
+
+    /// @brief Write binary blob, deferred
+    /// @param key Key name
+    /// @param data content
+    /// @param length bytes
+    /// @return true - success
+    bool writeBlob(const std::string &key, const void *data, size_t length)
+    {
+        return stage(key, StoredValue{StoredValue::Kind::Blob, 0, std::string(static_cast<const char *>(data), length)});
+    }
+
+    /// @brief Write pending values now, blocks on flash
+    /// @return true - success
+    bool flush()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_isInitialized) {
+                return true;
+            }
+        }
+
+        bool ok;
+        {
+            std::lock_guard<std::mutex> lock(_nvsMutex);
+            ok = _pending.flush(_nvs, xTaskGetTickCount());
         }
-        err = nvs_commit(this->_nvsHandle); 
-        return err == ESP_OK;
+        if (!ok) {
+            _timer.changePeriod(pdMS_TO_TICKS(_retryMs), 0);
+        }
+        return ok;
     }
 
     /// @brief Read uint32_t from NVS
@@ -97,9 +140,13 @@ public:
     /// @return true - success
     uint32_t readUint32(const std::string &key, const uint32_t defvalue = 0) const
     {
-        std::lock_guard<std::mutex> lock(_mutex);
+        StoredValue pending;
+        if (_pending.find(key, pending) && pending.kind == StoredValue::Kind::U32) {
+            return pending.num;
+        }
+        std::lock_guard<std::mutex> lock(_nvsMutex);
         uint32_t value = 0;
-        if (nvs_get_u32(this->_nvsHandle, key.c_str(), &value) != ESP_OK)
+        if (nvs_get_u32(_nvs.handle, key.c_str(), &value) != ESP_OK)
             value = defvalue;
         return value;
     }
@@ -110,16 +157,20 @@ public:
     /// @return true - success
     std::string readString(const std::string &key, const std::string &defvalue = "") const
     {
-        std::lock_guard<std::mutex> lock(_mutex);
+        StoredValue pending;
+        if (_pending.find(key, pending) && pending.kind == StoredValue::Kind::Str) {
+            return pending.str;
+        }
+        std::lock_guard<std::mutex> lock(_nvsMutex);
         std::string rc;
         size_t requiredSize = 0;
-        if (nvs_get_str(this->_nvsHandle, key.c_str(), nullptr, &requiredSize) != ESP_OK)
+        if (nvs_get_str(_nvs.handle, key.c_str(), nullptr, &requiredSize) != ESP_OK)
         {
             rc = defvalue;
             return rc;
         }
         rc.resize(requiredSize);
-        auto err = nvs_get_str(this->_nvsHandle, key.c_str(), &rc[0], &requiredSize);
+        auto err = nvs_get_str(_nvs.handle, key.c_str(), &rc[0], &requiredSize);
         if (err != ESP_OK)
         {
             rc = defvalue;
@@ -128,10 +179,105 @@ public:
         return rc;
     }
 
+    /// @brief Read binary blob with a single NVS lookup
+    /// @param key Key name
+    /// @param data output buffer
+    /// @param length buffer size on input, stored size on output
+    /// @return true - success, false - missing or longer than the buffer (length is the stored size)
+    bool readBlob(const std::string &key, void *data, size_t &length) const
+    {
+        StoredValue pending;
+        if (_pending.find(key, pending) && pending.kind == StoredValue::Kind::Blob) {
+            const bool fits = pending.str.size() <= length;
+            if (fits) {
+                std::copy(pending.str.begin(), pending.str.end(), static_cast<char *>(data));
+            }
+            length = pending.str.size();
+            return fits;
+        }
+        std::lock_guard<std::mutex> lock(_nvsMutex);
+        const size_t capacity = length;
+        esp_err_t err = nvs_get_blob(_nvs.handle, key.c_str(), data, &length);
+        if (err != ESP_OK && err != ESP_ERR_NVS_INVALID_LENGTH) {
+            length = 0;
+        }
+        return err == ESP_OK && length <= capacity;
+    }
+
 private:
-    
+    /// @brief NVS side of the pending writes, called with the NVS mutex held
+    struct Nvs {
+        nvs_handle_t handle;
+
+        bool write(const std::string &key, const StoredValue &v) {
+            esp_err_t err = ESP_OK;
+            switch (v.kind) {
+                case StoredValue::Kind::U32:
+                    err = nvs_set_u32(handle, key.c_str(), v.num);
+                    break;
+                case StoredValue::Kind::Str:
+                    err = nvs_set_str(handle, key.c_str(), v.str.c_str());
+                    break;
+                case StoredValue::Kind::Blob:
+                    err = nvs_set_blob(handle, key.c_str(), v.str.data(), v.str.size());
+                    break;
+            }
+            if (err != ESP_OK) {
+                ESP_LOGE("KeyVal", "%s: write failed %d", key.c_str(), err);
+            }
+            return err == ESP_OK;
+        }
+
+        bool commit() {
+            TraceSpan span(TraceEvent::NvsCommit);
+            esp_err_t err = nvs_commit(handle);
+            if (err != ESP_OK) {
+                ESP_LOGE("KeyVal", "commit failed %d", err);
+            }
+            return err == ESP_OK;
+        }
+    };
+
+    /// @brief Flush from the FreeRTOS timer task
+    class FlushTimer : public RPTimer {
+        void loop() override {
+            KeyVal::getInstance().flush();
+        }
+    };
+
+    /// @brief Store value into the dirty set & schedule flush, never waits for flash
+    bool stage(const std::string &key, StoredValue &&value)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_isInitialized) {
+                return false;
+            }
+        }
+        uint32_t age = 0;
+        const size_t count = _pending.stage(key, std::move(value), xTaskGetTickCount(), age);
+
+        // continuous writes must not postpone the flush forever
+        const TickType_t maxDelay = pdMS_TO_TICKS(_maxDelayMs);
+        const TickType_t delay = count >= _flushCount ? 1 : std::min<TickType_t>(pdMS_TO_TICKS(_quietMs), age < maxDelay ? maxDelay - age : 1);
+
+        // restarts the one-shot timer, a command to the timer task - no wait;
+        // a full timer queue leaves the value to the next write or shutdown
+        _timer.changePeriod(std::max<TickType_t>(delay, 1), 0);
+        return true;
+    }
+
     KeyVal() : _isInitialized(false) {}
-    nvs_handle_t _nvsHandle;
+
+    static constexpr uint32_t _quietMs{2000};       ///< flush after no write for
+    static constexpr uint32_t _maxDelayMs{10000};   ///< max. age of a pending write
+    static constexpr size_t _flushCount{8};         ///< flush at once with so many keys pending
+    static constexpr uint32_t _retryMs{5000};       ///< next flush after a failed one
+
+    Nvs _nvs{};
     bool _isInitialized;
-    mutable std::mutex _mutex;
+    mutable std::mutex _mutex;                      ///< init state
+    mutable std::mutex _nvsMutex;                   ///< NVS handle
+    PendingWrites<Nvs> _pending;                    ///< dirty set, coalesced writes
+    FlushTimer _timer;
 };
@@ -0,0 +1,169 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   latency.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <array>
+
+/// @brief Fixed log2 bucket histogram of microseconds
+///
+/// Bucket i holds values in <2^i, 2^(i+1)) us, bucket 0 also holds 0. Written by
+/// one task, read and reset by another one - relaxed atomics, no lock.
+class LatencyHistogram
+{
+public:
+    static constexpr size_t _buckets = 24;     ///< 1 us ... 16 s
+
+    /// @brief Add sample
+    /// @param us duration, negative values are ignored
+    void add(int64_t us)
+    {
+        if (us < 0)
+        {
+            return;
+        }
+        size_t i = 0;
+        while (i < _buckets - 1 && (static_cast<uint64_t>(us) >> (i + 1)) != 0)
+        {
+            i++;
+        }
+        _count[i].fetch_add(1, std::memory_order_relaxed);
+        uint32_t v = us > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(us);
+        if (v > _max.load(std::memory_order_relaxed))
+        {
+            _max.store(v, std::memory_order_relaxed);
+        }
+    }
+
+    /// @brief Number of samples
+    uint32_t samples() const
+    {
+        uint32_t sum = 0;
+        for (const auto &c : _count)
+        {
+            sum += c.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    /// @brief Percentile as upper bound of the bucket
+    /// @param p percentile 1 - 100
+    /// @return microseconds, 0 if empty
+    uint32_t percentile(uint32_t p) const
+    {
+        std::array<uint32_t, _buckets> snap;
+        uint32_t total = 0;
+        for (size_t i = 0; i < _buckets; ++i)
+        {
+            snap[i] = _count[i].load(std::memory_order_relaxed);
+            total += snap[i];
+        }
+        if (total == 0)
+        {
+            return 0;
+        }
+
+        // rank of the sample, rounded up
+        uint64_t rank = (static_cast<uint64_t>(total) * p + 99) / 100;
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < _buckets; ++i)
+        {
+            cumulative += snap[i];
+            if (cumulative >= rank)
+            {
+                return static_cast<uint32_t>((1ull << (i + 1)) - 1);
+            }
+        }
+        return UINT32_MAX;
+    }
+
+    /// @brief Largest sample
+    uint32_t max() const
+    {
+        return _max.load(std::memory_order_relaxed);
+    }
+
+    void reset()
+    {
+        for (auto &c : _count)
+        {
+            c.store(0, std::memory_order_relaxed);
+        }
+        _max.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::array<std::atomic<uint32_t>, _buckets> _count{};  ///< samples per bucket
+    std::atomic<uint32_t> _max{0};                         ///< largest sample
+};
+
+/// @brief Command path stage latencies per command source
+///
+/// receive (HTTP handler, button, datagram) -> enqueue -> dequeue in LC12STask -> UART TX done
+template <size_t Sources>
+class LatencyStats
+{
+public:
+    enum class Stage : uint8_t
+    {
+        Handler,    ///< receive -> enqueue
+        Queue,      ///< enqueue -> dequeue
+        Transmit,   ///< dequeue -> uart_wait_tx_done
+        Total,      ///< receive -> uart_wait_tx_done
+        Count
+    };
+
+    static constexpr size_t _stages = static_cast<size_t>(Stage::Count);
+
+    /// @brief Record one command
+    /// @param source command source index
+    /// @param recvUs receive time
+    /// @param enqueueUs enqueue time
+    /// @param dequeueUs dequeue time
+    /// @param doneUs TX complete time
+    void record(size_t source, int64_t recvUs, int64_t enqueueUs, int64_t dequeueUs, int64_t doneUs)
+    {
+        if (source >= Sources)
+        {
+            return;
+        }
+        auto &h = _hist[source];
+        h[static_cast<size_t>(Stage::Handler)].add(enqueueUs - recvUs);
+        h[static_cast<size_t>(Stage::Queue)].add(dequeueUs - enqueueUs);
+        h[static_cast<size_t>(Stage::Transmit)].add(doneUs - dequeueUs);
+        h[static_cast<size_t>(Stage::Total)].add(doneUs - recvUs);
+    }
+
+    const LatencyHistogram &get(size_t source, Stage stage) const
+    {
+        return _hist[source][static_cast<size_t>(stage)];
+    }
+
+    void reset()
+    {
+        for (auto &src : _hist)
+        {
+            for (auto &h : src)
+            {
+                h.reset();
+            }
+        }
+    }
+
+    static const char *stageName(Stage stage)
+    {
+        static const char *names[] = {"handler", "queue", "transmit", "total"};
+        static_assert(sizeof(names) / sizeof(names[0]) == _stages, "stage names");
+        return names[static_cast<size_t>(stage)];
+    }
+
+private:
+    std::array<std::array<LatencyHistogram, _stages>, Sources> _hist{};    ///< per source & stage
+};
@@ -17,12 +17,30 @@
 #include "hardware.h"
 #include "application.h"
 #include "lcs_info.h"
-#include "key_val.h"
+#include "config.h"
+#include "warm_state.h"
+#include "metrics.h"
+#include "esp_timer.h"
+#include "trace.h"
+#include "boot_phases.h"
+#include <algorithm>
 
 
 
-LC12STask::LC12STask() { 
-	_queue = xQueueCreate( 10 , sizeof(LCSInfo));
+LC12STask::LC12STask() : Reactor(_queueDepth + _uartQueueDepth) { 
+	_queue = _queueMem.create();
+	listen(_queue);
+}
+
+bool LC12STask::attachUart(QueueHandle_t uartQueue, int64_t readyUs) {
+	// events received before the task start are dropped, a queue with items can't join the set
+	xQueueReset(uartQueue);
+	if (!listen(uartQueue)) {
+		return false;
+	}
+	_uartQueue = uartQueue;
+	_readyUs = readyUs;
+	return true;
 }
 
 LC12STask::~LC12STask() {
@@ -35,78 +53,111 @@ void LC12STask::loop(){
 	
 	lamp::PacketParser prs; ///< lamp packet sniffer
 	uint8_t data[100];		///< serial buffer for LCS
-	int length = 0; 	   	/// TODO
+	size_t length = 0; 	   	///< buffered bytes in UART driver
 	int readcnt = 0; 	  	///< bytes from UART
+	uint32_t parseErrors = 0;	///< reported parser errors
 	bool learn = false;   	///< lamp ID must be learned
 	lamp::Packet mylamp;  	///< all LCS operation over this lamp
 	bool lampIsOn = false;  ///< for toggle switch
 	uint8_t hue = 0;		///< hue value
 	uint8_t intensity = 0;	///< intensity value
-	std::string strId;		///< LAMP ID
 
 	const uint8_t maxIntensity = 0x17;
 	const uint8_t minIntensity = 0x00;
-	const uint8_t defHue = 0x00;
 	
-	auto updateWeb = [](const std::string& idstr, uint8_t hue, uint8_t intensity, uint8_t command ) {
-		LCSInfo lcs;                        
-		strcpy(lcs.id, idstr.c_str()); // Ensure lcs.id is large enough to hold idstr
-		lcs.hue = hue;
-		lcs.intensity = intensity;
-		lcs.command = command;
-		Application::getInstance()->getWebTask()->lcsUpdate(lcs);
+	WarmState& warm = WarmState::getInstance();
+
+	// my lamp state into RTC memory - restored after a soft reset
+	auto remember = [&]() {
+		warm.setLamp(WarmLamp{mylamp.getIdentification(), static_cast<uint8_t>(learn ? 0 : 1),
+						   static_cast<uint8_t>(lampIsOn ? 1 : 0), hue, intensity});
+	};
+
+	// lamp state for web, UDP, MQTT ... - subscribers of the bus
+	auto publishState = [&](const std::array<uint8_t, 7>& id, uint8_t hue, uint8_t intensity, uint8_t command ) {
+		LampState state{id, command, intensity, hue};
+		Bus<LampState>::publish(state);
+		remember();
 	};
 
 	// minimal content
 	mylamp.prepare();
 	
 	// check if valid ID exists
-	KeyVal& kv = KeyVal::getInstance();
-	strId = kv.readString(literals::kv_lampid);
+	Config& cfg = Config::getInstance();
+	WarmLamp last{};
 	
-	if (!strId.empty()) {
+	if (warm.warm() && warm.getLamp(last) && last.hasId) {
+		// soft reset - the lamp keeps its state, so does the web interface
+		mylamp.setIdentification(last.id);
+		hue = last.hue;
+		intensity = last.intensity;
+		lampIsOn = last.on != 0;
+		mylamp.setIntensity(intensity);
+		mylamp.setYellow2White(hue);
+		mylamp.setCommand(lampIsOn ? lamp::Packet::Command::On : lamp::Packet::Command::Off);
+
+		publishState(mylamp.getIdentification(), hue, intensity, static_cast<uint8_t>(mylamp.getCommnad()));
+
+	} else if (const auto boot = cfg.get(); boot.hasLampId) {
 		// update web interface with last known value
-		mylamp.setIdentification(strId);
+		mylamp.setIdentification(boot.lampId);
 		
 		// last known value of hue & intensity
-		hue = static_cast<uint8_t>(kv.readUint32(literals::kv_lamhue, defHue));
-		intensity = static_cast<uint8_t>(kv.readUint32(literals::kv_lampintnesity, minIntensity));
+		cfg.level(hue, intensity);
 		mylamp.setIntensity(intensity);
 		mylamp.setYellow2White(hue);
 
-		updateWeb(strId, hue, intensity, static_cast<uint8_t>(lamp::Packet::Command::Startup));
+		publishState(mylamp.getIdentification(), hue, intensity, static_cast<uint8_t>(lamp::Packet::Command::Startup));
 		
 	} else {
 		// switch to learn mode
 		learn = true;
-		vTaskDelay(500 / portTICK_PERIOD_MS); 
-		Application::getInstance()->getLEDTask()->mode(BlinkMode::LEARN);
+		remember();
+		Bus<BlinkMode>::publish(BlinkMode::LEARN);
 	}
 
 
-	// LCS loop
-	while (true) {
-		// read packet from some LCS UART
-		if (uart_get_buffered_data_len(LCS_UART, (size_t*)&length) == ESP_OK) {
-			readcnt = uart_read_bytes(LCS_UART, data, length, 20 / portTICK_PERIOD_MS);			
+	// UART events - data from LC12S, the driver buffer is drained completely
+	on<uart_event_t>(_uartQueue, [&](const uart_event_t &event) {
+		if (event.type != UART_DATA) {
+			// FIFO overflow / buffer full - the byte stream is broken, start over
+			uart_flush_input(LCS_UART);
+			prs.clear();
+			return;
+		}
+
+		while (uart_get_buffered_data_len(LCS_UART, &length) == ESP_OK && length > 0) {
+			readcnt = uart_read_bytes(LCS_UART, data, std::min(length, sizeof(data)), 0);
+			if (readcnt <= 0) {
+				break;
+			}
+			Metrics::add(Metric::UartRxBytes, readcnt);
+			Trace::record(TraceEvent::ParseBatch, 'B', static_cast<uint16_t>(readcnt));
+
 			for (int i = 0; i < readcnt; ++i) {
 				if (prs.parseByte(data[i])) {
+					Metrics::add(Metric::FramesParsed);
+					Bus<RfActivity>::publish(RfActivity::Rx);
+					BootPhases::mark(BootPhase::FirstRf);
 					const auto& packet = prs.getPacket();
 					if (packet.validateChecksum() && !packet.canIgnoreMagic()) {
 						
 						const auto& viewID =  packet.getIdentification();
-						strId = lamp::Packet::arrayToString(viewID);
 
 						// update local copy from remote
 						hue = packet.getYellow2White();
 						intensity = packet.getIntensity();
 						
-						// learn mode stores my lamp ID into KV
+						// learn mode stores my lamp ID into the configuration
 						if (learn) {
 							mylamp.setIdentification(viewID);
-							kv.writeString(literals::kv_lampid, strId);
+							cfg.update([&viewID](ConfigRecord &c) {
+								c.lampId = viewID;
+								c.hasLampId = 1;
+							});
 							learn = false;
-							Application::getInstance()->getLEDTask()->mode(BlinkMode::CLIENT);
+							Bus<BlinkMode>::publish(BlinkMode::CLIENT);
 						}
 						
 						// values from remote controller for my lamp & update web pages & local copy udate
@@ -115,11 +166,13 @@ void LC12STask::loop(){
 							if (packet.getCommnad() == lamp::Packet::Command::On) lampIsOn = true;
 							if (packet.getCommnad() == lamp::Packet::Command::Off) lampIsOn = false;
 
-						    updateWeb(strId, hue, intensity,static_cast<int>(packet.getCommnad()));
+						    publishState(viewID, hue, intensity, static_cast<uint8_t>(packet.getCommnad()));
 
 							// sync hue & intensity
 							mylamp.setIntensity(packet.getIntensity());
 							mylamp.setYellow2White(packet.getYellow2White());
+						} else {
+							Metrics::add(Metric::ForeignFrames);
 						}
 												 
 					} else {
@@ -127,109 +180,162 @@ void LC12STask::loop(){
 					}
 				}
 			}
+
+			Trace::record(TraceEvent::ParseBatch, 'E');
+
+			// parser drops invalid frames silently
+			if (prs.errors() != parseErrors) {
+				Metrics::add(Metric::ChecksumErrors, prs.errors() - parseErrors);
+				parseErrors = prs.errors();
+			}
 		}
+	});
+
+	// LCS info & command from web interface & hw button control
+	on<LCSInfo>(_queue, [&](const LCSInfo &req) {
 		
-		
-		// LCS info & command from web interface & hw button control 
-		LCSInfo req;
-		auto res = xQueueReceive(_queue, (void *)&req, 0);
-		if (res == pdTRUE) { 
+		const int64_t dequeueUs = esp_timer_get_time();
+		Command cmd = static_cast<Command>(req.command);
+		bool foreign = false;	///< frame for other lamp already sent
+
+		if (cmd == LC12STask::Command::toggle) {
+			// hardware button
+			lampIsOn = !lampIsOn;
+			printf("#####1  %d  %d  on=%d\n", intensity, hue, lampIsOn?1:0);
+
+			if (lampIsOn) {
+				mylamp.setIntensity(intensity);
+				mylamp.setYellow2White(hue);
+				mylamp.setCommand(lamp::Packet::Command::On);
+			} else {
+				mylamp.setCommand(lamp::Packet::Command::Off);
+				
+				// Store last known level, own key - the configuration record is not rewritten
+				cfg.setLevel(hue, intensity);
+			}
+		}
+		if (cmd == LC12STask::Command::incIntensity) {
+			// hardware button
+			if (!lampIsOn) {
+				lampIsOn = true;
+				mylamp.setIntensity(intensity);
+				mylamp.setYellow2White(hue);
+				mylamp.setCommand(lamp::Packet::Command::On);
+			}
 			
-			Command cmd = static_cast<Command>(req.command);
+			if (intensity < maxIntensity) intensity++;
+			mylamp.setIntensity(intensity); 
+		}
+		if (cmd == LC12STask::Command::delta) {
+			// relative change, hue & intensity carry signed steps
+			int newIntensity = static_cast<int>(intensity) + static_cast<int8_t>(req.intensity);
+			int newHue = static_cast<int>(hue) + static_cast<int8_t>(req.hue);
+			intensity = static_cast<uint8_t>(std::clamp<int>(newIntensity, minIntensity, maxIntensity));
+			hue = static_cast<uint8_t>(std::clamp<int>(newHue, minIntensity, maxIntensity));
+			lampIsOn = true;
+			mylamp.setCommand(lamp::Packet::Command::On);
+			mylamp.setIntensity(intensity);
+			mylamp.setYellow2White(hue);
+		}
+		if (cmd == LC12STask::Command::decIntensity) {
+			// hardware button
+			if (!lampIsOn) {
+				lampIsOn = true;
+				mylamp.setIntensity(intensity);
+				mylamp.setYellow2White(hue);
+				mylamp.setCommand(lamp::Packet::Command::On);
+			}
 
- 			if (cmd == LC12STask::Command::toggle) {
-				// hardware button
-				lampIsOn = !lampIsOn;
-				printf("#####1  %d  %d  on=%d\n", intensity, hue, lampIsOn?1:0);
+			if (intensity > minIntensity) intensity--;
+			mylamp.setIntensity(intensity);
+		}
+		else if (cmd == LC12STask::Command::off) {
+			mylamp.setCommand(lamp::Packet::Command::Off);
+			lampIsOn = false;
+		} else if (cmd == LC12STask::Command::on) {
+			mylamp.setCommand(lamp::Packet::Command::On);
+			mylamp.setIntensity(intensity);
+			mylamp.setYellow2White(hue);
+			lampIsOn = true;
+		} else if (cmd == LC12STask::Command::learn) {
+			learn = true;
+			cfg.update([](ConfigRecord &c) {
+				c.hasLampId = 0;
+			});
+			remember();
+			Bus<BlinkMode>::publish(BlinkMode::LEARN);
+		} else if (cmd == LC12STask::Command::direct) {
+			// addressed frame (DMX), intensity 255 means OFF
+			lamp::Packet other;
+			other.prepare();
+			other.setIdentification(std::string(req.id));
+			bool on = req.intensity != 255;
+			other.setCommand(on ? lamp::Packet::Command::On : lamp::Packet::Command::Off);
+			if (on) {
+				other.setIntensity(req.intensity);
+				other.setYellow2White(req.hue);
+			}
 
-				if (lampIsOn) {
+			if (other.getIdentification() == mylamp.getIdentification()) {
+				// my lamp - keep local state in sync
+				mylamp.setCommand(other.getCommnad());
+				lampIsOn = on;
+				if (on) {
+					intensity = req.intensity;
+					hue = req.hue;
 					mylamp.setIntensity(intensity);
 					mylamp.setYellow2White(hue);
-					mylamp.setCommand(lamp::Packet::Command::On);
-					updateWeb(strId, hue, intensity,static_cast<int>(lamp::Packet::Command::On));
-				} else {
-					mylamp.setCommand(lamp::Packet::Command::Off);
-					
-					// Store last known config
-					kv.writeUint32(literals::kv_lampintnesity, intensity);
-					kv.writeUint32(literals::kv_lamhue, hue);
 				}
+			} else {
+				other.computeChecksum();
+				transmit(other, req, dequeueUs);
+				foreign = true;
 			}
-			if (cmd == LC12STask::Command::incIntensity) {
-				// hardware button
-				if (!lampIsOn) {
-					lampIsOn = true;
-					mylamp.setIntensity(intensity);
-					mylamp.setYellow2White(hue);
-					mylamp.setCommand(lamp::Packet::Command::On);
-				}
-				
-				if (intensity < maxIntensity) intensity++;
-				mylamp.setIntensity(intensity); 
-				updateWeb(strId, hue, intensity,static_cast<int>(lamp::Packet::Command::On));
+		} else if (cmd == LC12STask::Command::hueintensity) {
+			
+			if (req.hue != 255) {
+				mylamp.setYellow2White(req.hue);
+				hue = req.hue;
+				lampIsOn = true;
 			}
-			if (cmd == LC12STask::Command::decIntensity) {
-				// hardware button
-				if (!lampIsOn) {
-					lampIsOn = true;
-					mylamp.setIntensity(intensity);
-					mylamp.setYellow2White(hue);
-					mylamp.setCommand(lamp::Packet::Command::On);
-				}
 
-				if (intensity > minIntensity) intensity--;
-				mylamp.setIntensity(intensity);
-				updateWeb(strId, hue, intensity,static_cast<int>(lamp::Packet::Command::On));
+			if (req.intensity != 255) {
+				 mylamp.setIntensity(req.intensity);
+				 intensity = req.intensity;
 			}
-			else if (cmd == LC12STask::Command::off) {
-				mylamp.setCommand(lamp::Packet::Command::Off);
-				lampIsOn = false;
-			} else if (cmd == LC12STask::Command::on) {
+		
+			if (mylamp.getCommnad() !=  lamp::Packet::Command::On) {
+				// switch ON if in OFF mode or automatic
 				mylamp.setCommand(lamp::Packet::Command::On);
 				mylamp.setIntensity(intensity);
 				mylamp.setYellow2White(hue);
 				lampIsOn = true;
-			} else if (cmd == LC12STask::Command::learn) {
-				learn = true;
-				kv.writeString(literals::kv_lampid, "");
-				Application::getInstance()->getLEDTask()->mode(BlinkMode::LEARN);
-			} else if (cmd == LC12STask::Command::hueintensity) {
-				
-				if (req.hue != 255) {
-					mylamp.setYellow2White(req.hue);
-					hue = req.hue;
-					lampIsOn = true;
-				}
+			}
+		} 
+	
+		if (!learn && !foreign) {
+			// send to LCS lamp
+			mylamp.computeChecksum();				
+			transmit(mylamp, req, dequeueUs);
 
-				if (req.intensity != 255) {
-					 mylamp.setIntensity(req.intensity);
-					 intensity = req.intensity;
-				}
-			
-				if (mylamp.getCommnad() !=  lamp::Packet::Command::On) {
-					// switch ON if in OFF mode or automatic
-					mylamp.setCommand(lamp::Packet::Command::On);
-					mylamp.setIntensity(intensity);
-					mylamp.setYellow2White(hue);
-					lampIsOn = true;
-				}
-			} 
-		
-			if (!learn) {
-				// send to LCS lamp
-				mylamp.computeChecksum();				
-				uart_write_bytes(UART_NUM_1, reinterpret_cast<const char*>(mylamp.getContnet().data()), mylamp.getContnet().size());
-			} 
-		
+			// publish resulting state
+			publishState(mylamp.getIdentification(), hue, intensity, static_cast<uint8_t>(lampIsOn ? lamp::Packet::Command::On : lamp::Packet::Command::Off));
+		} 
+
+		// queue drained - the waiting producer (DMX) may send the next frame
+		TaskHandle_t waiter = _drainTask.load(std::memory_order_relaxed);
+		if (waiter && uxQueueMessagesWaiting(_queue) == 0) {
+			xTaskNotifyGive(waiter);
 		}
+	});
 
-		vTaskDelay(1 / portTICK_PERIOD_MS); 
-	}
-	
- }
+	// UART & command queue are served from here, Wi-Fi may still be starting
+	BootPhases::mark(BootPhase::RfReady);
+	dispatch();
+}
 
 
-void  LC12STask::command(LC12STask::Command cmd)
+bool  LC12STask::command(LC12STask::Command cmd, const LCSOrigin& origin)
 {
 	if (_queue)
 	{
@@ -237,11 +343,12 @@ void  LC12STask::command(LC12STask::Command cmd)
 		l.hue = 0;
 		l.intensity = 0;
 		l.command = static_cast<int>(cmd);
-		xQueueSendToBack(_queue, (void *)&l, 0);
+		return enqueue(l, origin);
 	}
+	return false;
 }
 
-void  LC12STask::hue(uint8_t hue)
+bool  LC12STask::hue(uint8_t hue, const LCSOrigin& origin)
 {
 	if (_queue)
 	{
@@ -249,11 +356,12 @@ void  LC12STask::hue(uint8_t hue)
 		l.hue = hue;
 		l.intensity = 255;
 		l.command = static_cast<int>(LC12STask::Command::hueintensity);
-		xQueueSendToBack(_queue, (void *)&l, 0);
+		return enqueue(l, origin);
 	}
+	return false;
 }
 
-void  LC12STask::intensity(uint8_t intensity)
+bool  LC12STask::intensity(uint8_t intensity, const LCSOrigin& origin)
 {
 	if (_queue)
 	{
@@ -261,7 +369,102 @@ void  LC12STask::intensity(uint8_t intensity)
 		l.hue = 255;
 		l.intensity = intensity;
 		l.command = static_cast<int>(LC12STask::Command::hueintensity);
-		xQueueSendToBack(_queue, (void *)&l, 0);
+		return enqueue(l, origin);
+	}
+	return false;
+}
+
+uint32_t LC12STask::pending() const
+{
+	return _queue ? uxQueueMessagesWaiting(_queue) : 0;
+}
+
+uint32_t LC12STask::retryAfter() const
+{
+	// time to drain the queued frames, rounded up to whole seconds
+	return 1 + (pending() * _frameTimeUs) / 1000000ul;
+}
+
+void LC12STask::notifyDrained(TaskHandle_t task)
+{
+	// one waiter, it takes the notification with ulTaskNotifyTake
+	_drainTask.store(task, std::memory_order_relaxed);
+}
+
+bool  LC12STask::state(bool on, uint8_t intensity, uint8_t hue, const LCSOrigin& origin)
+{
+	if (!on) {
+		return command(LC12STask::Command::off, origin);
+	}
+
+	if (_queue)
+	{
+		LCSInfo l;
+		l.hue = hue;
+		l.intensity = intensity;
+		l.command = static_cast<int>(LC12STask::Command::hueintensity);
+		return enqueue(l, origin);
 	}
+	return false;
 }
 
+bool  LC12STask::delta(int8_t intensity, int8_t hue, const LCSOrigin& origin)
+{
+	if (_queue)
+	{
+		LCSInfo l;
+		l.hue = static_cast<uint8_t>(hue);
+		l.intensity = static_cast<uint8_t>(intensity);
+		l.command = static_cast<int>(LC12STask::Command::delta);
+		return enqueue(l, origin);
+	}
+	return false;
+}
+
+bool  LC12STask::direct(const std::array<uint8_t, 7>& id, bool on, uint8_t intensity, uint8_t hue, const LCSOrigin& origin)
+{
+	if (_queue)
+	{
+		LCSInfo l;
+		const auto strId = lamp::Packet::arrayToString(id);
+		strncpy(l.id, strId.c_str(), sizeof(l.id) - 1);
+		l.id[sizeof(l.id) - 1] = '\0';
+		l.hue = hue;
+		l.intensity = on ? intensity : 255;
+		l.command = static_cast<int>(LC12STask::Command::direct);
+		return enqueue(l, origin);
+	}
+	return false;
+}
+
+bool LC12STask::enqueue(LCSInfo& l, const LCSOrigin& origin)
+{
+	l.origin = origin;
+	l.enqueueUs = esp_timer_get_time();
+	if (l.origin.recvUs == 0) {
+		l.origin.recvUs = l.enqueueUs;
+	}
+	if (xQueueSendToBack(_queue, (void *)&l, 0) == pdTRUE) {
+		return true;
+	}
+	Metrics::add(Metric::DropLcs);
+	return false;
+}
+
+void LC12STask::transmit(const lamp::Packet& packet, const LCSInfo& req, int64_t dequeueUs)
+{
+	// LC12S may still be starting (power-on), only the first frames wait
+	const int64_t wait = _readyUs - esp_timer_get_time();
+	if (wait > 0) {
+		vTaskDelay(pdMS_TO_TICKS(wait / 1000) + 1);
+	}
+
+	TraceSpan span(TraceEvent::UartTx, static_cast<uint16_t>(packet.getContnet().size()));
+	uart_write_bytes(LCS_UART, reinterpret_cast<const char*>(packet.getContnet().data()), packet.getContnet().size());
+	// frame is on air - measured up to the last stop bit
+	uart_wait_tx_done(LCS_UART, _txDoneTimeout);
+	Metrics::add(Metric::TxFrames);
+	Bus<RfActivity>::publish(RfActivity::Tx);
+	BootPhases::mark(BootPhase::FirstRf);
+	_latency.record(static_cast<size_t>(req.origin.source), req.origin.recvUs, req.enqueueUs, dequeueUs, esp_timer_get_time());
+}
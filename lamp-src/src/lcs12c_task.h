@@ -8,9 +8,14 @@
 #pragma once
 
 #include "hardware.h"
-#include "rptask.h"
+#include "reactor.h"
+#include <array>
+#include <atomic>
+#include "lcs_info.h"
+#include "latency.h"
+#include "packet.h"
 
-class LC12STask : public RPTask
+class LC12STask : public Reactor
 {
 public:
 	 enum class Command {
@@ -21,19 +26,44 @@ public:
 		toggle,
 		incIntensity,
 		decIntensity,
+		delta,
+		direct,
 		};
 
 	LC12STask();
 	virtual ~LC12STask();
-	void  command(LC12STask::Command cmd);
-	void  hue(uint8_t hue);
-	void  intensity(uint8_t intensity);
+	bool  command(LC12STask::Command cmd, const LCSOrigin& origin = {});
+	bool  hue(uint8_t hue, const LCSOrigin& origin = {});
+	bool  intensity(uint8_t intensity, const LCSOrigin& origin = {});
+	bool  state(bool on, uint8_t intensity, uint8_t hue, const LCSOrigin& origin = {});
+	bool  delta(int8_t intensity, int8_t hue, const LCSOrigin& origin = {});
+	bool  direct(const std::array<uint8_t, 7>& id, bool on, uint8_t intensity, uint8_t hue, const LCSOrigin& origin = {});
+	bool  attachUart(QueueHandle_t uartQueue, int64_t readyUs = 0);
+	uint32_t pending() const;
+	uint32_t retryAfter() const;
+	void notifyDrained(TaskHandle_t task);
+
+	using Latency = LatencyStats<static_cast<size_t>(LCSSource::Count)>;
+	Latency& latency() { return _latency; }
+
+	static constexpr uint32_t _queueDepth{10};		///< command queue size
+	static constexpr uint32_t _uartQueueDepth{16};	///< UART driver event queue size
+	static constexpr uint32_t _frameTimeUs{13540};	///< 13 bytes at 9600 bd
 
 protected:
 	void loop() override;
 
 private:
+	bool enqueue(LCSInfo& l, const LCSOrigin& origin);
+	void transmit(const lamp::Packet& packet, const LCSInfo& req, int64_t dequeueUs);
+
 	const uint32_t  _defaultTick{1000};
+	const TickType_t _txDoneTimeout{50 / portTICK_PERIOD_MS};	///< several frames
 	gpio_num_t 		_pin{GPIO_NUM_0};
 	QueueHandle_t 	_queue;
+	QueueHandle_t 	_uartQueue{nullptr};	///< UART driver events
+	int64_t			_readyUs{0};			///< LC12S accepts frames from this time [us]
+	QueueMemory<LCSInfo, _queueDepth> _queueMem;		///< static queue storage
+	Latency			_latency;		///< command path latency
+	std::atomic<TaskHandle_t> _drainTask{nullptr};	///< notified when the command queue runs empty
 };
@@ -8,11 +8,60 @@
 #pragma once
 
 #include <stdint.h>
+#include <array>
+#include "bus.h"
+
+/// @brief Command source, latency statistics are kept per source
+enum class LCSSource : uint8_t {
+	Web,
+	Button,
+	Udp,
+	Mqtt,
+	Dmx,
+	Count
+};
+
+/// @brief Command origin - source & receive timestamp
+struct LCSOrigin {
+	LCSSource source{LCSSource::Web};	///< source of the command
+	int64_t recvUs{0};					///< receive time (esp_timer), 0 - at enqueue
+};
 
 struct LCSInfo {
     uint8_t hue;				///< hue value
 	uint8_t intensity;			///< intensity value
     uint8_t command;			///< command as ordinal value	
 	char id[15]; 				///< device ID as string with '\0'
+	LCSOrigin origin;			///< command source & receive time
+	int64_t enqueueUs;			///< enqueue time
+};
+
+/// @brief Lamp state, published by LC12STask after a received or transmitted frame
+struct LampState {
+	std::array<uint8_t, 7> id;	///< binary lamp ID
+	uint8_t command;			///< lamp::Packet::Command as ordinal value
+	uint8_t intensity;			///< intensity value
+	uint8_t hue;				///< hue value
+};
+
+template <>
+struct Topic<LampState> {
+	static constexpr const char *name = "lamp_state";
+	static constexpr bool latest = true;
+	static constexpr size_t depth = 1;
+	static constexpr size_t subscribers = 4;
 };
 
+/// @brief RF frame received / sent by LC12STask
+enum class RfActivity : uint8_t {
+	Rx,
+	Tx
+};
+
+template <>
+struct Topic<RfActivity> {
+	static constexpr const char *name = "rf_activity";
+	static constexpr bool latest = false;
+	static constexpr size_t depth = 4;
+	static constexpr size_t subscribers = 2;
+};
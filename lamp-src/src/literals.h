@@ -18,33 +18,45 @@ public:
     // internal - do not modify
     
     // internal task name
-    static constexpr const char *tsk_led{"LEDTSK"};
     static constexpr const char *tsk_web{"WEBTSK"};
     static constexpr const char *tsk_wifi{"WIFITSK"};
     static constexpr const char *tsk_lcs{"LCSTSK"};
     static constexpr const char *btn_lcs{"BTNTSK"};
+    static constexpr const char *tsk_udp{"UDPTSK"};
+    static constexpr const char *tsk_dmx{"DMXTSK"};
+    static constexpr const char *tsk_mqtt{"MQTTTSK"};
 
     // AP definition
     static constexpr const char *ap_name{"LAMP AP"};
     static constexpr const char *ap_passwd{""};
 
+    // wall clock for the history log
+    static constexpr const char *ntp_server{"pool.ntp.org"};
+
     // KV & files
     static constexpr const char *kv_namespace{"lamp"};
     static constexpr const char *kv_ssid{"ssid"};
     static constexpr const char *kv_passwd{"pass"};
+    static constexpr const char *kv_ssid2{"ssid2"};
+    static constexpr const char *kv_passwd2{"pass2"};
+    static constexpr const char *kv_ssid3{"ssid3"};
+    static constexpr const char *kv_passwd3{"pass3"};
     static constexpr const char *kv_ip{"ip"};
     static constexpr const char *kv_gtw{"gw"};
     static constexpr const char *kv_mask{"mask"};
     static constexpr const char *kv_lampid{"lampid"};
     static constexpr const char *kv_lampintnesity{"lamintensity"};
     static constexpr const char *kv_lamhue{"lamphue"};
-
-    // spiffs filenames
-    static constexpr const char *kv_fl_index{"/spiffs/index.html"}; 
-    static constexpr const char *kv_fl_apb{"/spiffs/ap_beg.html"};
-    static constexpr const char *kv_fl_ape{"/spiffs/ap_end.html"}; 
-    static constexpr const char *kv_fl_style{"/spiffs/style.css"}; 
-    static constexpr const char *kv_fl_finish{"/spiffs/finish.html"};
+    static constexpr const char *kv_dmx{"dmx"};
+    static constexpr const char *kv_mqtt{"mqtt"};
+    static constexpr const char *kv_wlink{"wlink"};
+
+    // asset archive paths
+    static constexpr const char *kv_fl_index{"/index.html"}; 
+    static constexpr const char *kv_fl_apb{"/ap_beg.html"};
+    static constexpr const char *kv_fl_ape{"/ap_end.html"}; 
+    static constexpr const char *kv_fl_style{"/style.css"}; 
+    static constexpr const char *kv_fl_finish{"/finish.html"};
     
 
 
@@ -0,0 +1,153 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   long_poll.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <esp_http_server.h>
+#include <array>
+#include <string>
+#include <functional>
+#include <mutex>
+#include "esp_timer.h"
+
+/// @brief Parked long-poll requests (esp_http_server async handlers, IDF >= 5.1)
+///
+/// A parked request keeps its socket open, so the number of slots must stay
+/// below max_open_sockets of the server. Requests over the limit are answered
+/// immediately by the caller. Parked requests must be answered by notify()
+/// before the server is stopped.
+template <size_t Slots>
+class LongPoll
+{
+public:
+    using RenderFunc = std::function<std::string()>;
+    using ReadyFunc = std::function<bool()>;
+
+    /// @brief Park request until notify() or timeout
+    /// @param req request from the handler, must not be used after success
+    /// @param timeoutMs wait time
+    /// @param ready checked under the lock, true - data already available
+    /// @return true if parked, false - caller answers immediately
+    bool park(httpd_req_t *req, uint32_t timeoutMs, const ReadyFunc &ready)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (ready())
+        {
+            return false;
+        }
+
+        for (auto &s : _slots)
+        {
+            if (s.req == nullptr)
+            {
+                if (httpd_req_async_handler_begin(req, &s.req) != ESP_OK)
+                {
+                    s.req = nullptr;
+                    return false;
+                }
+                s.deadlineUs = esp_timer_get_time() + static_cast<int64_t>(timeoutMs) * 1000;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// @brief Answer all parked requests with the current state
+    /// @param render response body
+    void notify(const RenderFunc &render)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!pendingLocked())
+        {
+            return;
+        }
+
+        const auto body = render();
+        for (auto &s : _slots)
+        {
+            if (s.req)
+            {
+                reply(s, body);
+            }
+        }
+    }
+
+    /// @brief Answer the requests with expired timeout
+    /// @param render response body
+    void expire(const RenderFunc &render)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto now = esp_timer_get_time();
+        std::string body;
+        for (auto &s : _slots)
+        {
+            if (s.req && now >= s.deadlineUs)
+            {
+                if (body.empty())
+                {
+                    body = render();
+                }
+                reply(s, body);
+            }
+        }
+    }
+
+    /// @brief Nearest timeout of the parked requests
+    /// @param us output, esp_timer_get_time() time
+    /// @return false if nothing is parked
+    bool deadline(int64_t &us) const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        bool any = false;
+        for (const auto &s : _slots)
+        {
+            if (s.req && (!any || s.deadlineUs < us))
+            {
+                us = s.deadlineUs;
+                any = true;
+            }
+        }
+        return any;
+    }
+
+    /// @brief Any request waiting?
+    bool pending() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return pendingLocked();
+    }
+
+private:
+    struct Slot
+    {
+        httpd_req_t *req{nullptr};  ///< async copy of the request
+        int64_t deadlineUs{0};      ///< timeout
+    };
+
+    bool pendingLocked() const
+    {
+        for (const auto &s : _slots)
+        {
+            if (s.req)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void reply(Slot &s, const std::string &body)
+    {
+        httpd_resp_set_type(s.req, "application/json");
+        httpd_resp_send(s.req, body.c_str(), body.length());
+        httpd_req_async_handler_complete(s.req);
+        s.req = nullptr;
+    }
+
+    std::array<Slot, Slots> _slots; ///< parked requests
+    mutable std::mutex _mutex;      ///< httpd task parks, web task answers
+};
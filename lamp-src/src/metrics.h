@@ -0,0 +1,86 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   metrics.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "freertos/FreeRTOS.h"
+
+/// @brief Counter identifiers
+enum class Metric : uint8_t {
+	UartRxBytes,		///< bytes read from LC12S UART
+	FramesParsed,		///< complete frames from PacketParser
+	ChecksumErrors,		///< frames dropped by PacketParser (checksum / end mark)
+	ForeignFrames,		///< valid frames of other lamps
+	TxFrames,			///< frames written to LC12S
+	DropLcs,			///< LC12STask queue full
+	HttpRejected,		///< 429 - admission control & back-pressure
+	DropHistory,		///< history log RAM queue full
+	Count
+};
+
+/// @brief Lock-free hot path counters
+///
+/// Each core increments its own slot (relaxed atomic add, a few instructions,
+/// no lock, no cache line ping-pong), the reader sums the slots.
+class Metrics
+{
+public:
+	/// @brief Increment counter
+	/// @param m counter
+	/// @param n value
+	static inline void add(Metric m, uint32_t n = 1)
+	{
+		_counters[xPortGetCoreID()][static_cast<size_t>(m)].fetch_add(n, std::memory_order_relaxed);
+	}
+
+	/// @brief Sum over cores
+	/// @param m counter
+	/// @return value
+	static uint32_t get(Metric m)
+	{
+		uint32_t sum = 0;
+		for (size_t core = 0; core < portNUM_PROCESSORS; ++core) {
+			sum += _counters[core][static_cast<size_t>(m)].load(std::memory_order_relaxed);
+		}
+		return sum;
+	}
+
+	/// @brief Prometheus metric name
+	static const char *name(Metric m)
+	{
+		static const char *names[] = {
+			"lamp_uart_rx_bytes_total",
+			"lamp_frames_parsed_total",
+			"lamp_frames_checksum_errors_total",
+			"lamp_frames_foreign_total",
+			"lamp_frames_tx_total",
+			"lamp_queue_drops_total{queue=\"lcs\"}",
+			"lamp_http_rejected_total",
+			"lamp_queue_drops_total{queue=\"history\"}",
+		};
+		static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(Metric::Count), "metric names");
+		return names[static_cast<size_t>(m)];
+	}
+
+	/// @brief Render all counters in Prometheus text format
+	/// @param out output
+	static void render(std::string &out)
+	{
+		char line[96];
+		for (size_t i = 0; i < static_cast<size_t>(Metric::Count); ++i) {
+			auto m = static_cast<Metric>(i);
+			snprintf(line, sizeof(line), "%s %u\n", name(m), static_cast<unsigned>(get(m)));
+			out += line;
+		}
+	}
+
+private:
+	static inline std::atomic<uint32_t> _counters[portNUM_PROCESSORS][static_cast<size_t>(Metric::Count)]{};
+};
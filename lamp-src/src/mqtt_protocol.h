@@ -0,0 +1,294 @@
+/*
+ * @file mqtt_protocol.h
+ * @author Petr Vanek (petr@fotoventus.cz)
+ * @brief MQTT command & state payloads, pending command slot, hardware independent
+ * @version 0.1
+ * @date 2024-03-12
+ *
+ * @copyright Copyright (c) 2024 Petr Vanek
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <mutex>
+
+namespace lamp {
+
+/// @brief Requested lamp state from lamp/<dev>/set
+struct MqttRequest
+{
+    bool valid{false};      ///< any known key present
+    bool on{false};
+    int intensity{-1};      ///< -1 unchanged
+    int hue{-1};            ///< -1 unchanged
+    int64_t recvUs{0};      ///< receive time of the oldest merged command
+};
+
+/**
+ * @brief Home Assistant JSON light schema
+ *
+ * Command  {"state": "ON", "brightness": 12, "color_temp": 300}, brightness 0 - 23,
+ *          brightness or color_temp alone switch the lamp ON, other keys are ignored
+ * State    {"state":"ON","brightness":12,"color_temp":300,"color_mode":"color_temp","id":"<lamp id>"}
+ *
+ * Commands are flat objects, the parser reads them in place without allocation.
+ */
+class MqttProtocol
+{
+public:
+    static constexpr int _miredsCold = 153;     ///< hue 0x17
+    static constexpr int _miredsWarm = 500;     ///< hue 0x00
+
+    /// @brief Parse command payload
+    /// @param data payload, not terminated
+    /// @param len payload length
+    /// @param r request, recvUs is not touched
+    /// @return false if not a JSON object, r.valid if any known key was found
+    static bool parseCommand(const char *data, size_t len, MqttRequest &r)
+    {
+        Cursor c{data, data + len};
+        if (!c.skip('{'))
+        {
+            return false;
+        }
+        if (c.skip('}'))
+        {
+            return true;
+        }
+
+        bool level = false;     ///< brightness or color_temp - ON whatever the state says
+        do
+        {
+            const char *key;
+            size_t keyLen;
+            if (!c.string(key, keyLen) || !c.skip(':'))
+            {
+                return false;
+            }
+
+            const char *str;
+            size_t strLen;
+            double num;
+            if (c.string(str, strLen))
+            {
+                if (equals(key, keyLen, "state"))
+                {
+                    r.valid = true;
+                    r.on = equals(str, strLen, "ON");
+                }
+            }
+            else if (c.number(num))
+            {
+                if (equals(key, keyLen, "brightness"))
+                {
+                    level = true;
+                    r.intensity = static_cast<int>(std::clamp(num, 0.0, 23.0));
+                }
+                else if (equals(key, keyLen, "color_temp"))
+                {
+                    level = true;
+                    r.hue = miredsToHue(static_cast<int>(std::clamp(num, 0.0, 100000.0)));
+                }
+            }
+            else if (!c.other())
+            {
+                return false;
+            }
+        } while (c.skip(','));
+
+        if (level)
+        {
+            r.valid = true;
+            r.on = true;
+        }
+        return c.skip('}');
+    }
+
+    /// @brief State payload
+    /// @return length, 0 if the buffer is too small
+    static size_t statePayload(char *buf, size_t size, bool on, uint8_t intensity, uint8_t hue, const char *id)
+    {
+        int len = snprintf(buf, size,
+            "{\"state\":\"%s\",\"brightness\":%u,\"color_temp\":%d,\"color_mode\":\"color_temp\",\"id\":\"%s\"}",
+            on ? "ON" : "OFF", intensity, hueToMireds(hue), id);
+        return len > 0 && static_cast<size_t>(len) < size ? static_cast<size_t>(len) : 0;
+    }
+
+    /// @brief Color temperature -> hue, 0x00 - yellow max (warm), 0x17 - yellow min (cold)
+    static uint8_t miredsToHue(int mireds)
+    {
+        mireds = std::clamp(mireds, _miredsCold, _miredsWarm);
+        return static_cast<uint8_t>(((_miredsWarm - mireds) * 0x17 + (_miredsWarm - _miredsCold) / 2) / (_miredsWarm - _miredsCold));
+    }
+
+    static int hueToMireds(uint8_t hue)
+    {
+        hue = std::min<uint8_t>(hue, 0x17);
+        return _miredsWarm - (hue * (_miredsWarm - _miredsCold)) / 0x17;
+    }
+
+private:
+    /// @brief JSON tokens of a flat object, strings without escapes
+    struct Cursor
+    {
+        const char *p;
+        const char *end;
+
+        void ws()
+        {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+            {
+                ++p;
+            }
+        }
+
+        bool skip(char ch)
+        {
+            ws();
+            if (p < end && *p == ch)
+            {
+                ++p;
+                return true;
+            }
+            return false;
+        }
+
+        bool string(const char *&s, size_t &len)
+        {
+            ws();
+            if (p >= end || *p != '"')
+            {
+                return false;
+            }
+            const char *q = static_cast<const char *>(memchr(p + 1, '"', end - p - 1));
+            if (!q || memchr(p + 1, '\\', q - p - 1))
+            {
+                return false;
+            }
+            s = p + 1;
+            len = q - s;
+            p = q + 1;
+            return true;
+        }
+
+        bool number(double &v)
+        {
+            ws();
+            char tmp[24];
+            size_t n = 0;
+            while (p + n < end && n < sizeof(tmp) - 1 && (isdigit(static_cast<unsigned char>(p[n])) || (p[n] && strchr("+-.eE", p[n]))))
+            {
+                tmp[n] = p[n];
+                ++n;
+            }
+            if (n == 0)
+            {
+                return false;
+            }
+            tmp[n] = '\0';
+            char *stop = nullptr;
+            v = strtod(tmp, &stop);
+            if (stop != tmp + n)
+            {
+                return false;
+            }
+            p += n;
+            return true;
+        }
+
+        /// @brief true, false, null - nested values are not expected in commands
+        bool other()
+        {
+            ws();
+            for (const char *lit : {"true", "false", "null"})
+            {
+                size_t n = strlen(lit);
+                if (static_cast<size_t>(end - p) >= n && memcmp(p, lit, n) == 0)
+                {
+                    p += n;
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    static bool equals(const char *s, size_t len, const char *lit)
+    {
+        return strlen(lit) == len && memcmp(s, lit, len) == 0;
+    }
+};
+
+/**
+ * @brief Newest not yet applied command, written by the MQTT event handler, applied by MqttTask
+ *
+ * A newer command is merged into the pending one (brightness or color_temp alone keep
+ * the other value). Every put() changes the sequence number, so applied() clears the slot
+ * only if no command arrived while the taken one was being queued.
+ */
+class MqttRequestSlot
+{
+public:
+    /// @brief Store command, merged with the pending one
+    void put(MqttRequest r)
+    {
+        if (!r.valid)
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(_lock);
+        if (_request.valid && r.on)
+        {
+            if (r.intensity < 0) r.intensity = _request.intensity;
+            if (r.hue < 0) r.hue = _request.hue;
+            r.recvUs = _request.recvUs;
+        }
+        _request = r;
+        _seq++;
+    }
+
+    /// @brief Copy of the pending command
+    /// @param r command
+    /// @param seq sequence number for applied()
+    /// @return false if nothing is pending
+    bool take(MqttRequest &r, uint32_t &seq) const
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        if (!_request.valid)
+        {
+            return false;
+        }
+        r = _request;
+        seq = _seq;
+        return true;
+    }
+
+    /// @brief Command was queued, a newer one stays pending
+    void applied(uint32_t seq)
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        if (_seq == seq)
+        {
+            _request.valid = false;
+        }
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _request.valid = false;
+    }
+
+private:
+    mutable std::mutex _lock;
+    MqttRequest _request;
+    uint32_t _seq{0};       ///< changes with every put()
+};
+
+} // namespace lamp
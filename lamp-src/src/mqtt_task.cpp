@@ -0,0 +1,308 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   mqtt_task.cpp
+/// @author Petr Vanek
+
+#include <stdio.h>
+#include <memory.h>
+#include <math.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <algorithm>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include <cJSON.h>
+#include "mqtt_task.h"
+#include "application.h"
+#include "config.h"
+#include "literals.h"
+#include "packet.h"
+
+MqttTask::MqttTask() : Reactor(2 + _eventsDepth)
+{
+	listen(_state.handle());
+	_queue = _queueMem.create();
+	listen(_queue);
+	_events = _eventsMem.create();
+	listen(_events);
+}
+
+MqttTask::~MqttTask()
+{
+	done();
+	stop();
+	if (_queue)
+		vQueueDelete(_queue);
+	if (_events)
+		vQueueDelete(_events);
+}
+
+void MqttTask::loop()
+{
+	uint8_t mac[6] = {0};
+	esp_efuse_mac_get_default(mac);
+	char dev[20];
+	snprintf(dev, sizeof(dev), "lamp_%02x%02x%02x", mac[3], mac[4], mac[5]);
+	_dev = dev;
+	_topicState = "lamp/" + _dev + "/state";
+	_topicSet = "lamp/" + _dev + "/set";
+	_topicAvail = "lamp/" + _dev + "/availability";
+
+	LampState last{};
+	last.command = static_cast<uint8_t>(lamp::Packet::Command::Unknown);
+	bool dirty = false;					///< state not published yet
+	uint32_t backoffMs = _backoffMinMs;
+
+	// state & pending command, only with a connected client
+	auto publish = [&]()
+	{
+		if (!_connected) {
+			return;
+		}
+		// batched commands - only the newest request goes to the LCS queue
+		if (applyRequest()) {
+			disarmTimer();
+		} else {
+			armTimer(_busyRetryMs);
+		}
+		if (dirty && last.command != static_cast<uint8_t>(lamp::Packet::Command::Unknown)) {
+			publishState(last);
+			dirty = false;
+		}
+	};
+
+	// configuration changed - restart, without a broker URI nothing runs until the next reload
+	on<int>(_queue, [&](const int &)
+	{
+		stop();
+		disarmTimer();
+		backoffMs = _backoffMinMs;
+		start();
+	});
+
+	// newest lamp state, older ones were overwritten in the mailbox
+	on<LampState>(_state.handle(), [&](const LampState &state)
+	{
+		last = state;
+		dirty = true;
+		publish();
+	});
+
+	on<Event>(_events, [&](const Event &ev)
+	{
+		if (ev == Event::Connected) {
+			if (!_connected) {
+				// stale event of a stopped client
+				return;
+			}
+			backoffMs = _backoffMinMs;
+			disarmTimer();
+			publishDiscovery();
+			esp_mqtt_client_subscribe(_client, _topicSet.c_str(), 0);
+			esp_mqtt_client_publish(_client, _topicAvail.c_str(), "online", 0, 1, 1);
+			dirty = true;
+			publish();
+		} else if (ev == Event::Disconnected) {
+			if (!_client || _connected) {
+				return;
+			}
+			// exponential back-off with +-25 % jitter
+			uint32_t jitter = esp_random() % (backoffMs / 2 + 1);
+			armTimer(backoffMs - backoffMs / 4 + jitter);
+			backoffMs = std::min(backoffMs * 2, _backoffMaxMs);
+		} else {
+			publish();
+		}
+	});
+
+	// reconnect when disconnected, command retry when connected
+	onTimer([&]()
+	{
+		if (!_client) {
+			return;
+		}
+		if (_connected) {
+			publish();
+		} else {
+			esp_mqtt_client_reconnect(_client);
+		}
+	});
+
+	start();
+	dispatch();
+}
+
+bool MqttTask::start()
+{
+	_uri = Config::getInstance().get().mqtt;
+	if (_uri.empty()) {
+		return false;
+	}
+
+	esp_mqtt_client_config_t cfg = {};
+	cfg.broker.address.uri = _uri.c_str();
+	cfg.credentials.client_id = _dev.c_str();
+	cfg.session.last_will.topic = _topicAvail.c_str();
+	cfg.session.last_will.msg = "offline";
+	cfg.session.last_will.msg_len = 7;
+	cfg.session.last_will.qos = 1;
+	cfg.session.last_will.retain = 1;
+	cfg.network.disable_auto_reconnect = true;		// own back-off in run()
+	cfg.buffer.size = 512;
+	cfg.buffer.out_size = 1024;
+
+	_client = esp_mqtt_client_init(&cfg);
+	if (!_client) {
+		ESP_LOGE("MqttTask", "init failed");
+		return false;
+	}
+	esp_mqtt_client_register_event(_client, MQTT_EVENT_ANY, &MqttTask::eventHandler, this);
+	esp_mqtt_client_start(_client);
+	ESP_LOGI("MqttTask", "broker %s", _uri.c_str());
+	return true;
+}
+
+void MqttTask::stop()
+{
+	if (!_client) {
+		return;
+	}
+	if (_connected) {
+		esp_mqtt_client_publish(_client, _topicAvail.c_str(), "offline", 0, 1, 1);
+	}
+	// no events after stop, the handler does not run with a destroyed client
+	esp_mqtt_client_stop(_client);
+	esp_mqtt_client_destroy(_client);
+	_client = nullptr;
+	_connected = false;
+	_request.clear();
+}
+
+void MqttTask::reload()
+{
+	if (_queue)
+	{
+		int req = 1;
+		xQueueOverwrite(_queue, (void *)&req);
+	}
+}
+
+void MqttTask::eventHandler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+	auto *task = static_cast<MqttTask *>(arg);
+	auto *event = static_cast<esp_mqtt_event_handle_t>(data);
+	// a full queue drops the event - the next one applies the pending command too
+	auto post = [task](Event ev) {
+		xQueueSendToBack(task->_events, &ev, 0);
+	};
+
+	switch (static_cast<esp_mqtt_event_id_t>(id)) {
+		case MQTT_EVENT_CONNECTED:
+			task->_connected = true;
+			post(Event::Connected);
+			break;
+		case MQTT_EVENT_DISCONNECTED:
+		case MQTT_EVENT_ERROR:
+			if (task->_connected || static_cast<esp_mqtt_event_id_t>(id) == MQTT_EVENT_DISCONNECTED) {
+				task->_connected = false;
+				post(Event::Disconnected);
+			}
+			break;
+		case MQTT_EVENT_DATA:
+			// commands are small, fragmented messages are ignored
+			if (event->data_len == event->total_data_len &&
+				task->_topicSet.compare(0, std::string::npos, event->topic, event->topic_len) == 0) {
+				task->onData(event->data, event->data_len);
+				post(Event::Command);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+void MqttTask::onData(const char *data, int len)
+{
+	// {"state": "ON", "brightness": 12, "color_temp": 300}
+	lamp::MqttRequest r;
+	r.recvUs = esp_timer_get_time();
+	if (lamp::MqttProtocol::parseCommand(data, len, r)) {
+		_request.put(r);
+	}
+}
+
+bool MqttTask::applyRequest()
+{
+	lamp::MqttRequest r;
+	uint32_t seq;
+	if (!_request.take(r, seq)) {
+		return true;
+	}
+
+	auto lcs = Application::getInstance()->getLcsTask();
+	const LCSOrigin origin{LCSSource::Mqtt, r.recvUs};
+	bool accepted;
+	if (!r.on) {
+		accepted = lcs->command(LC12STask::Command::off, origin);
+	} else if (r.intensity < 0 && r.hue < 0) {
+		accepted = lcs->command(LC12STask::Command::on, origin);
+	} else {
+		accepted = lcs->state(true, r.intensity < 0 ? 255 : r.intensity, r.hue < 0 ? 255 : r.hue, origin);
+	}
+
+	if (accepted) {
+		// a command received meanwhile stays pending
+		_request.applied(seq);
+	}
+	// LCS queue full - retried by the timer
+	return accepted;
+}
+
+void MqttTask::publishState(const LampState& lcs)
+{
+	char payload[128];
+	bool on = lcs.command == static_cast<uint8_t>(lamp::Packet::Command::On);
+	size_t len = lamp::MqttProtocol::statePayload(payload, sizeof(payload), on, lcs.intensity, lcs.hue,
+		lamp::Packet::arrayToString(lcs.id).c_str());
+	if (len) {
+		esp_mqtt_client_publish(_client, _topicState.c_str(), payload, len, 0, 1);
+	}
+}
+
+void MqttTask::publishDiscovery()
+{
+	cJSON *root = cJSON_CreateObject();
+	if (!root) {
+		return;
+	}
+
+	cJSON_AddStringToObject(root, "name", "Light Bar");
+	cJSON_AddStringToObject(root, "unique_id", _dev.c_str());
+	cJSON_AddStringToObject(root, "schema", "json");
+	cJSON_AddStringToObject(root, "state_topic", _topicState.c_str());
+	cJSON_AddStringToObject(root, "command_topic", _topicSet.c_str());
+	cJSON_AddStringToObject(root, "availability_topic", _topicAvail.c_str());
+	cJSON_AddBoolToObject(root, "brightness", 1);
+	cJSON_AddNumberToObject(root, "brightness_scale", 0x17);
+	cJSON_AddNumberToObject(root, "min_mireds", lamp::MqttProtocol::_miredsCold);
+	cJSON_AddNumberToObject(root, "max_mireds", lamp::MqttProtocol::_miredsWarm);
+	cJSON *modes = cJSON_AddArrayToObject(root, "supported_color_modes");
+	cJSON_AddItemToArray(modes, cJSON_CreateString("color_temp"));
+	cJSON *device = cJSON_AddObjectToObject(root, "device");
+	cJSON *ids = cJSON_AddArrayToObject(device, "identifiers");
+	cJSON_AddItemToArray(ids, cJSON_CreateString(_dev.c_str()));
+	cJSON_AddStringToObject(device, "name", "Elesense Light Bar");
+	cJSON_AddStringToObject(device, "manufacturer", "fotoventus.cz");
+
+	char *payload = cJSON_PrintUnformatted(root);
+	if (payload) {
+		const std::string topic = "homeassistant/light/" + _dev + "/config";
+		esp_mqtt_client_publish(_client, topic.c_str(), payload, 0, 1, 1);
+		free(payload);
+	}
+	cJSON_Delete(root);
+}
@@ -0,0 +1,74 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   mqtt_task.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include "mqtt_client.h"
+#include "hardware.h"
+#include "reactor.h"
+#include "lcs_info.h"
+#include "mqtt_protocol.h"
+
+/// @brief MQTT client - retained state, command subscription, Home Assistant discovery
+///
+/// Topics (<dev> = lamp_<MAC>):
+///   lamp/<dev>/state          retained JSON state, published on change only
+///   lamp/<dev>/set            JSON command (Home Assistant JSON light schema)
+///   lamp/<dev>/availability   online / offline (LWT)
+///   homeassistant/light/<dev>/config   discovery
+///
+/// Without a broker URI the task waits for reload(), a changed URI restarts the client.
+/// Payloads are handled by lamp::MqttProtocol (host tested). The task blocks on the
+/// state mailbox, reload requests and client events; the timer runs only for a
+/// scheduled reconnect or a command the full LCS queue did not take.
+class MqttTask : public Reactor
+{
+public:
+	MqttTask();
+	virtual ~MqttTask();
+	void reload();
+
+protected:
+	void loop() override;
+
+private:
+	/// @brief Client event, posted by the esp-mqtt task
+	enum class Event : uint8_t {
+		Connected,
+		Disconnected,
+		Command		///< new command in _request
+	};
+
+	static void eventHandler(void *arg, esp_event_base_t base, int32_t id, void *data);
+	bool start();
+	void stop();
+	void onData(const char *data, int len);
+	void publishDiscovery();
+	void publishState(const LampState& lcs);
+	bool applyRequest();
+
+	static constexpr uint32_t _busyRetryMs{100};		///< command retry, LCS queue full
+	static constexpr uint32_t _backoffMinMs{1000};		///< first reconnect delay
+	static constexpr uint32_t _backoffMaxMs{60000};		///< max. reconnect delay
+	static constexpr size_t _eventsDepth{4};
+
+	Mailbox<LampState>		_state;				///< newest state overwrites stale one
+	QueueHandle_t 			_queue;				///< reload requests
+	QueueMemory<int, 1>		_queueMem;			///< static queue storage
+	QueueHandle_t			_events{nullptr};	///< client events
+	QueueMemory<Event, _eventsDepth> _eventsMem;
+	esp_mqtt_client_handle_t _client{nullptr};
+	std::string				_uri;				///< broker of the running client
+	std::string				_dev;				///< device id
+	std::string				_topicState;
+	std::string				_topicSet;
+	std::string				_topicAvail;
+	std::atomic<bool>		_connected{false};
+	lamp::MqttRequestSlot	_request;			///< newest command from /set
+};
@@ -10,11 +10,10 @@
 
 #pragma once
 #include <cstdint>
+#include <cstddef>
 #include <array>
-#include <iomanip>
-#include <iostream>
+#include <string>
 #include <algorithm>
-#include <queue>
 
 namespace lamp {
 
@@ -116,42 +115,15 @@ public:
       return (_data[7] == 0xA4);
     }
     
-    /// @brief Lamp identification
-    /// @param queue ID eat from queue
-    /// @return true if length is ok
-    bool setIdentification(std::queue<uint8_t> &queue)
+    /// @brief Raw byte, the parser fills the frame in place
+    /// @param pos position 0 - 12
+    /// @param b value
+    void setByte(size_t pos, uint8_t b)
     {
-        if (queue.size() < 7)
+        if (pos < _data.size())
         {
-            return false;
+            _data[pos] = b;
         }
-
-        for (int i = 1; i <= 7; ++i)
-        {
-            _data[i] = queue.front();
-            queue.pop();
-        }
-
-        return true;
-    }
-
-    /// @brief Sets data content eg. Command & intensity
-    /// @param queue 3 bytes from queue
-    /// @return true if length is ok
-    bool setData(std::queue<uint8_t> &queue)
-    {
-        if (queue.size() < 3)
-        {
-            return false;
-        }
-
-        for (int i = 1; i <= 3; ++i)
-        {
-            _data[i + 7] = queue.front();
-            queue.pop();
-        }
-
-        return true;
     }
 
     /// @brief Gets packet content
@@ -290,27 +262,40 @@ public:
 
     template <size_t N>
     static std::string arrayToString(const std::array<uint8_t, N>& arr) {
-        std::stringstream ss;
-        ss << std::hex << std::setfill('0');
-        for (auto byte : arr) {
-            ss << std::setw(2) << static_cast<unsigned>(byte);
+        static const char digits[] = "0123456789abcdef";
+        std::string rc(2 * N, '0');
+        for (size_t i = 0; i < N; ++i) {
+            rc[2 * i] = digits[arr[i] >> 4];
+            rc[2 * i + 1] = digits[arr[i] & 0x0F];
         }
-        return ss.str();
+        return rc;
     }
 
 
+    /// @brief ID from hex string, missing bytes are 0
+    /// @param str hex digits, no separators
+    /// @return ID
     static std::array<uint8_t, 7> stringToID(const std::string& str) {
-        std::array<uint8_t, 7> arr;
+        std::array<uint8_t, 7> arr{};
         size_t count = std::min(str.size() / 2, arr.size());
 
         for (size_t i = 0; i < count; ++i) {
-            std::string byteString = str.substr(i * 2, 2);
-            arr[i] = static_cast<uint8_t>(std::stoul(byteString, nullptr, 16));
+            arr[i] = static_cast<uint8_t>((hexDigit(str[i * 2]) << 4) | hexDigit(str[i * 2 + 1]));
         }
 
         return arr;
     }
 
+    /// @brief Value of a hex digit
+    /// @param c character
+    /// @return 0 - 15, 0 for anything else
+    static uint8_t hexDigit(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return 0;
+    }
+
 private:
     std::array<uint8_t, 13> _data;  ///< content 
 };
@@ -10,7 +10,7 @@
 
 #pragma once
 #include <cstdint>
-#include <queue>
+#include <cstddef>
 #include "packet.h"
 
 namespace lamp {
@@ -40,25 +40,19 @@ public:
             break;
 
         case ParserState::ReceivingId:
-
-            _receiveBuffer.push(b);
-            _byteCount++;
+            // bytes go straight into the frame, no buffering
+            _currentPacket.setByte(_byteCount++, b);
             if (_byteCount >= 8)
             {
-                _currentPacket.setIdentification(_receiveBuffer);
                 _state = ParserState::ReceivingData;
-                _receiveBuffer = std::queue<uint8_t>();
             }
             break;
 
         case ParserState::ReceivingData:
-            _receiveBuffer.push(b);
-            _byteCount++;
+            _currentPacket.setByte(_byteCount++, b);
             if (_byteCount >= 11)
             {
-                _currentPacket.setData(_receiveBuffer);
                 _state = ParserState::ReceivingSum;
-                _receiveBuffer = std::queue<uint8_t>();
             }
             break;
 
@@ -77,6 +71,7 @@ public:
             }
             else
             {
+                _errors++;
                 clear();
             }
             break;
@@ -91,10 +86,16 @@ public:
         return _currentPacket;
     }
 
+    /// @brief Number of frames dropped due to checksum or end mark
+    /// @return counter
+    uint32_t errors() const
+    {
+        return _errors;
+    }
+
     /// @brief Go to initial state
     void clear()
     {
-        std::queue<uint8_t>().swap(_receiveBuffer);
         _state = ParserState::WaitingForHead;
         _byteCount = 0;
         _currentPacket.clear();
@@ -115,8 +116,8 @@ private:
 
     ParserState _state{ParserState::WaitingForHead};    ///< parse state
     Packet _currentPacket;                              ///< packet content
-    std::queue<uint8_t> _receiveBuffer;                 ///< aux buffer
     size_t _byteCount{0};                               ///< counter of receiced bytes
+    uint32_t _errors{0};                                ///< counter of invalid frames
 };
 
 } // namespace lamp 
\ No newline at end of file
@@ -0,0 +1,141 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   pending_writes.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+/// @brief Value of a key-value store
+struct StoredValue {
+	enum class Kind : uint8_t {
+		U32,
+		Str,
+		Blob
+	};
+
+	Kind kind{Kind::U32};
+	uint32_t num{0};
+	std::string str;		///< string or blob
+};
+
+/// @brief Write-behind set of a key-value store, the batching part of KeyVal
+///
+/// No hardware and no OS dependency - the store is a template parameter, time is
+/// a tick count of the caller. Writes of the same key coalesce, flush() writes every
+/// pending key once and commits the whole batch once. Lookups of pending values are
+/// hash lookups, independent of the number of pending keys.
+///
+/// Storage provides:
+///   bool write(const std::string &key, const StoredValue &value);
+///   bool commit();
+///
+/// A failed write or commit returns its keys to the pending set, a newer write of
+/// the same key wins.
+template <typename Storage>
+class PendingWrites
+{
+public:
+	/// @brief Store value, replaces a pending value of the key
+	/// @param key key
+	/// @param value value
+	/// @param now time [ticks]
+	/// @param age age of the oldest pending write [ticks]
+	/// @return pending keys
+	size_t stage(const std::string &key, StoredValue &&value, uint32_t now, uint32_t &age)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_dirty.empty()) {
+			_firstDirty = now;
+		}
+		_dirty[key] = std::move(value);
+		age = now - _firstDirty;
+		return _dirty.size();
+	}
+
+	/// @brief Pending value of the key, including the batch being flushed
+	bool find(const std::string &key, StoredValue &value) const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto it = _dirty.find(key);
+		if (it != _dirty.end()) {
+			value = it->second;
+			return true;
+		}
+		it = _flushing.find(key);
+		if (it != _flushing.end()) {
+			value = it->second;
+			return true;
+		}
+		return false;
+	}
+
+	/// @brief Pending keys, the batch being flushed excluded
+	size_t pending() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _dirty.size();
+	}
+
+	/// @brief Write pending values, one commit per batch
+	/// @param storage store, one flush at a time
+	/// @param now time [ticks], start of the age of keys returned on failure
+	/// @return true - success or nothing pending
+	bool flush(Storage &storage, uint32_t now)
+	{
+		std::lock_guard<std::mutex> flushLock(_flushMutex);
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_dirty.empty()) {
+				return true;
+			}
+			// writers continue into an empty set, readers still see _flushing
+			_flushing.swap(_dirty);
+		}
+
+		std::vector<const std::string *> failed;	///< keys of rejected writes
+		for (const auto &item : _flushing) {
+			if (!storage.write(item.first, item.second)) {
+				failed.push_back(&item.first);
+			}
+		}
+		const bool committed = storage.commit();
+
+		const bool ok = committed && failed.empty();
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!ok) {
+			// back to the dirty set, a newer write of the same key wins
+			if (_dirty.empty()) {
+				_firstDirty = now;
+			}
+			if (!committed) {
+				for (auto &item : _flushing) {
+					_dirty.try_emplace(item.first, std::move(item.second));
+				}
+			} else {
+				for (const auto *key : failed) {
+					_dirty.try_emplace(*key, std::move(_flushing[*key]));
+				}
+			}
+		}
+		_flushing.clear();
+		return ok;
+	}
+
+private:
+	using Map = std::unordered_map<std::string, StoredValue>;
+
+	mutable std::mutex _mutex;			///< dirty sets
+	std::mutex _flushMutex;				///< one flush at a time
+	Map _dirty;							///< pending writes
+	Map _flushing;						///< being written
+	uint32_t _firstDirty{0};			///< oldest pending write [ticks]
+};
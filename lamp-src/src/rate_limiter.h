@@ -0,0 +1,128 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   rate_limiter.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <algorithm>
+
+/// @brief Per-client token bucket admission control
+///
+/// Fixed table of client buckets keyed by IPv4 address, the least recently
+/// seen client is recycled when the table is full. No allocation and no locking,
+/// all calls are expected from one task (httpd serves requests sequentially).
+template <size_t Clients>
+class TokenBucketLimiter
+{
+public:
+    /// @brief CTOR
+    /// @param ratePerSec refill rate - requests per second
+    /// @param burst bucket size - requests allowed in one burst
+    TokenBucketLimiter(uint32_t ratePerSec = 10, uint32_t burst = 20)
+    {
+        configure(ratePerSec, burst);
+    }
+
+    /// @brief Change limits, all buckets are refilled
+    /// @param ratePerSec refill rate - requests per second
+    /// @param burst bucket size
+    void configure(uint32_t ratePerSec, uint32_t burst)
+    {
+        _rate = ratePerSec ? ratePerSec : 1;
+        _burst = (burst ? burst : 1) * _scale;
+        for (auto &b : _buckets)
+        {
+            b.addr = 0;
+            b.tokens = _burst;
+            b.fraction = 0;
+        }
+    }
+
+    /// @brief Try to take one token for a client
+    /// @param addr client IPv4 address
+    /// @param nowUs monotonic time in microseconds
+    /// @return true - request admitted
+    bool admit(uint32_t addr, int64_t nowUs)
+    {
+        auto &b = bucket(addr, nowUs);
+        b.lastSeenUs = nowUs;
+
+        // refill, tokens are kept in 1/_scale units, the part of a unit not yet
+        // earned stays in fraction - frequent requests don't lose refill time
+        int64_t elapsed = nowUs - b.lastUs;
+        if (elapsed > 0)
+        {
+            const uint64_t earned = static_cast<uint64_t>(elapsed) * _rate * _scale + b.fraction;
+            const uint64_t add = earned / 1000000ull;
+            b.lastUs = nowUs;
+            if (b.tokens + add >= _burst)
+            {
+                // full bucket, nothing to carry over
+                b.tokens = _burst;
+                b.fraction = 0;
+            }
+            else
+            {
+                b.tokens += static_cast<uint32_t>(add);
+                b.fraction = static_cast<uint32_t>(earned % 1000000ull);
+            }
+        }
+
+        if (b.tokens >= _scale)
+        {
+            b.tokens -= _scale;
+            return true;
+        }
+
+        _rejected++;
+        return false;
+    }
+
+    /// @brief Number of rejected requests since start
+    uint32_t rejected() const { return _rejected; }
+
+private:
+    struct Bucket
+    {
+        uint32_t addr{0};     ///< client address, 0 - free slot
+        uint32_t tokens{0};   ///< available tokens * _scale
+        uint32_t fraction{0}; ///< refill not yet converted to a token unit [units * 1e6]
+        int64_t lastUs{0};    ///< last refill time
+        int64_t lastSeenUs{0}; ///< last request - LRU, a rejected client is not idle
+    };
+
+    /// @brief Find client bucket or recycle the least recently used one
+    Bucket &bucket(uint32_t addr, int64_t nowUs)
+    {
+        Bucket *lru = &_buckets[0];
+        for (auto &b : _buckets)
+        {
+            if (b.addr == addr)
+            {
+                return b;
+            }
+            if (b.lastSeenUs < lru->lastSeenUs)
+            {
+                lru = &b;
+            }
+        }
+
+        lru->addr = addr;
+        lru->tokens = _burst;
+        lru->fraction = 0;
+        lru->lastUs = nowUs;
+        lru->lastSeenUs = nowUs;
+        return *lru;
+    }
+
+    static constexpr uint32_t _scale{1000};  ///< fixed point scale of tokens
+    std::array<Bucket, Clients> _buckets;    ///< client table
+    uint32_t _rate{10};                      ///< refill rate per second
+    uint32_t _burst{20 * _scale};            ///< bucket size * _scale
+    uint32_t _rejected{0};                   ///< rejected requests counter
+};
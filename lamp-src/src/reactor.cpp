@@ -0,0 +1,99 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   reactor.cpp
+/// @author Petr Vanek
+
+#include <stdio.h>
+#include "esp_log.h"
+#include "reactor.h"
+
+Reactor::Reactor(UBaseType_t setLength)
+{
+    _set = xQueueCreateSet(setLength);
+}
+
+Reactor::~Reactor()
+{
+    done();
+    if (_set)
+        vQueueDelete(_set);
+}
+
+bool Reactor::listen(QueueHandle_t queue)
+{
+    if (!_set || !queue || _count >= _maxMailboxes)
+    {
+        return false;
+    }
+    if (xQueueAddToSet(queue, _set) != pdPASS)
+    {
+        ESP_LOGE("Reactor", "queue can't join the set");
+        return false;
+    }
+    _mailboxes[_count++].queue = queue;
+    return true;
+}
+
+void Reactor::bind(QueueHandle_t queue, MailboxFunc fn)
+{
+    for (size_t i = 0; i < _count; ++i)
+    {
+        if (_mailboxes[i].queue == queue)
+        {
+            _mailboxes[i].fn = fn;
+            return;
+        }
+    }
+    ESP_LOGE("Reactor", "handler of not listened queue");
+}
+
+void Reactor::armTimer(uint32_t ms)
+{
+    _deadline = xTaskGetTickCount() + pdMS_TO_TICKS(ms);
+    _timerArmed = true;
+}
+
+void Reactor::dispatch()
+{
+    while (true)
+    {
+        TickType_t wait = portMAX_DELAY;
+        if (_timerArmed)
+        {
+            auto left = static_cast<int32_t>(_deadline - xTaskGetTickCount());
+            wait = left > 0 ? static_cast<TickType_t>(left) : 0;
+        }
+
+        auto member = xQueueSelectFromSet(_set, wait);
+        if (member)
+        {
+            for (size_t i = 0; i < _count; ++i)
+            {
+                auto &mb = _mailboxes[i];
+                if (mb.queue == member)
+                {
+                    if (mb.fn)
+                    {
+                        mb.fn(mb.queue);
+                    }
+                    else
+                    {
+                        ESP_LOGE("Reactor", "mailbox without handler");
+                    }
+                    break;
+                }
+            }
+        }
+
+        if (_timerArmed && static_cast<int32_t>(_deadline - xTaskGetTickCount()) <= 0)
+        {
+            _timerArmed = false;
+            if (_timerFunc)
+            {
+                _timerFunc();
+            }
+        }
+    }
+}
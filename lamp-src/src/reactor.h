@@ -0,0 +1,80 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   reactor.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <array>
+#include <functional>
+#include "rptask.h"
+
+/// @brief Task blocked on a queue set of its mailboxes and a one-shot timer
+///
+/// Mailboxes are added to the set in the constructor (listen), before any other task
+/// can post into them - a queue with items can't join a set. The task binds typed
+/// handlers in loop() and calls dispatch(), which wakes only for a message or
+/// an expired timer.
+class Reactor : public RPTask
+{
+public:
+	/// @param setLength sum of the lengths of all listened queues
+	explicit Reactor(UBaseType_t setLength);
+	virtual ~Reactor();
+
+protected:
+	using TimerFunc = std::function<void()>;
+
+	/// @brief Add queue to the set, call from constructor
+	/// @param queue mailbox
+	/// @return true if added
+	bool listen(QueueHandle_t queue);
+
+	/// @brief Bind typed handler of the mailbox
+	/// @param queue listened mailbox
+	/// @param fn handler
+	template <typename T>
+	void on(QueueHandle_t queue, std::function<void(const T &)> fn)
+	{
+		bind(queue, [fn](QueueHandle_t q) {
+			T item;
+			if (xQueueReceive(q, &item, 0) == pdTRUE) {
+				fn(item);
+			}
+		});
+	}
+
+	/// @brief Timer handler
+	void onTimer(TimerFunc fn) { _timerFunc = fn; }
+
+	/// @brief Arm one-shot timer, re-arm from the handler for periodic work
+	/// @param ms timeout, replaces the previous one
+	void armTimer(uint32_t ms);
+
+	/// @brief Cancel timer
+	void disarmTimer() { _timerArmed = false; }
+
+	/// @brief Event loop, never returns
+	void dispatch();
+
+private:
+	using MailboxFunc = std::function<void(QueueHandle_t)>;
+
+	struct Binding {
+		QueueHandle_t queue{nullptr};	///< listened queue
+		MailboxFunc fn{};				///< receives & handles one item
+	};
+
+	void bind(QueueHandle_t queue, MailboxFunc fn);
+
+	static constexpr size_t _maxMailboxes{4};
+
+	QueueSetHandle_t _set{nullptr};					///< mailboxes
+	std::array<Binding, _maxMailboxes> _mailboxes{};	///< handlers
+	size_t _count{0};								///< listened mailboxes
+	TimerFunc _timerFunc{};							///< timer handler
+	TickType_t _deadline{0};						///< timer expiration
+	bool _timerArmed{false};						///< timer is running
+};
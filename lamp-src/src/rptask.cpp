@@ -39,7 +39,7 @@ bool RPTask::init(const char * name,
                   UBaseType_t priority,
                   const configSTACK_DEPTH_TYPE stackDepth)
 {
-
+    _stackDepth = stackDepth;
     auto res = xTaskCreate(
         RPTask::handler,
        name,
@@ -50,11 +50,29 @@ bool RPTask::init(const char * name,
     return (res == pdPASS);
 }
 
+bool RPTask::init(const TaskConfig &cfg, StackType_t *stack, StaticTask_t *tcb)
+{
+    _stackDepth = cfg.stack;
+    _handle = xTaskCreateStaticPinnedToCore(
+        RPTask::handler,
+        cfg.name,
+        cfg.stack,
+        (void *)this,
+        cfg.priority,
+        stack,
+        tcb,
+        cfg.core);
+    return (_handle != NULL);
+}
+
 void RPTask::handler(void *pvParameters)
 {
     RPTask *task = (RPTask *)pvParameters;
     if (task != NULL)
     {
         task->loop();
+        // loop finished (task not needed or failed), the handle is no longer valid
+        task->_handle = NULL;
     }
+    vTaskDelete(NULL);
 }
\ No newline at end of file
@@ -11,14 +11,52 @@
 #include "freertos/task.h"
 #include "freertos/queue.h"
 
+/// @brief Task parameters, see task_config.h
+struct TaskConfig {
+	const char *name;			///< task name
+	UBaseType_t priority;		///< FreeRTOS priority
+	BaseType_t core;			///< PRO_CPU_NUM, APP_CPU_NUM, tskNO_AFFINITY
+	uint32_t stack;				///< stack size [bytes]
+};
+
+/// @brief Statically reserved stack & TCB
+template <uint32_t Stack>
+struct TaskMemory {
+	StackType_t stack[Stack];	///< ESP32 StackType_t is one byte
+	StaticTask_t tcb;			///< task control block
+};
+
+/// @brief Statically reserved queue
+template <typename T, size_t Depth>
+class QueueMemory {
+public:
+	QueueHandle_t create() {
+		return xQueueCreateStatic(Depth, sizeof(T), _storage, &_queue);
+	}
+
+private:
+	uint8_t _storage[Depth * sizeof(T)];	///< items
+	StaticQueue_t _queue;					///< queue control block
+};
+
 class RPTask
 {
 public:
 	RPTask();
 	virtual ~RPTask();
 	virtual bool init(const char * name, UBaseType_t priority = tskIDLE_PRIORITY, const configSTACK_DEPTH_TYPE stackDepth = configMINIMAL_STACK_SIZE);
+	virtual bool init(const TaskConfig &cfg, StackType_t *stack, StaticTask_t *tcb);
+
+	/// @brief Create task with static stack & TCB, one memory block per configuration
+	template <const TaskConfig &Cfg>
+	bool init() {
+		static TaskMemory<Cfg.stack> memory;
+		return init(Cfg, memory.stack, &memory.tcb);
+	}
+
 	virtual void done();
 	virtual TaskHandle_t task();
+	configSTACK_DEPTH_TYPE stackDepth() const { return _stackDepth; }
 
 protected:
 	static void handler(void *pvParameters);
@@ -26,4 +64,5 @@ protected:
 
 private:
 	TaskHandle_t _handle = NULL;
+	configSTACK_DEPTH_TYPE _stackDepth = 0;	///< stack size given to init
 };
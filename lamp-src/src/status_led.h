@@ -0,0 +1,247 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   status_led.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "driver/gpio.h"
+#include "driver/rmt_tx.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "bus.h"
+#include "lcs_info.h"
+
+enum class BlinkMode {
+    AP_MODE,
+    CLIENT,
+    ERROR,
+    LEARN,
+    NONE
+};
+
+template <>
+struct Topic<BlinkMode> {
+    static constexpr const char *name = "led_mode";
+    static constexpr bool latest = true;
+    static constexpr size_t depth = 1;
+    static constexpr size_t subscribers = 1;
+};
+
+/// @brief Status LED driven by RMT
+///
+/// A blink pattern is a few RMT symbols transmitted in an endless hardware loop,
+/// no task and no CPU is involved while it runs. A new mode aborts the running
+/// pattern immediately. RF activity overlays a short flash, then the pattern
+/// starts over; flashes are spaced by a hold-off, so busy traffic does not hide
+/// the pattern. All RMT calls run in the esp_timer task.
+class StatusLed
+{
+public:
+    /// @brief CTOR, subscribes BlinkMode & RfActivity
+    /// @param pin LED pin
+    explicit StatusLed(gpio_num_t pin) : _pin(pin)
+    {
+        Bus<BlinkMode>::subscribe(&StatusLed::onMode, this);
+        Bus<RfActivity>::subscribe(&StatusLed::onActivity, this);
+    }
+
+    ~StatusLed()
+    {
+        done();
+    }
+
+    StatusLed(const StatusLed &) = delete;
+    StatusLed &operator=(const StatusLed &) = delete;
+
+    /// @brief Create RMT channel & timer, shows the current mode
+    /// @return true if OK
+    bool init()
+    {
+        rmt_tx_channel_config_t cfg{};
+        cfg.gpio_num = _pin;
+        // ESP32 - 1 MHz REF_TICK allows the 10 kHz resolution (APB divider is max. 255)
+        cfg.clk_src = RMT_CLK_SRC_REF_TICK;
+        cfg.resolution_hz = _resolutionHz;
+        cfg.mem_block_symbols = 64;
+        cfg.trans_queue_depth = 2;
+        if (rmt_new_tx_channel(&cfg, &_channel) != ESP_OK) {
+            ESP_LOGE("StatusLed", "RMT channel failed");
+            return false;
+        }
+
+        rmt_copy_encoder_config_t enc{};
+        if (rmt_new_copy_encoder(&enc, &_encoder) != ESP_OK) {
+            ESP_LOGE("StatusLed", "RMT encoder failed");
+            return false;
+        }
+
+        esp_timer_create_args_t args{};
+        args.callback = &StatusLed::update;
+        args.arg = this;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name = "led";
+        if (esp_timer_create(&args, &_timer) != ESP_OK) {
+            ESP_LOGE("StatusLed", "timer failed");
+            return false;
+        }
+
+        kick();
+        return true;
+    }
+
+    void done()
+    {
+        if (_timer) {
+            esp_timer_stop(_timer);
+            esp_timer_delete(_timer);
+            _timer = nullptr;
+        }
+        if (_channel) {
+            if (_enabled) {
+                rmt_disable(_channel);
+                _enabled = false;
+            }
+            rmt_del_channel(_channel);
+            _channel = nullptr;
+        }
+        if (_encoder) {
+            rmt_del_encoder(_encoder);
+            _encoder = nullptr;
+        }
+    }
+
+    /// @brief Switch pattern, takes effect immediately
+    void mode(BlinkMode mode)
+    {
+        _mode.store(mode, std::memory_order_relaxed);
+        kick();
+    }
+
+    /// @brief Flash over the pattern, ignored during the hold-off
+    void activity()
+    {
+        const uint32_t now = static_cast<uint32_t>(esp_timer_get_time() / 1000);
+        if (static_cast<int32_t>(now - _quietUntil.load(std::memory_order_relaxed)) < 0) {
+            return;
+        }
+        _quietUntil.store(now + _flashMs + _holdoffMs, std::memory_order_relaxed);
+        _flash.store(true, std::memory_order_relaxed);
+        kick();
+    }
+
+private:
+    static void onMode(const BlinkMode &mode, void *ctx)
+    {
+        static_cast<StatusLed *>(ctx)->mode(mode);
+    }
+
+    static void onActivity(const RfActivity &, void *ctx)
+    {
+        static_cast<StatusLed *>(ctx)->activity();
+    }
+
+    /// @brief RMT symbol, two levels [ms]
+    static rmt_symbol_word_t symbol(uint8_t level0, uint16_t ms0, uint8_t level1, uint16_t ms1)
+    {
+        rmt_symbol_word_t s{};
+        s.level0 = level0;
+        s.duration0 = ms0 * (_resolutionHz / 1000);
+        s.level1 = level1;
+        s.duration1 = ms1 * (_resolutionHz / 1000);
+        return s;
+    }
+
+    /// @brief Run update() in the esp_timer task now
+    void kick()
+    {
+        if (_timer) {
+            esp_timer_stop(_timer);
+            esp_timer_start_once(_timer, 0);
+        }
+    }
+
+    /// @brief Transmit symbols, aborts the running transmission
+    /// @param symbols data, must stay valid
+    /// @param count symbols
+    /// @param loop endless hardware loop
+    void play(const rmt_symbol_word_t *symbols, size_t count, bool loop)
+    {
+        // disable aborts the running loop, a never enabled channel must not be disabled
+        if (_enabled) {
+            rmt_disable(_channel);
+            _enabled = false;
+        }
+        if (rmt_enable(_channel) != ESP_OK) {
+            return;
+        }
+        _enabled = true;
+        rmt_transmit_config_t cfg{};
+        cfg.loop_count = loop ? -1 : 0;
+        cfg.flags.eot_level = 0;
+        rmt_transmit(_channel, _encoder, symbols, count * sizeof(rmt_symbol_word_t), &cfg);
+    }
+
+    /// @brief esp_timer callback - flash or the current pattern
+    static void update(void *arg)
+    {
+        auto *led = static_cast<StatusLed *>(arg);
+
+        // AP mode .. .. ..
+        static const rmt_symbol_word_t apMode[] = {symbol(1, 100, 0, 100), symbol(1, 100, 0, 600)};
+        // CLIENT - - - -
+        static const rmt_symbol_word_t client[] = {symbol(1, 500, 0, 500)};
+        // ERROR  . . . . .
+        static const rmt_symbol_word_t error[] = {symbol(1, 100, 0, 100)};
+        // LEARN    . -  . -
+        static const rmt_symbol_word_t learn[] = {symbol(1, 100, 0, 100), symbol(1, 500, 0, 500)};
+        // NONE
+        static const rmt_symbol_word_t off[] = {symbol(0, 1, 0, 1)};
+        // activity flash, dark gap makes it visible on a lit LED too
+        static const rmt_symbol_word_t flash[] = {symbol(0, _gapMs, 1, _flashMs - 2 * _gapMs), symbol(0, _gapMs, 0, 1)};
+
+        if (led->_flash.exchange(false, std::memory_order_relaxed)) {
+            led->play(flash, 2, false);
+            // pattern starts over after the flash
+            esp_timer_start_once(led->_timer, _flashMs * 1000);
+            return;
+        }
+
+        switch (led->_mode.load(std::memory_order_relaxed)) {
+            case BlinkMode::AP_MODE:
+                led->play(apMode, sizeof(apMode) / sizeof(apMode[0]), true);
+                break;
+            case BlinkMode::CLIENT:
+                led->play(client, sizeof(client) / sizeof(client[0]), true);
+                break;
+            case BlinkMode::ERROR:
+                led->play(error, sizeof(error) / sizeof(error[0]), true);
+                break;
+            case BlinkMode::LEARN:
+                led->play(learn, sizeof(learn) / sizeof(learn[0]), true);
+                break;
+            case BlinkMode::NONE:
+            default:
+                led->play(off, 1, false);
+                break;
+        }
+    }
+
+    static constexpr uint32_t _resolutionHz{10000};    ///< 0.1 ms tick, max. 3.2 s per level
+    static constexpr uint16_t _flashMs{80};            ///< whole flash
+    static constexpr uint16_t _gapMs{20};              ///< dark before & after the flash
+    static constexpr uint32_t _holdoffMs{200};         ///< min. time between flashes
+
+    gpio_num_t _pin;
+    rmt_channel_handle_t _channel{nullptr};
+    rmt_encoder_handle_t _encoder{nullptr};
+    esp_timer_handle_t _timer{nullptr};
+    bool _enabled{false};                           ///< RMT channel enabled, esp_timer task only
+    std::atomic<BlinkMode> _mode{BlinkMode::NONE};  ///< requested pattern
+    std::atomic<bool> _flash{false};                ///< flash requested
+    std::atomic<uint32_t> _quietUntil{0};           ///< no flash until [ms]
+};
@@ -0,0 +1,32 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   task_config.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "rptask.h"
+#include "literals.h"
+
+/// @brief Task table - name, priority, core, stack
+///
+/// The 2.4 GHz link runs alone on APP_CPU above the other lamp tasks, WiFi (pinned
+/// to core 0 by sdkconfig), httpd and the WiFi / web tasks stay on PRO_CPU.
+/// Stacks are reserved statically, see RPTask::init<>().
+class task_config
+{
+public:
+    static constexpr TaskConfig wifi{literals::tsk_wifi, tskIDLE_PRIORITY + 1, PRO_CPU_NUM, 4086};
+    static constexpr TaskConfig web{literals::tsk_web, tskIDLE_PRIORITY + 1, PRO_CPU_NUM, 4086};
+    static constexpr TaskConfig lcs{literals::tsk_lcs, tskIDLE_PRIORITY + 4, APP_CPU_NUM, 4086};
+    static constexpr TaskConfig button{literals::btn_lcs, tskIDLE_PRIORITY + 1, tskNO_AFFINITY, 4086};
+    static constexpr TaskConfig udp{literals::tsk_udp, tskIDLE_PRIORITY + 1, tskNO_AFFINITY, 4086};
+    static constexpr TaskConfig dmx{literals::tsk_dmx, tskIDLE_PRIORITY + 1, tskNO_AFFINITY, 4086};
+    static constexpr TaskConfig mqtt{literals::tsk_mqtt, tskIDLE_PRIORITY + 1, tskNO_AFFINITY, 4086};
+
+    /// httpd is created by esp_http_server (heap), only its placement is set
+    static constexpr TaskConfig httpd{"httpd", tskIDLE_PRIORITY + 5, PRO_CPU_NUM, 4096};
+};
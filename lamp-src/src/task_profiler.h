@@ -0,0 +1,141 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   task_profiler.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <functional>
+#include <algorithm>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/// @brief Per-task CPU usage over a sliding window
+///
+/// Needs CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS.
+/// sample() is called periodically, the usage is the run time counter delta between
+/// the newest and the oldest of Window snapshots. Counters are 32 bit, unsigned
+/// differences survive the wrap around.
+template <size_t Tasks, size_t Window>
+class TaskProfiler
+{
+public:
+    /// @brief Task report
+    struct Row
+    {
+        const char *name;           ///< task name
+        TaskHandle_t handle;        ///< task handle
+        BaseType_t core;            ///< pinned core, tskNO_AFFINITY
+        UBaseType_t priority;       ///< current priority
+        eTaskState state;           ///< running, ready, blocked ...
+        uint32_t stackFree;         ///< stack high water mark [bytes]
+        uint32_t cpuPermille;       ///< CPU usage over window, 1000 - one core
+    };
+
+    /// @brief Take snapshot of run time counters
+    void sample()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto &snap = _snap[_next];
+        uint32_t total = 0;
+        snap.count = uxTaskGetSystemState(_status.data(), _status.size(), &total);
+        snap.total = total;
+        for (size_t i = 0; i < snap.count; ++i)
+        {
+            snap.task[i].handle = _status[i].xHandle;
+            snap.task[i].counter = _status[i].ulRunTimeCounter;
+        }
+        _next = (_next + 1) % Window;
+        if (_samples < Window)
+        {
+            _samples++;
+        }
+    }
+
+    /// @brief Current state of all tasks
+    /// @param fn called for every task
+    /// @return window length in run time counter units
+    uint32_t report(std::function<void(const Row &)> fn)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_samples == 0)
+        {
+            return 0;
+        }
+
+        const auto &newest = _snap[(_next + Window - 1) % Window];
+        const auto &oldest = _snap[(_next + Window - _samples) % Window];
+        // total counter runs at the rate of one core, both cores together give 2000 permille
+        const uint32_t window = newest.total - oldest.total;
+
+        uint32_t total = 0;
+        UBaseType_t count = uxTaskGetSystemState(_status.data(), _status.size(), &total);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto &st = _status[i];
+            Row row{};
+            row.name = st.pcTaskName;
+            row.handle = st.xHandle;
+            row.core = st.xCoreID;
+            row.priority = st.uxCurrentPriority;
+            row.state = st.eCurrentState;
+            row.stackFree = st.usStackHighWaterMark;
+
+            uint32_t a, b;
+            if (window && counter(newest, st.xHandle, a) && counter(oldest, st.xHandle, b))
+            {
+                row.cpuPermille = static_cast<uint32_t>(static_cast<uint64_t>(a - b) * 1000 / window);
+            }
+            fn(row);
+        }
+        return window;
+    }
+
+    /// @brief Suggested stack size, used stack + 25 % + 512 B, rounded up to 256 B
+    /// @param configured stack size given to xTaskCreate
+    /// @param stackFree high water mark
+    /// @return bytes
+    static uint32_t suggestStack(uint32_t configured, uint32_t stackFree)
+    {
+        uint32_t used = configured > stackFree ? configured - stackFree : 0;
+        uint32_t s = used + used / 4 + 512;
+        return (s + 255) & ~255u;
+    }
+
+private:
+    struct Counter
+    {
+        TaskHandle_t handle{nullptr};
+        uint32_t counter{0};
+    };
+
+    struct Snapshot
+    {
+        std::array<Counter, Tasks> task{};
+        size_t count{0};
+        uint32_t total{0};
+    };
+
+    static bool counter(const Snapshot &snap, TaskHandle_t handle, uint32_t &value)
+    {
+        for (size_t i = 0; i < snap.count; ++i)
+        {
+            if (snap.task[i].handle == handle)
+            {
+                value = snap.task[i].counter;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::mutex _mutex;                          ///< sampler (web task) & reader (httpd)
+    std::array<TaskStatus_t, Tasks> _status{};  ///< uxTaskGetSystemState buffer
+    std::array<Snapshot, Window> _snap{};       ///< ring of snapshots
+    size_t _next{0};                            ///< next snapshot to write
+    size_t _samples{0};                         ///< valid snapshots
+};
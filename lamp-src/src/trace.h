@@ -0,0 +1,135 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   trace.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+/// @brief Traced spans
+enum class TraceEvent : uint8_t {
+	ParseBatch,		///< UART read & PacketParser batch
+	UartTx,			///< frame write until TX done
+	HttpHandler,	///< httpd URI handler
+	NvsCommit,		///< nvs_commit
+	HistoryWrite,	///< history log records written to flash
+	Count
+};
+
+/// @brief Binary trace record, 12 bytes
+struct TraceRecord {
+	uint32_t ts;		///< esp_timer low 32 bits [us]
+	uint32_t task;		///< task handle - lane in the viewer
+	uint8_t event;		///< TraceEvent
+	uint8_t phase;		///< 'B' begin / 'E' end
+	uint16_t arg;		///< event argument (bytes, ...)
+};
+
+/// @brief Per-core lock-free trace ring buffer
+///
+/// Disabled trace costs one relaxed load. Enabled trace costs a timestamp, a slot
+/// reservation and a store - the slot is reserved by fetch_add, so preemption
+/// between tasks of one core never mixes records. The oldest records are overwritten.
+///
+/// Download format (little endian):
+/// "LTRC", u8 version, u8 cores, u16 records per core, u64 time of download,
+/// u8 event count, event names ('\0' terminated),
+/// u8 task count, { u32 handle, name ('\0' terminated) } ...,
+/// per core: u32 head (number of written records), records[records per core]
+class Trace
+{
+public:
+	static constexpr size_t _records = 256;		///< per core, power of 2
+	static constexpr uint8_t _version = 1;
+
+	static_assert((_records & (_records - 1)) == 0, "power of 2");
+
+	static void enable(bool on)
+	{
+		_enabled.store(on, std::memory_order_relaxed);
+	}
+
+	static bool enabled()
+	{
+		return _enabled.load(std::memory_order_relaxed);
+	}
+
+	/// @brief Store record
+	/// @param event traced event
+	/// @param phase 'B' / 'E'
+	/// @param arg argument
+	static inline void record(TraceEvent event, uint8_t phase, uint16_t arg = 0)
+	{
+		if (!_enabled.load(std::memory_order_relaxed)) {
+			return;
+		}
+		const auto core = xPortGetCoreID();
+		const uint32_t slot = _head[core].fetch_add(1, std::memory_order_relaxed);
+		auto &r = _ring[core][slot & (_records - 1)];
+		r.ts = static_cast<uint32_t>(esp_timer_get_time());
+		r.task = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(xTaskGetCurrentTaskHandle()));
+		r.event = static_cast<uint8_t>(event);
+		r.phase = phase;
+		r.arg = arg;
+	}
+
+	static const char *name(TraceEvent event)
+	{
+		static const char *names[] = {"parse", "uart_tx", "http", "nvs_commit", "history_write"};
+		static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(TraceEvent::Count), "event names");
+		return names[static_cast<size_t>(event)];
+	}
+
+	/// @brief Number of written records of core
+	static uint32_t head(size_t core)
+	{
+		return _head[core].load(std::memory_order_relaxed);
+	}
+
+	/// @brief Ring of core
+	static const TraceRecord *ring(size_t core)
+	{
+		return _ring[core];
+	}
+
+	static void clear()
+	{
+		for (auto &h : _head) {
+			h.store(0, std::memory_order_relaxed);
+		}
+	}
+
+private:
+	static inline std::atomic<bool> _enabled{false};
+	static inline std::atomic<uint32_t> _head[portNUM_PROCESSORS]{};
+	static inline TraceRecord _ring[portNUM_PROCESSORS][_records]{};
+};
+
+/// @brief Traced scope
+class TraceSpan
+{
+public:
+	explicit TraceSpan(TraceEvent event, uint16_t arg = 0) : _event(event)
+	{
+		Trace::record(_event, 'B', arg);
+	}
+
+	~TraceSpan()
+	{
+		Trace::record(_event, 'E');
+	}
+
+	TraceSpan(const TraceSpan &) = delete;
+	TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+	TraceEvent _event;
+};
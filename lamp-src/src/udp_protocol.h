@@ -0,0 +1,137 @@
+/*
+ * @file udp_protocol.h
+ * @author Petr Vanek (petr@fotoventus.cz)
+ * @brief Binary UDP control protocol, shared by firmware and host client
+ * @version 0.1
+ * @date 2024-03-04
+ *
+ * @copyright Copyright (c) 2024 Petr Vanek
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <algorithm>
+
+namespace lamp {
+
+/**
+ * @brief Fixed size UDP message, request and reply have the same layout
+ *
+ * byte:
+ * 0       MAGIC 0x4C ('L')
+ * 1       VERSION 0x01
+ * 2       Type (see Type)
+ * 3       Status - reply only (see Status)
+ * 4 - 7   Sequence number, little endian, echoed in reply
+ * 8       SetState: on (0/1)       Delta: signed intensity step    Scene: scene index
+ * 9       SetState: intensity      Delta: signed hue step
+ * 10      SetState: hue
+ * 11      reserved 0x00
+ *
+ * Reply (Type::State) carries on, intensity, hue of the last known lamp state at 8 - 10.
+ * The reply is sent when the request is queued for the 2.4 GHz link, so it shows the
+ * state before the request; the new state is returned by a later Query.
+ * Clients start the sequence at a random value, the lamp keeps the last sequence
+ * of 4 clients (address & port) only.
+ * A request with a sequence number not newer than the last one from the same
+ * client is not applied again, only the state is returned (Status::Duplicate).
+ */
+class UdpMessage
+{
+public:
+
+    enum class Type : uint8_t
+    {
+        SetState = 0x01,    ///< on/off, intensity, hue
+        Delta = 0x02,       ///< relative intensity & hue change
+        Scene = 0x03,       ///< recall preset
+        Query = 0x04,       ///< state query
+        State = 0x81        ///< reply
+    };
+
+    enum class Status : uint8_t
+    {
+        Ok = 0x00,          ///< request applied
+        Duplicate = 0x01,   ///< already applied sequence number
+        Busy = 0x02,        ///< RF queue is full, retry later
+        Invalid = 0x03      ///< malformed request
+    };
+
+    static constexpr size_t _size = 12;         ///< message length
+    static constexpr uint8_t _magic = 0x4C;     ///< 'L'
+    static constexpr uint8_t _version = 0x01;   ///< protocol version
+    static constexpr uint16_t _port = 4210;     ///< default UDP port
+
+    using Buffer = std::array<uint8_t, _size>;
+
+    UdpMessage() { _data.fill(0); _data[0] = _magic; _data[1] = _version; }
+
+    /// @brief Build message
+    /// @param type message type
+    /// @param seq sequence number
+    /// @param a, b, c payload bytes 8 - 10
+    static UdpMessage make(Type type, uint32_t seq, uint8_t a = 0, uint8_t b = 0, uint8_t c = 0)
+    {
+        UdpMessage m;
+        m.setType(type);
+        m.setSequence(seq);
+        m._data[8] = a;
+        m._data[9] = b;
+        m._data[10] = c;
+        return m;
+    }
+
+    /// @brief Parse received datagram
+    /// @param buf data
+    /// @param len length of data
+    /// @return true if header & length is valid
+    bool parse(const uint8_t *buf, size_t len)
+    {
+        if (len != _size || buf[0] != _magic || buf[1] != _version)
+        {
+            return false;
+        }
+        std::copy(buf, buf + _size, _data.begin());
+        return true;
+    }
+
+    Type getType() const { return static_cast<Type>(_data[2]); }
+    void setType(Type type) { _data[2] = static_cast<uint8_t>(type); }
+
+    Status getStatus() const { return static_cast<Status>(_data[3]); }
+    void setStatus(Status status) { _data[3] = static_cast<uint8_t>(status); }
+
+    uint32_t getSequence() const
+    {
+        return static_cast<uint32_t>(_data[4]) | (static_cast<uint32_t>(_data[5]) << 8) |
+               (static_cast<uint32_t>(_data[6]) << 16) | (static_cast<uint32_t>(_data[7]) << 24);
+    }
+
+    void setSequence(uint32_t seq)
+    {
+        _data[4] = seq & 0xFF;
+        _data[5] = (seq >> 8) & 0xFF;
+        _data[6] = (seq >> 16) & 0xFF;
+        _data[7] = (seq >> 24) & 0xFF;
+    }
+
+    /// @brief Payload byte 8 - 10
+    uint8_t arg(size_t i) const { return _data[8 + i]; }
+    void setArg(size_t i, uint8_t v) { _data[8 + i] = v; }
+
+    /// @brief Gets whole message
+    const Buffer &getContnet() const { return _data; }
+
+    /// @brief Sequence number a is newer than b (serial number arithmetic)
+    static bool newer(uint32_t a, uint32_t b)
+    {
+        return static_cast<int32_t>(a - b) > 0;
+    }
+
+private:
+    Buffer _data;   ///< content
+};
+
+} // namespace lamp
@@ -0,0 +1,143 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   udp_task.cpp
+/// @author Petr Vanek
+
+#include <stdio.h>
+#include <memory.h>
+#include <math.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <algorithm>
+#include "lwip/sockets.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "udp_task.h"
+#include "application.h"
+#include "packet.h"
+
+UdpTask::UdpTask(uint16_t port) : _port(port)
+{
+	_lcs.command = static_cast<uint8_t>(lamp::Packet::Command::Unknown);
+}
+
+UdpTask::~UdpTask()
+{
+	done();
+}
+
+void UdpTask::loop()
+{
+	int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0) {
+		ESP_LOGE("UdpTask", "socket failed");
+		return;
+	}
+
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(_port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) {
+		ESP_LOGE("UdpTask", "bind failed");
+		close(sock);
+		return;
+	}
+
+	// blocks until a datagram arrives, no wake-up without traffic
+	uint8_t buf[lamp::UdpMessage::_size + 1];
+	while (true)
+	{
+		struct sockaddr_in from = {};
+		socklen_t fromLen = sizeof(from);
+		int len = recvfrom(sock, buf, sizeof(buf), 0, reinterpret_cast<struct sockaddr *>(&from), &fromLen);
+		if (len <= 0) {
+			continue;
+		}
+		const LCSOrigin origin{LCSSource::Udp, esp_timer_get_time()};
+
+		lamp::UdpMessage msg;
+		lamp::UdpMessage::Status status = lamp::UdpMessage::Status::Invalid;
+		if (msg.parse(buf, len)) {
+			auto &cl = client(from.sin_addr.s_addr, from.sin_port);
+			if (msg.getType() != lamp::UdpMessage::Type::Query &&
+				cl.valid && !lamp::UdpMessage::newer(msg.getSequence(), cl.seq)) {
+				status = lamp::UdpMessage::Status::Duplicate;
+			} else {
+				status = apply(msg, origin);
+				if (status == lamp::UdpMessage::Status::Ok && msg.getType() != lamp::UdpMessage::Type::Query) {
+					// busy requests may be repeated with the same sequence number
+					cl.seq = msg.getSequence();
+					cl.valid = true;
+				}
+			}
+		}
+
+		// reply - last known state, the newest one from LCS if it changed meanwhile
+		_state.receive(_lcs);
+		auto reply = lamp::UdpMessage::make(lamp::UdpMessage::Type::State, msg.getSequence(),
+					_lcs.command == static_cast<uint8_t>(lamp::Packet::Command::On) ? 1 : 0,
+					_lcs.intensity, _lcs.hue);
+		reply.setStatus(status);
+		sendto(sock, reply.getContnet().data(), reply.getContnet().size(), 0,
+			   reinterpret_cast<struct sockaddr *>(&from), fromLen);
+	}
+}
+
+UdpTask::Client &UdpTask::client(uint32_t addr, uint16_t port)
+{
+	_clock++;
+	Client *lru = &_clients[0];
+	for (auto &c : _clients) {
+		if (c.addr == addr && c.port == port) {
+			c.used = _clock;
+			return c;
+		}
+		if (c.used < lru->used) {
+			lru = &c;
+		}
+	}
+
+	// new client - replaces the least recently used one
+	*lru = Client{};
+	lru->addr = addr;
+	lru->port = port;
+	lru->used = _clock;
+	return *lru;
+}
+
+lamp::UdpMessage::Status UdpTask::apply(const lamp::UdpMessage& msg, const LCSOrigin& origin)
+{
+	const uint8_t maxValue = 0x17;
+	auto lcs = Application::getInstance()->getLcsTask();
+	bool accepted = true;
+
+	switch (msg.getType()) {
+		case lamp::UdpMessage::Type::SetState:
+			accepted = lcs->state(msg.arg(0) != 0, std::min(msg.arg(1), maxValue), std::min(msg.arg(2), maxValue), origin);
+			break;
+
+		case lamp::UdpMessage::Type::Delta:
+			accepted = lcs->delta(static_cast<int8_t>(msg.arg(0)), static_cast<int8_t>(msg.arg(1)), origin);
+			break;
+
+		case lamp::UdpMessage::Type::Scene:
+			if (msg.arg(0) >= _scenes.size()) {
+				return lamp::UdpMessage::Status::Invalid;
+			} else {
+				const auto &scene = _scenes[msg.arg(0)];
+				accepted = lcs->state(scene.on, scene.intensity, scene.hue, origin);
+			}
+			break;
+
+		case lamp::UdpMessage::Type::Query:
+			break;
+
+		default:
+			return lamp::UdpMessage::Status::Invalid;
+	}
+
+	return accepted ? lamp::UdpMessage::Status::Ok : lamp::UdpMessage::Status::Busy;
+}
@@ -0,0 +1,58 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   udp_task.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <array>
+#include "hardware.h"
+#include "rptask.h"
+#include "lcs_info.h"
+#include "udp_protocol.h"
+
+/// @brief Binary UDP control (see udp_protocol.h)
+class UdpTask : public RPTask
+{
+public:
+	UdpTask(uint16_t port = lamp::UdpMessage::_port);
+	virtual ~UdpTask();
+
+protected:
+	void loop() override;
+
+private:
+	/// @brief last sequence number per client
+	struct Client {
+		uint32_t addr{0};
+		uint16_t port{0};
+		uint32_t seq{0};
+		bool valid{false};
+		uint32_t used{0};
+	};
+
+	/// @brief built-in scenes
+	struct Scene {
+		bool on;
+		uint8_t intensity;
+		uint8_t hue;
+	};
+
+	Client &client(uint32_t addr, uint16_t port);
+	lamp::UdpMessage::Status apply(const lamp::UdpMessage& msg, const LCSOrigin& origin);
+
+	static constexpr std::array<Scene, 4> _scenes{{
+		{false, 0x00, 0x00},	///< 0 - off
+		{true, 0x17, 0x17},		///< 1 - full, cold
+		{true, 0x10, 0x00},		///< 2 - warm
+		{true, 0x00, 0x00}		///< 3 - night
+	}};
+
+	uint16_t 				_port;
+	Mailbox<LampState>		_state;				///< newest lamp state
+	LampState				_lcs{};				///< last known lamp state
+	std::array<Client, 4> 	_clients{};			///< idempotency table
+	uint32_t				_clock{0};			///< LRU clock of client table
+};
@@ -0,0 +1,11 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   warm_state.cpp
+/// @author Petr Vanek
+
+#include "warm_state.h"
+
+// not initialized by the startup code - keeps the content over soft resets
+RTC_NOINIT_ATTR WarmState::Block WarmState::_block;
@@ -0,0 +1,164 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   warm_state.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_rom_crc.h"
+#include "esp_log.h"
+#include "config_record.h"
+
+/// @brief Last lamp state known to LC12STask
+struct WarmLamp {
+    std::array<uint8_t, 7> id;      ///< lamp ID
+    uint8_t hasId;                  ///< 0 - learn mode
+    uint8_t on;                     ///< 1 - lamp is on
+    uint8_t hue;
+    uint8_t intensity;
+};
+
+/// @brief State kept in RTC slow memory over soft resets
+///
+/// RTC_NOINIT memory keeps its content over software, panic and watchdog
+/// resets, it is garbage after power-on. The block is trusted only after such a
+/// reset and with a valid CRC, otherwise everything falls back to NVS. Every
+/// change rewrites the CRC - a reset in the middle of an update gives a cold boot.
+class WarmState {
+public:
+    static WarmState &getInstance() {
+        static WarmState instance;
+        return instance;
+    }
+
+    WarmState(WarmState const &) = delete;
+    void operator=(WarmState const &) = delete;
+
+    /// @brief Validate the block, call once at boot before the tasks start
+    /// @return true if warm boot - the block survived
+    bool restore() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const esp_reset_reason_t reason = esp_reset_reason();
+        _reason = reason;
+        _warm = retained(reason) && _block.magic == _magic && _block.crc == crc();
+        if (!_warm) {
+            _block = Block{};
+            _block.magic = _magic;
+            seal();
+        }
+        ESP_LOGI("WarmState", "%s boot, reset reason %d", _warm ? "warm" : "cold", static_cast<int>(reason));
+        return _warm;
+    }
+
+    /// @brief Warm boot detected by restore()
+    bool warm() const {
+        return _warm;
+    }
+
+    /// @brief Last lamp state
+    /// @param lamp output
+    /// @return false if unknown - use NVS
+    bool getLamp(WarmLamp &lamp) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_block.hasLamp) {
+            return false;
+        }
+        lamp = _block.lamp;
+        return true;
+    }
+
+    /// @brief Remember lamp state
+    void setLamp(const WarmLamp &lamp) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _block.lamp = lamp;
+        _block.hasLamp = 1;
+        seal();
+    }
+
+    /// @brief Configuration as stored by Config, Wi-Fi parameters included
+    /// @param rec output, checked by Config
+    /// @param level output, Config level key
+    /// @return false if unknown - use NVS
+    bool getConfig(ConfigRecord &rec, uint32_t &level) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_block.hasConfig) {
+            return false;
+        }
+        rec = _block.config;
+        level = _block.level;
+        return true;
+    }
+
+    /// @brief Remember configuration, with every change stored to NVS
+    void setConfig(const ConfigRecord &rec, uint32_t level) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _block.config = rec;
+        _block.level = level;
+        _block.hasConfig = 1;
+        seal();
+    }
+
+    /// @brief Reset by esp_restart - the shutdown handlers have flushed NVS
+    bool clean() const {
+        return _reason == ESP_RST_SW;
+    }
+
+private:
+    WarmState() = default;
+
+    static constexpr uint32_t _magic{0x574D5332u};     ///< "WMS2", change with the Block layout
+
+    struct Block {
+        uint32_t magic;
+        uint32_t crc;               ///< CRC32 of the bytes after the header
+        uint8_t hasLamp;            ///< lamp is valid
+        uint8_t hasConfig;          ///< config & level are valid
+        WarmLamp lamp;
+        uint32_t level;             ///< Config level key
+        ConfigRecord config;        ///< Config record with its own header & CRC
+    };
+
+    static_assert(std::is_trivially_copyable<Block>::value, "Block is checked as bytes");
+    static_assert(sizeof(Block) <= 2048, "RTC slow memory is 8 kB, shared with the ULP & deep sleep data");
+
+    static constexpr size_t _headerSize{offsetof(Block, hasLamp)};
+
+    /// @brief RTC memory survives this reset
+    static bool retained(esp_reset_reason_t reason) {
+        switch (reason) {
+            case ESP_RST_SW:
+            case ESP_RST_PANIC:
+            case ESP_RST_INT_WDT:
+            case ESP_RST_TASK_WDT:
+            case ESP_RST_WDT:
+            case ESP_RST_DEEPSLEEP:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static uint32_t crc() {
+        const auto *raw = reinterpret_cast<const uint8_t *>(&_block);
+        return esp_rom_crc32_le(0, raw + _headerSize, sizeof(Block) - _headerSize);
+    }
+
+    /// @brief Update CRC, called with the mutex held
+    static void seal() {
+        _block.crc = crc();
+    }
+
+    static Block _block;            ///< RTC_NOINIT, defined in warm_state.cpp
+    mutable std::mutex _mutex;
+    bool _warm{false};
+    esp_reset_reason_t _reason{ESP_RST_UNKNOWN};
+};
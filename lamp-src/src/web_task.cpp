@@ -13,306 +13,877 @@
 #include <ctype.h>
 
 #include "application.h"
+#include "task_config.h"
 #include "web_task.h"
 #include "http_server.h"
 #include "key_val.h"
-#include "content_file.h"
+#include "config.h"
+#include "asset_store.h"
 #include "http_request.h"
 #include "packet.h"
+#include "long_poll.h"
+#include "metrics.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "trace.h"
+#include "history_log.h"
+#include "boot_phases.h"
+#include <mutex>
+#include <algorithm>
+#include <array>
 #include <cJSON.h>
 
-WebTask::WebTask()
+/// @brief Render /values JSON
+/// @param lcs last known lamp state
+/// @param version state version for long-poll
+/// @return JSON
+static std::string valuesJson(const LampState &lcs, uint32_t version)
 {
-	_queue = xQueueCreate(2, sizeof(int));
-	_queueAP = xQueueCreate(2, sizeof(APInfo));
-	_queueLcs = xQueueCreate(2, sizeof(LCSInfo));
+	std::string rc;
+	cJSON *root = cJSON_CreateObject();
+	if (root) 
+	{
+		if (lcs.command == static_cast<uint8_t>(lamp::Packet::Command::Unknown)) {
+			// unknown values
+			cJSON_AddNumberToObject(root, "brightness", 0); 
+			cJSON_AddNumberToObject(root, "hue", 0);
+			cJSON_AddStringToObject(root, "id", "???");  
+		} else {
+			// Startup - known ID & last stored intensity & hue
+			cJSON_AddNumberToObject(root, "brightness", lcs.intensity); 
+			cJSON_AddNumberToObject(root, "hue", lcs.hue);  
+			cJSON_AddStringToObject(root, "id", lamp::Packet::arrayToString(lcs.id).c_str());  
+		}
+		cJSON_AddNumberToObject(root, "version", version);
+
+		char *json_string = cJSON_Print(root);
+		if (json_string != nullptr) {
+			rc = json_string;
+			free(json_string);
+		}
+		cJSON_Delete(root);
+	}
+	return rc;
+}
+
+/// @brief Topics of the task bus reported in /metrics
+using BusTopics = TopicList<LampState, RfActivity, BlinkMode, WebMode, WifiMode>;
+
+/// @brief Render /metrics in Prometheus text format
+/// @param server web server - per-route counters
+/// @return text
+static std::string metricsText(const HttpServer &server)
+{
+	std::string rc;
+	char line[128];
+	Metrics::render(rc);
+
+	server.forEachRoute([&rc, &line](const std::string &uri, httpd_method_t method, uint32_t requests) {
+		snprintf(line, sizeof(line), "lamp_http_requests_total{uri=\"%s\",method=\"%s\"} %u\n",
+				 uri.c_str(), http_method_str(method), static_cast<unsigned>(requests));
+		rc += line;
+	});
+
+	snprintf(line, sizeof(line), "lamp_heap_free_bytes %u\nlamp_heap_min_free_bytes %u\n",
+			 static_cast<unsigned>(esp_get_free_heap_size()), static_cast<unsigned>(esp_get_minimum_free_heap_size()));
+	rc += line;
+
+	// boot to 2.4 GHz link, IP address & first answered request, 0 - not yet
+	snprintf(line, sizeof(line), "lamp_boot_rf_ready_ms %u\nlamp_boot_got_ip_ms %u\nlamp_boot_first_http_ms %u\n",
+			 static_cast<unsigned>(BootPhases::get(BootPhase::RfReady) / 1000),
+			 static_cast<unsigned>(BootPhases::get(BootPhase::GotIp) / 1000),
+			 static_cast<unsigned>(BootPhases::get(BootPhase::FirstHttp) / 1000));
+	rc += line;
+
+	// Wi-Fi supervisor - recovered link losses, time to recover, network in use
+	const auto *wifi = Application::getInstance()->getWifiTask();
+	snprintf(line, sizeof(line), "lamp_wifi_recoveries_total %u\nlamp_wifi_recovery_last_ms %u\nlamp_wifi_recovery_max_ms %u\n",
+			 static_cast<unsigned>(wifi->recoveries()), static_cast<unsigned>(wifi->lastRecoveryMs()),
+			 static_cast<unsigned>(wifi->maxRecoveryMs()));
+	rc += line;
+	snprintf(line, sizeof(line), "lamp_wifi_network %u\n", static_cast<unsigned>(wifi->network()));
+	rc += line;
+
+	Application::getInstance()->forEachTask([&rc, &line](RPTask &task) {
+		// high water mark - minimum of free stack in bytes since the task start
+		snprintf(line, sizeof(line), "lamp_task_stack_free_min_bytes{task=\"%s\"} %u\n",
+				 pcTaskGetName(task.task()), static_cast<unsigned>(uxTaskGetStackHighWaterMark(task.task())));
+		rc += line;
+	});
+
+	BusTopics::forEach([&rc, &line](const char *topic, size_t subscribers, uint32_t drops) {
+		snprintf(line, sizeof(line), "lamp_bus_subscribers{topic=\"%s\"} %u\nlamp_bus_drops_total{topic=\"%s\"} %u\n",
+				 topic, static_cast<unsigned>(subscribers), topic, static_cast<unsigned>(drops));
+		rc += line;
+	});
+	return rc;
+}
+
+/// @brief Render /debug/latency JSON - percentiles per source & stage
+/// @param stats latency statistics
+/// @return JSON
+static std::string latencyJson(const LC12STask::Latency &stats)
+{
+	static const char *sources[] = {"web", "button", "udp", "mqtt", "dmx"};
+	static_assert(sizeof(sources) / sizeof(sources[0]) == static_cast<size_t>(LCSSource::Count), "source names");
+
+	std::string rc;
+	cJSON *root = cJSON_CreateObject();
+	if (root) 
+	{
+		for (size_t src = 0; src < static_cast<size_t>(LCSSource::Count); ++src) {
+			cJSON *source = cJSON_AddObjectToObject(root, sources[src]);
+			for (size_t st = 0; st < LC12STask::Latency::_stages; ++st) {
+				auto stage = static_cast<LC12STask::Latency::Stage>(st);
+				const auto &h = stats.get(src, stage);
+				cJSON *item = cJSON_AddObjectToObject(source, LC12STask::Latency::stageName(stage));
+				cJSON_AddNumberToObject(item, "count", h.samples());
+				cJSON_AddNumberToObject(item, "p50", h.percentile(50));
+				cJSON_AddNumberToObject(item, "p90", h.percentile(90));
+				cJSON_AddNumberToObject(item, "p99", h.percentile(99));
+				cJSON_AddNumberToObject(item, "max", h.max());
+			}
+		}
+
+		char *json_string = cJSON_PrintUnformatted(root);
+		if (json_string != nullptr) {
+			rc = json_string;
+			free(json_string);
+		}
+		cJSON_Delete(root);
+	}
+	return rc;
+}
+
+/// @brief Send trace buffer (binary, see Trace), tracing is paused while sending
+/// @param req request
+/// @return ESP_OK
+static esp_err_t traceDump(httpd_req_t *req)
+{
+	const bool wasEnabled = Trace::enabled();
+	Trace::enable(false);
+
+	std::string hdr("LTRC");
+	auto put = [&hdr](const void *p, size_t n) {
+		hdr.append(static_cast<const char *>(p), n);
+	};
+	const uint8_t version = Trace::_version;
+	const uint8_t cores = portNUM_PROCESSORS;
+	const uint16_t records = Trace::_records;
+	const int64_t now = esp_timer_get_time();
+	const uint8_t events = static_cast<uint8_t>(TraceEvent::Count);
+	put(&version, 1);
+	put(&cores, 1);
+	put(&records, 2);
+	put(&now, 8);
+	put(&events, 1);
+	for (uint8_t e = 0; e < events; ++e) {
+		hdr += Trace::name(static_cast<TraceEvent>(e));
+		hdr += '\0';
+	}
+
+	// lanes - own tasks & the httpd task
+	std::string tasks;
+	uint8_t taskCount = 0;
+	auto addTask = [&tasks, &taskCount](TaskHandle_t handle) {
+		uint32_t h = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(handle));
+		tasks.append(reinterpret_cast<const char *>(&h), 4);
+		tasks += pcTaskGetName(handle);
+		tasks += '\0';
+		taskCount++;
+	};
+	Application::getInstance()->forEachTask([&addTask](RPTask &task) {
+		addTask(task.task());
+	});
+	addTask(xTaskGetCurrentTaskHandle());
+	put(&taskCount, 1);
+	hdr += tasks;
+
+	httpd_resp_set_type(req, "application/octet-stream");
+	httpd_resp_send_chunk(req, hdr.data(), hdr.size());
+	for (size_t core = 0; core < portNUM_PROCESSORS; ++core) {
+		const uint32_t head = Trace::head(core);
+		httpd_resp_send_chunk(req, reinterpret_cast<const char *>(&head), sizeof(head));
+		httpd_resp_send_chunk(req, reinterpret_cast<const char *>(Trace::ring(core)), sizeof(TraceRecord) * Trace::_records);
+	}
+	httpd_resp_send_chunk(req, nullptr, 0);
+
+	Trace::enable(wasEnabled);
+	return ESP_OK;
+}
+
+/// @brief Render /debug/boot JSON
+/// @return JSON, phases reached so far in order of time
+static std::string bootJson()
+{
+	std::string rc;
+	cJSON *root = cJSON_CreateObject();
+	if (root) 
+	{
+		std::array<BootPhase, static_cast<size_t>(BootPhase::Count)> order;
+		for (size_t i = 0; i < order.size(); ++i) {
+			order[i] = static_cast<BootPhase>(i);
+		}
+		std::stable_sort(order.begin(), order.end(), [](BootPhase a, BootPhase b) {
+			return BootPhases::get(a) < BootPhases::get(b);
+		});
+
+		cJSON *phases = cJSON_AddArrayToObject(root, "phases");
+		for (auto p : order) {
+			const int64_t us = BootPhases::get(p);
+			if (us == 0) {
+				continue;
+			}
+			cJSON *item = cJSON_CreateObject();
+			cJSON_AddStringToObject(item, "phase", BootPhases::name(p));
+			cJSON_AddNumberToObject(item, "ms", us / 1000.0);
+			cJSON_AddItemToArray(phases, item);
+		}
+
+		// power-on to 2.4 GHz link ready, the button works from here
+		const int64_t rf = BootPhases::get(BootPhase::RfReady);
+		cJSON_AddNumberToObject(root, "rf_budget_ms", BootPhases::_rfBudgetMs);
+		cJSON_AddBoolToObject(root, "rf_within_budget", rf != 0 && rf <= static_cast<int64_t>(BootPhases::_rfBudgetMs) * 1000);
+
+		char *json_string = cJSON_PrintUnformatted(root);
+		if (json_string != nullptr) {
+			rc = json_string;
+			free(json_string);
+		}
+		cJSON_Delete(root);
+	}
+	return rc;
+}
+
+/// @brief Send asset from the archive, no copy
+/// @param req request
+/// @param path asset path
+/// @return ESP_OK
+static esp_err_t sendAsset(httpd_req_t *req, const char *path)
+{
+	Asset asset{};
+	if (!AssetStore::getInstance().find(path, asset)) {
+		httpd_resp_send_404(req);
+		return ESP_OK;
+	}
+	httpd_resp_set_type(req, asset.mime);
+	httpd_resp_send(req, asset.data, asset.size);
+	return ESP_OK;
+}
+
+/// @brief Render the AP list of the setting page
+/// @param scanner scan results
+/// @return <li> items, strongest first
+static std::string apListHtml(const WiFiScanner &scanner)
+{
+	std::string rc;
+	scanner.forEach([&rc](const APInfo &ap) {
+		rc += "<li><pre>";
+		// SSID is any 32 bytes
+		for (const char *c = ap.ap_name; *c; ++c) {
+			switch (*c) {
+				case '<': rc += "&lt;"; break;
+				case '>': rc += "&gt;"; break;
+				case '&': rc += "&amp;"; break;
+				default: rc += *c; break;
+			}
+		}
+		rc += "  RSSI: ";
+		rc += std::to_string(ap.rssi);
+		rc += "</pre></li>";
+	});
+	return rc;
+}
+
+/// @brief Render /scan JSON
+/// @param scanner scan results
+/// @return JSON, version changes with the results
+static std::string apListJson(const WiFiScanner &scanner)
+{
+	std::string rc;
+	cJSON *root = cJSON_CreateObject();
+	if (root) 
+	{
+		cJSON_AddNumberToObject(root, "version", scanner.version());
+		cJSON *aps = cJSON_AddArrayToObject(root, "aps");
+		scanner.forEach([aps](const APInfo &ap) {
+			cJSON *item = cJSON_CreateObject();
+			cJSON_AddStringToObject(item, "ssid", ap.ap_name);
+			cJSON_AddNumberToObject(item, "rssi", ap.rssi);
+			cJSON_AddItemToArray(aps, item);
+		});
+
+		char *json_string = cJSON_PrintUnformatted(root);
+		if (json_string != nullptr) {
+			rc = json_string;
+			free(json_string);
+		}
+		cJSON_Delete(root);
+	}
+	return rc;
+}
+
+/// @brief Stream /history JSON - state changes & per lamp totals, chunked
+///
+/// Query: from, to - time range [s], lamp - hex ID. Records are read from flash in
+/// small batches, the response is never held in RAM as a whole.
+/// @param req request
+/// @return ESP_OK
+static esp_err_t historyDump(httpd_req_t *req)
+{
+	uint32_t from = 0;
+	uint32_t to = UINT32_MAX;
+	bool byLamp = false;
+	std::array<uint8_t, 7> lampId{};
+
+	char query[96] = {0};
+	char param[24] = {0};
+	if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+		if (httpd_query_key_value(query, "from", param, sizeof(param)) == ESP_OK) {
+			from = strtoul(param, nullptr, 10);
+		}
+		if (httpd_query_key_value(query, "to", param, sizeof(param)) == ESP_OK) {
+			to = strtoul(param, nullptr, 10);
+		}
+		if (httpd_query_key_value(query, "lamp", param, sizeof(param)) == ESP_OK) {
+			lampId = lamp::Packet::stringToID(param);
+			byLamp = true;
+		}
+	}
+
+	/// on time & changes of a lamp
+	struct Totals {
+		std::array<uint8_t, 7> id;
+		uint32_t changes;
+		uint32_t onSeconds;
+		uint32_t onSince;
+		uint8_t flags;			///< clock of onSince
+		bool on;
+	};
+	std::array<Totals, 8> lamps{};
+	size_t lampCount = 0;
+
+	auto account = [&lamps, &lampCount](const HistoryRecord &rec) {
+		auto it = std::find_if(lamps.begin(), lamps.begin() + lampCount, [&rec](const Totals &t) { return t.id == rec.id; });
+		if (it == lamps.begin() + lampCount) {
+			if (lampCount == lamps.size()) {
+				return;
+			}
+			*it = Totals{rec.id, 0, 0, 0, 0, false};
+			lampCount++;
+		}
+		it->changes++;
+		// uptime & unix time can't be mixed, a reboot ends the interval
+		if (it->on && it->flags == rec.flags && rec.time >= it->onSince) {
+			it->onSeconds += rec.time - it->onSince;
+		}
+		it->on = rec.command == static_cast<uint8_t>(lamp::Packet::Command::On);
+		it->onSince = rec.time;
+		it->flags = rec.flags;
+	};
+
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send_chunk(req, "{\"records\":[", HTTPD_RESP_USE_STRLEN);
+
+	HistoryLog &log = HistoryLog::getInstance();
+	HistoryLog::Cursor cur;
+	std::array<HistoryRecord, 16> batch;
+	std::string chunk;
+	char line[128];
+	bool first = true;
+	size_t n = 0;
+	while ((n = log.read(cur, from, to, batch.data(), batch.size())) > 0) {
+		chunk.clear();
+		for (size_t i = 0; i < n; ++i) {
+			const auto &rec = batch[i];
+			if (byLamp && rec.id != lampId) {
+				continue;
+			}
+			account(rec);
+			snprintf(line, sizeof(line), "%s{\"t\":%u,\"clock\":%u,\"id\":\"%s\",\"cmd\":%u,\"intensity\":%u,\"hue\":%u}",
+					 first ? "" : ",", static_cast<unsigned>(rec.time), static_cast<unsigned>(rec.flags & HistoryRecord::Clock),
+					 lamp::Packet::arrayToString(rec.id).c_str(), rec.command, rec.intensity, rec.hue);
+			chunk += line;
+			first = false;
+		}
+		if (!chunk.empty() && httpd_resp_send_chunk(req, chunk.data(), chunk.size()) != ESP_OK) {
+			// client gone
+			return ESP_FAIL;
+		}
+	}
+
+	chunk = "],\"lamps\":[";
+	for (size_t i = 0; i < lampCount; ++i) {
+		const auto &t = lamps[i];
+		snprintf(line, sizeof(line), "%s{\"id\":\"%s\",\"changes\":%u,\"on_s\":%u,\"on\":%s}", i ? "," : "",
+				 lamp::Packet::arrayToString(t.id).c_str(), static_cast<unsigned>(t.changes),
+				 static_cast<unsigned>(t.onSeconds), t.on ? "true" : "false");
+		chunk += line;
+	}
+	chunk += "]}";
+	httpd_resp_send_chunk(req, chunk.data(), chunk.size());
+	httpd_resp_send_chunk(req, nullptr, 0);
+	return ESP_OK;
+}
+
+/// @brief Render /debug/tasks JSON
+/// @param profiler CPU usage sampler
+/// @return JSON
+template <typename Profiler>
+static std::string tasksJson(Profiler &profiler)
+{
+	static const char *states[] = {"running", "ready", "blocked", "suspended", "deleted", "invalid"};
+
+	std::string rc;
+	cJSON *root = cJSON_CreateObject();
+	if (root) 
+	{
+		cJSON *tasks = cJSON_AddArrayToObject(root, "tasks");
+		auto window = profiler.report([tasks](const typename Profiler::Row &row) {
+			cJSON *item = cJSON_CreateObject();
+			cJSON_AddStringToObject(item, "name", row.name);
+			cJSON_AddNumberToObject(item, "core", row.core == tskNO_AFFINITY ? -1 : row.core);
+			cJSON_AddNumberToObject(item, "priority", row.priority);
+			cJSON_AddStringToObject(item, "state", row.state <= eInvalid ? states[row.state] : "?");
+			cJSON_AddNumberToObject(item, "cpu", row.cpuPermille / 10.0);
+			cJSON_AddNumberToObject(item, "stack_free", row.stackFree);
+
+			// own tasks - configured & suggested stack size
+			Application::getInstance()->forEachTask([item, &row](RPTask &task) {
+				if (task.task() == row.handle) {
+					cJSON_AddNumberToObject(item, "stack", task.stackDepth());
+					cJSON_AddNumberToObject(item, "stack_suggested", Profiler::suggestStack(task.stackDepth(), row.stackFree));
+				}
+			});
+			cJSON_AddItemToArray(tasks, item);
+		});
+		cJSON_AddNumberToObject(root, "window_ms", window / 1000);
+
+		char *json_string = cJSON_PrintUnformatted(root);
+		if (json_string != nullptr) {
+			rc = json_string;
+			free(json_string);
+		}
+		cJSON_Delete(root);
+	}
+	return rc;
+}
+
+WebTask::WebTask() : Reactor(4)
+{
+	listen(_modes.handle());
+	listen(_state.handle());
+	_parked = _parkedMem.create();
+	listen(_parked);
 }
 
 WebTask::~WebTask()
 {
 	done();
-	if (_queue)
-		vQueueDelete(_queue);
-	if (_queueAP)
-		vQueueDelete(_queueAP);
-	if (_queueLcs) 
-	   vQueueDelete(_queueLcs);
 }
 
 void WebTask::loop()
 {
 
-	APInfo apinf = {
-		.ap_name = "",
-		.rssi = 0
-	};
 	HttpServer server;
-	std::string apinfo;
+	server.setTask(task_config::httpd.priority, task_config::httpd.core, task_config::httpd.stack);
 
-	LCSInfo lcs {
-		.hue = 0,
-		.intensity = 0,
+	LampState lcs {
+		.id = {},
 		.command = static_cast<uint8_t>(lamp::Packet::Command::Unknown),
-		.id = {'\0'} 
+		.intensity = 0,
+		.hue = 0
+	};
+	uint32_t version = 1;		///< incremented on every lcs change
+	std::mutex lcsLock;			///< lcs & version shared with httpd task
+	LongPoll<_pollSlots> poll;	///< parked /values requests
+	TickType_t lastProfile = 0;	///< last CPU usage sample
+	QueueHandle_t parkedQueue = _parked;	///< posted by the httpd task after park
+
+	// timer - nearest long-poll timeout or the next CPU usage sample, nothing else wakes the task
+	auto schedule = [&]() {
+		const TickType_t sinceProfile = xTaskGetTickCount() - lastProfile;
+		uint32_t ms = sinceProfile < pdMS_TO_TICKS(_profileTick) ? (pdMS_TO_TICKS(_profileTick) - sinceProfile) * portTICK_PERIOD_MS : 0;
+		int64_t deadlineUs = 0;
+		if (poll.deadline(deadlineUs)) {
+			const int64_t left = deadlineUs - esp_timer_get_time();
+			ms = std::min<uint32_t>(ms, left > 0 ? static_cast<uint32_t>((left + 999) / 1000) : 0);
+		}
+		// round up to whole ticks, an early wake-up would only re-arm
+		armTimer(ms + portTICK_PERIOD_MS - 1);
+	};
+
+	auto render = [&lcs, &version, &lcsLock]() -> std::string {
+		std::lock_guard<std::mutex> lock(lcsLock);
+		return valuesJson(lcs, version);
 	};
 
 
-	while (true)
-	{ // Loop forever
-		
-		// AP info update - used only in registration
-		auto resap = xQueueReceive(_queueAP, (void *)&apinf, 0);
-		if (resap == pdTRUE)
-		{  
-			apinfo += "<li><pre>";
-			apinfo += apinf.ap_name;
-			apinfo += "  RSSI: ";
-			apinfo += std::to_string(apinf.rssi);
-			apinfo += "</pre></li>";
+	// mode switch
+	on<Mode>(_modes.handle(), [&](const Mode &mode)
+	{
+		// parked requests must be answered before the server stops
+		poll.notify(render);
+
+		if (mode == Mode::Unknown)
+		{
+			server.stop();
 		}
-		
-		// form LCS update
-		xQueueReceive(_queueLcs, (void *)&lcs, 0);
-		
-		int receivedMode;
-		auto res = xQueueReceive(_queue, (void *)&receivedMode, 0);
-		if (res == pdTRUE)
+		else if (mode == Mode::Control)
 		{
-			Mode mode = static_cast<Mode>(receivedMode);
-			if (mode == Mode::Unknown)
-			{
-				server.stop();
-			}
-			else if (mode == Mode::Control)
-			{
-				server.stop();
-				server.start();
-				server.registerUriHandler("/", HTTP_GET, [&apinfo](httpd_req_t *req) -> esp_err_t
-										  {
-					ConentFile ap1cntb(literals::kv_fl_index);
+			server.stop();
+			// no LRU purge - it would close parked long-poll sockets first
+			server.setMaxOpenSockets(_maxOpenSockets, false);
+			server.setRetryAfter([]() -> uint32_t {
+				return Application::getInstance()->getLcsTask()->retryAfter();
+			});
+			server.start();
+			server.registerUriHandler("/", HTTP_GET, [](httpd_req_t *req) -> esp_err_t {
+				return sendAsset(req, literals::kv_fl_index);
+			});
+
+			server.registerUriHandler("/style.css", HTTP_GET, [](httpd_req_t *req) -> esp_err_t {
+				return sendAsset(req, literals::kv_fl_style);
+			});
+
+			// Slider movement - send to LCS
+			server.registerUriHandler("/slider", HTTP_POST, [&lcs, &lcsLock, &server](httpd_req_t *req) -> esp_err_t {
+				const LCSOrigin origin{LCSSource::Web, esp_timer_get_time()};
+				char content[300] = {0}; 
 				
-    				auto cnt =  ap1cntb.readContnet();
- 					httpd_resp_send(req, cnt.c_str(), cnt.length());
-                    return ESP_OK; });
-
-				server.registerUriHandler("/style.css", HTTP_GET, [](httpd_req_t *req) -> esp_err_t
-										  {
-					 httpd_resp_set_type(req, "text/css");
-					 ConentFile ap1cnt(literals::kv_fl_style);
-    				 auto contnet = ap1cnt.readContnet();
-                    httpd_resp_send(req, contnet.c_str(), contnet.length());
-                    return ESP_OK; });
-
-				// Slider movement - send to LCS
-				server.registerUriHandler("/slider", HTTP_POST, [&lcs](httpd_req_t *req) -> esp_err_t {
-					char content[300] = {0}; 
+				int received = httpd_req_recv(req, content, sizeof(content) - 1);
+				if (received <= 0) { 
+					if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+						httpd_resp_send_408(req);
+					}
+					return ESP_FAIL;
+				}
+
+				// processign JSON from page
+				cJSON *json = cJSON_Parse(content);
+				bool accepted = true;
+
+				if (json == nullptr) {
+					// invalid JSON 
+					// TODO
+				} else {
+					//values
+					// {slider: "brightness", value: "28"}
+					// {slider: "hue", value: "28"}
+					cJSON *slider = cJSON_GetObjectItem(json, "slider");
+					cJSON *valueItem = cJSON_GetObjectItem(json, "value");
+					if (slider && valueItem && cJSON_IsString(slider)&& cJSON_IsString(valueItem)) {
+						
+						uint8_t value = (uint8_t)atoi(valueItem->valuestring);
+
+						if (strcmp(slider->valuestring, "brightness") == 0 && cJSON_IsString(valueItem)) {	
+							std::lock_guard<std::mutex> lock(lcsLock);
+							lcs.intensity = value;
+							accepted = Application::getInstance()->getLcsTask()->intensity(value, origin);
+						} else if (strcmp(slider->valuestring, "hue") == 0) {
+							std::lock_guard<std::mutex> lock(lcsLock);
+							lcs.hue = value;
+							accepted = Application::getInstance()->getLcsTask()->hue(value, origin);
+						}
+					}
 					
-					int received = httpd_req_recv(req, content, sizeof(content) - 1);
-					if (received <= 0) { 
-						if (received == HTTPD_SOCK_ERR_TIMEOUT) {
-							httpd_resp_send_408(req);
+					cJSON_Delete(json);
+				}
+
+				if (!accepted) {
+					// LCS queue is full - back-pressure
+					return server.sendTooManyRequests(req);
+				}
+
+				httpd_resp_send(req, "", 0);
+
+				return ESP_OK; 
+			}, true);
+
+			// get info - slieders & status - repeated query about slider position
+			// /values?since=<version>&timeout=<ms> waits until the version is newer than since
+			server.registerUriHandler("/values", HTTP_GET, [&render, &poll, &version, &lcsLock, parkedQueue](httpd_req_t *req) -> esp_err_t
+				 {
+					char query[64] = {0};
+					char param[16] = {0};
+					bool longPoll = false;
+					uint32_t since = 0;
+					uint32_t timeout = _pollTimeoutMs;
+
+					if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+						if (httpd_query_key_value(query, "since", param, sizeof(param)) == ESP_OK) {
+							since = strtoul(param, nullptr, 10);
+							longPoll = true;
+						}
+						if (httpd_query_key_value(query, "timeout", param, sizeof(param)) == ESP_OK) {
+							timeout = std::min<uint32_t>(strtoul(param, nullptr, 10), _pollTimeoutMs);
 						}
-						return ESP_FAIL;
 					}
 
-					// processign JSON from page
-					cJSON *json = cJSON_Parse(content);
-
-					if (json == nullptr) {
-						// invalid JSON 
-						// TODO
-					} else {
-						//values
-						// {slider: "brightness", value: "28"}
-						// {slider: "hue", value: "28"}
-						cJSON *slider = cJSON_GetObjectItem(json, "slider");
-						cJSON *valueItem = cJSON_GetObjectItem(json, "value");
-						if (slider && valueItem && cJSON_IsString(slider)&& cJSON_IsString(valueItem)) {
-							
-							uint8_t value = (uint8_t)atoi(valueItem->valuestring);
-
-							if (strcmp(slider->valuestring, "brightness") == 0 && cJSON_IsString(valueItem)) {	
-								lcs.intensity = value;
-								Application::getInstance()->getLcsTask()->intensity(value);
-							} else if (strcmp(slider->valuestring, "hue") == 0) {
-								lcs.hue = value;
-								Application::getInstance()->getLcsTask()->hue(value);
-							}
+					if (longPoll && timeout > 0) {
+						bool parked = poll.park(req, timeout, [&]() {
+							std::lock_guard<std::mutex> lock(lcsLock);
+							return version != since;
+						});
+						if (parked) {
+							// answered by the web task on change or timeout, its timer follows the new deadline
+							const uint8_t wake = 1;
+							xQueueOverwrite(parkedQueue, &wake);
+							return ESP_OK;
 						}
-						
-						cJSON_Delete(json);
 					}
 
-					httpd_resp_send(req, "", 0);
-
-					return ESP_OK; 
-				});
-
-				// get info - slieders & status - repeated query about slider position
-				server.registerUriHandler("/values", HTTP_GET, [&apinfo, &lcs](httpd_req_t *req) -> esp_err_t
-					 {
-
-						cJSON *root = cJSON_CreateObject();
-						if (root) 
-						{
-							if (lcs.command == static_cast<uint8_t>(lamp::Packet::Command::Unknown)) {
-								// unknown values
-								cJSON_AddNumberToObject(root, "brightness", 0); 
-								cJSON_AddNumberToObject(root, "hue", 0);
-								cJSON_AddStringToObject(root, "id", "???");  
-							} else if (lcs.command == static_cast<uint8_t>(lamp::Packet::Command::Startup)) {
-								// TODO: known ID but unknown intensity & hue
-								cJSON_AddNumberToObject(root, "brightness",lcs.intensity); 
-								cJSON_AddNumberToObject(root, "hue", lcs.hue);  
-								cJSON_AddStringToObject(root, "id", lcs.id);  
-								//lcs.command =  static_cast<uint8_t>(lamp::Packet::Command::On);
-							} else {
-								cJSON_AddNumberToObject(root, "brightness", lcs.intensity); 
-								cJSON_AddNumberToObject(root, "hue", lcs.hue);  
-								cJSON_AddStringToObject(root, "id", lcs.id);  
-							}
-							
-							httpd_resp_set_type(req, "application/json");
-
-							char *json_string = cJSON_Print(root);
-							if (json_string != nullptr) {
-							httpd_resp_send(req, json_string, strlen(json_string));
-							}
-
-							cJSON_Delete(root);
-							if (json_string) free(json_string);
-						}
-								
+					auto json = render();
+					httpd_resp_set_type(req, "application/json");
+					httpd_resp_send(req, json.c_str(), json.length());
                     return ESP_OK; });
 
-				// commands - send to LCS
-				server.registerUriHandler("/command", HTTP_POST, [&lcs](httpd_req_t *req) -> esp_err_t {
-					char content[300] = {0}; 
-					int received = httpd_req_recv(req, content, sizeof(content) - 1);
-					if (received <= 0) { 
-						if (received == HTTPD_SOCK_ERR_TIMEOUT) {
-							httpd_resp_send_408(req);
-						}
-						return ESP_FAIL;
+			// commands - send to LCS
+			server.registerUriHandler("/command", HTTP_POST, [&lcs, &lcsLock, &version, &server, &poll, &render](httpd_req_t *req) -> esp_err_t {
+				const LCSOrigin origin{LCSSource::Web, esp_timer_get_time()};
+				char content[300] = {0}; 
+				int received = httpd_req_recv(req, content, sizeof(content) - 1);
+				if (received <= 0) { 
+					if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+						httpd_resp_send_408(req);
 					}
-
-					// processign JSON from page
-					cJSON *json = cJSON_Parse(content);
-
-					if (json == nullptr) {
-						// invalid JSON 
-						// TODO
-					} else {
-						//values
-						// {command: "ON", brightness: "20", hue: "50"}
-						// {command: "OFF", brightness: "20", hue: "50"}
-						// {command: "RECONFIG", brightness: "20", hue: "50"}
-						cJSON *command = cJSON_GetObjectItem(json, "command");
-						if (command) {
-							if (strcmp(command->valuestring, "ON") == 0) {
-								Application::getInstance()->getLcsTask()->command(LC12STask::Command::on);
-							} else if (strcmp(command->valuestring, "OFF") == 0) {
-								Application::getInstance()->getLcsTask()->command(LC12STask::Command::off);
-							} if (strcmp(command->valuestring, "RECONFIG") == 0) {
-								Application::getInstance()->getLcsTask()->command(LC12STask::Command::learn);
+					return ESP_FAIL;
+				}
+
+				// processign JSON from page
+				cJSON *json = cJSON_Parse(content);
+				bool accepted = true;
+
+				if (json == nullptr) {
+					// invalid JSON 
+					// TODO
+				} else {
+					//values
+					// {command: "ON", brightness: "20", hue: "50"}
+					// {command: "OFF", brightness: "20", hue: "50"}
+					// {command: "RECONFIG", brightness: "20", hue: "50"}
+					cJSON *command = cJSON_GetObjectItem(json, "command");
+					if (command) {
+						if (strcmp(command->valuestring, "ON") == 0) {
+							accepted = Application::getInstance()->getLcsTask()->command(LC12STask::Command::on, origin);
+						} else if (strcmp(command->valuestring, "OFF") == 0) {
+							accepted = Application::getInstance()->getLcsTask()->command(LC12STask::Command::off, origin);
+						} else if (strcmp(command->valuestring, "RECONFIG") == 0) {
+							accepted = Application::getInstance()->getLcsTask()->command(LC12STask::Command::learn, origin);
+							{
+								std::lock_guard<std::mutex> lock(lcsLock);
 								lcs.command = static_cast<uint8_t>(lamp::Packet::Command::Unknown);
+								version++;
 							}
+							// parked clients see the learn state at once, same as an LCS update
+							poll.notify(render);
 						}
-						cJSON_Delete(json);
 					}
+					cJSON_Delete(json);
+				}
+
+				if (!accepted) {
+					// LCS queue is full - back-pressure
+					return server.sendTooManyRequests(req);
+				}
+
+				httpd_resp_send(req, "", 0);
+				return ESP_OK; 
+			}, true);
+
+			
+			// DMX mapping "<universe>/<duty %>/<lamp id>:<intensity ch>:<hue ch>,..."
+			server.registerUriHandler("/dmx", HTTP_POST, [](httpd_req_t *req) -> esp_err_t {
+				char content[300] = {0}; 
+				int received = httpd_req_recv(req, content, sizeof(content) - 1);
+				if (received < 0) { 
+					if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+						httpd_resp_send_408(req);
+					}
+					return ESP_FAIL;
+				}
 
+				Config::getInstance().update([&content](ConfigRecord &c) {
+					Config::setString(c.dmx, content);
+				});
+				Application::getInstance()->getDmxTask()->reload();
+
+				httpd_resp_send(req, "", 0);
+				return ESP_OK; 
+			});
+
+			// command latency in us (bucket upper bound), /debug/latency?reset=1 clears the statistics
+			server.registerUriHandler("/debug/latency", HTTP_GET, [](httpd_req_t *req) -> esp_err_t {
+				auto &stats = Application::getInstance()->getLcsTask()->latency();
+				auto json = latencyJson(stats);
+
+				char query[32] = {0};
+				char param[8] = {0};
+				if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+					httpd_query_key_value(query, "reset", param, sizeof(param)) == ESP_OK && strcmp(param, "1") == 0) {
+					stats.reset();
+				}
+
+				httpd_resp_set_type(req, "application/json");
+				httpd_resp_send(req, json.c_str(), json.length());
+				return ESP_OK;
+			});
+
+			// trace - /debug/trace?enable=1 starts (and clears), ?enable=0 stops, no query downloads the buffer
+			server.registerUriHandler("/debug/trace", HTTP_GET, [](httpd_req_t *req) -> esp_err_t {
+				char query[32] = {0};
+				char param[8] = {0};
+				if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+					httpd_query_key_value(query, "enable", param, sizeof(param)) == ESP_OK) {
+					bool on = strcmp(param, "1") == 0;
+					if (on) {
+						Trace::clear();
+					}
+					Trace::enable(on);
 					httpd_resp_send(req, "", 0);
-					return ESP_OK; 
+					return ESP_OK;
+				}
+				return traceDump(req);
+			});
+
+			// tasks - CPU % (100 - one core) over the sampling window, stack high water mark
+			server.registerUriHandler("/debug/tasks", HTTP_GET, [this](httpd_req_t *req) -> esp_err_t {
+				auto json = tasksJson(_profiler);
+				httpd_resp_set_type(req, "application/json");
+				httpd_resp_send(req, json.c_str(), json.length());
+				return ESP_OK;
+			});
+
+			// boot phases - time since boot, 2.4 GHz link budget
+			server.registerUriHandler("/debug/boot", HTTP_GET, [](httpd_req_t *req) -> esp_err_t {
+				auto json = bootJson();
+				httpd_resp_set_type(req, "application/json");
+				httpd_resp_send(req, json.c_str(), json.length());
+				return ESP_OK;
+			});
+
+			// lamp history - /history?from=<unix s>&to=<unix s>&lamp=<hex id>, all parameters optional
+			server.registerUriHandler("/history", HTTP_GET, [](httpd_req_t *req) -> esp_err_t {
+				return historyDump(req);
+			});
+
+			// Prometheus scrape
+			server.registerUriHandler("/metrics", HTTP_GET, [&server](httpd_req_t *req) -> esp_err_t {
+				auto text = metricsText(server);
+				httpd_resp_set_type(req, "text/plain; version=0.0.4");
+				httpd_resp_send(req, text.c_str(), text.size());
+				return ESP_OK;
+			});
+		}
+		else if (mode == Mode::Setting)
+		{
+			server.stop();
+			server.start();
+
+			// AP main page
+			server.registerUriHandler("/", HTTP_GET, [](httpd_req_t *req) -> esp_err_t
+									  {
+				// page head & tail straight from flash, APs found so far between them
+				Asset beg{}, end{};
+				AssetStore &assets = AssetStore::getInstance();
+				if (!assets.find(literals::kv_fl_apb, beg) || !assets.find(literals::kv_fl_ape, end)) {
+					httpd_resp_send_404(req);
+					return ESP_OK;
+				}
+				httpd_resp_set_type(req, beg.mime);
+				httpd_resp_send_chunk(req, beg.data, beg.size);
+				auto apinfo = apListHtml(Application::getInstance()->getWifiTask()->scanner());
+				if (!apinfo.empty()) {
+					// an empty chunk ends the response
+					httpd_resp_send_chunk(req, apinfo.data(), apinfo.size());
+				}
+				httpd_resp_send_chunk(req, end.data, end.size);
+				httpd_resp_send_chunk(req, nullptr, 0);
+				return ESP_OK; });
+
+			server.registerUriHandler("/style.css", HTTP_GET, [](httpd_req_t *req) -> esp_err_t {
+				return sendAsset(req, literals::kv_fl_style);
+			});
+
+			// scan results, polled by the page while the scan continues
+			server.registerUriHandler("/scan", HTTP_GET, [](httpd_req_t *req) -> esp_err_t {
+				auto json = apListJson(Application::getInstance()->getWifiTask()->scanner());
+				httpd_resp_set_type(req, "application/json");
+				httpd_resp_send(req, json.c_str(), json.length());
+				return ESP_OK;
+			});
+
+			// AP setting answer
+			server.registerUriHandler("/", HTTP_POST, [](httpd_req_t *req) -> esp_err_t {
+				char content[768] = {0}; 
+				int received = httpd_req_recv(req, content, sizeof(content) - 1);
+				if (received <= 0) { 
+					if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+						httpd_resp_send_408(req);
+					}
+					return ESP_FAIL;
+				}
+
+				// parse response & store configuration
+				std::map<std::string, std::string> formData = HttpReqest::parseFormData(std::string(content));
+				Config::getInstance().update([&formData](ConfigRecord &c) {
+					Config::setString(c.ssid, HttpReqest::getValue(formData, literals::kv_ssid));
+					Config::setString(c.pass, HttpReqest::getValue(formData, literals::kv_passwd));
+					c.ip = Config::parseIp(HttpReqest::getValue(formData, literals::kv_ip));
+					c.gw = Config::parseIp(HttpReqest::getValue(formData, literals::kv_gtw));
+					c.mask = Config::parseIp(HttpReqest::getValue(formData, literals::kv_mask));
+					Config::setString(c.mqtt, HttpReqest::getValue(formData, literals::kv_mqtt));
+					Config::setString(c.backup[0].ssid, HttpReqest::getValue(formData, literals::kv_ssid2));
+					Config::setString(c.backup[0].pass, HttpReqest::getValue(formData, literals::kv_passwd2));
+					Config::setString(c.backup[1].ssid, HttpReqest::getValue(formData, literals::kv_ssid3));
+					Config::setString(c.backup[1].pass, HttpReqest::getValue(formData, literals::kv_passwd3));
 				});
-
+				// configuration must survive a power cycle right after the dialog
+				KeyVal::getInstance().flush();
+				// broker may have changed, the client restarts without reboot
+				Application::getInstance()->getMqttTask()->reload();
 				
-			}
-			else if (mode == Mode::Setting)
-			{
-				server.stop();
-				server.start();
-
-				// AP main page
-				server.registerUriHandler("/", HTTP_GET, [&apinfo](httpd_req_t *req) -> esp_err_t
-										  {
-					ConentFile ap1cntb(literals::kv_fl_apb);
-					ConentFile ap1cnte(literals::kv_fl_ape);
-    				 auto contnetb = ap1cntb.readContnet();
-                    contnetb += apinfo;
-					contnetb += ap1cnte.readContnet();
- 					httpd_resp_send(req, contnetb.c_str(), contnetb.length());
-                    return ESP_OK; });
-
-				server.registerUriHandler("/style.css", HTTP_GET, [](httpd_req_t *req) -> esp_err_t
-										  {
-					 httpd_resp_set_type(req, "text/css");
-					 ConentFile ap1cnt(literals::kv_fl_style);
-    				 auto contnet = ap1cnt.readContnet();
-                    httpd_resp_send(req, contnet.c_str(), contnet.length());
-                   
-                    return ESP_OK; });
-
-				// AP setting answer
-				server.registerUriHandler("/", HTTP_POST, [](httpd_req_t *req) -> esp_err_t {
-					char content[300] = {0}; 
-					int received = httpd_req_recv(req, content, sizeof(content) - 1);
-					if (received <= 0) { 
-						if (received == HTTPD_SOCK_ERR_TIMEOUT) {
-							httpd_resp_send_408(req);
-						}
-						return ESP_FAIL;
-					}
-
-					// parse response & store configuration
-					std::map<std::string, std::string> formData = HttpReqest::parseFormData(std::string(content));
-					KeyVal& kv = KeyVal::getInstance();
-					
-					kv.writeString(literals::kv_ssid, HttpReqest::getValue(formData, literals::kv_ssid).c_str());
-					kv.writeString(literals::kv_passwd, HttpReqest::getValue(formData, literals::kv_passwd).c_str());
-					kv.writeString(literals::kv_ip, HttpReqest::getValue(formData, literals::kv_ip).c_str());
-					kv.writeString(literals::kv_gtw, HttpReqest::getValue(formData, literals::kv_gtw).c_str());
-					kv.writeString(literals::kv_mask, HttpReqest::getValue(formData, literals::kv_mask).c_str());
-					
-					
-					// switch to Stop mode & check configuration
-					Application::getInstance()->getWifiTask()->switchMode(WifiTask::Mode::Stop);
-
-					// Response & swith mode 
-					ConentFile respContnetDialog(literals::kv_fl_finish);
-    				auto finish = respContnetDialog.readContnet();
-					httpd_resp_send(req, finish.c_str(), finish.length());
+				
+				// switch to Stop mode & check configuration
+				Bus<WifiMode>::publish(WifiMode::Stop);
 
-					return ESP_OK; 
-				});
-			}
+				// Response & swith mode 
+				return sendAsset(req, literals::kv_fl_finish);
+			});
 		}
+	});
 
-		vTaskDelay(500 / portTICK_PERIOD_MS);
-	}
-}
+	// LCS update - parked long-poll requests are answered immediately
+	on<LampState>(_state.handle(), [&](const LampState &update)
+	{
+		{
+			std::lock_guard<std::mutex> lock(lcsLock);
+			lcs = update;
+			version++;
+		}
+		poll.notify(render);
+		schedule();
+	});
 
-void WebTask::apInfo(const APInfo &ap)
-{
-	if (_queueAP)
+	// request parked by the httpd task - its timeout may be the nearest one
+	on<uint8_t>(_parked, [&](const uint8_t &)
 	{
-		xQueueSendToBack(_queueAP, (void *)&ap, 0);
-	}
-}
+		schedule();
+	});
 
-void WebTask::command(Mode mode)
-{
-	if (_queue)
+	// long-poll timeouts & CPU usage sampling
+	onTimer([&]()
 	{
-		int modeToSend = static_cast<int>(mode);
-		xQueueSendToBack(_queue, (void *)&modeToSend, 0);
-	}
-}
+		poll.expire(render);
 
+		if (xTaskGetTickCount() - lastProfile >= pdMS_TO_TICKS(_profileTick)) {
+			lastProfile = xTaskGetTickCount();
+			_profiler.sample();
+		}
+		schedule();
+	});
+
+	schedule();
+	dispatch();
+}
 
-void  WebTask::lcsUpdate(const LCSInfo& lcs) 
-{
-	if (_queueLcs)
-	{
-		xQueueSendToBack(_queueLcs, (void *)&lcs, 0);
-	}
-}
\ No newline at end of file
@@ -8,33 +8,49 @@
 #pragma once
 
 #include "hardware.h"
-#include "rptask.h"
+#include "reactor.h"
 #include "access_point.h"
 #include "literals.h"
-#include "wifi_scanner.h"
 #include "lcs_info.h"
+#include "task_profiler.h"
+#include "bus.h"
 
+enum class WebMode {
+	Setting,     
+	Control, 	
+	Unknown
+};
+
+template <>
+struct Topic<WebMode> {
+	static constexpr const char *name = "web_mode";
+	static constexpr bool latest = false;
+	static constexpr size_t depth = 2;
+	static constexpr size_t subscribers = 1;
+};
 
-class WebTask : public RPTask
+class WebTask : public Reactor
 {
 public:
- enum class Mode {
-		ClearAPInfo,
-	    Setting,     
-        Control, 	
-        Unknown       };
+	using Mode = WebMode;
 
 	WebTask();
 	virtual ~WebTask();
-	void command(Mode mode);
-	void apInfo(const APInfo& ap);
-	void lcsUpdate(const LCSInfo& lcs);
 protected:
 	void loop() override;
 
 private:
+	static constexpr uint32_t _pollTimeoutMs{30000};	///< max. long-poll wait [ms]
+	static constexpr size_t _pollSlots{3};				///< parked long-poll requests
+	static constexpr uint16_t _maxOpenSockets{_pollSlots + 2};	///< parked requests + UI
+	static constexpr uint32_t _profileTick{1000};		///< CPU usage sampling [ms]
+
+	using Profiler = TaskProfiler<24, 10>;				///< tasks, 10 s window
+
 	Mode            _mode {Mode::Unknown};
-	QueueHandle_t 	_queue;
-	QueueHandle_t 	_queueAP;
-	QueueHandle_t 	_queueLcs;
+	Mailbox<WebMode> _modes;		///< mode switch requests
+	Mailbox<LampState> _state;		///< newest lamp state
+	QueueMemory<uint8_t, 1> _parkedMem;
+	QueueHandle_t	_parked{nullptr};	///< a long-poll request was parked - re-arm the timer
+	Profiler		_profiler;		///< per-task CPU usage
 };
@@ -9,6 +9,7 @@
 #pragma once
 
 #include <functional>
+#include <cstring>
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
@@ -80,16 +81,34 @@ public:
         return connect(ssid.c_str(), pass.c_str(), use_dhcp, static_ip);
     }
 
-    bool connect(const char *ssid, const char *pass, bool use_dhcp = true, esp_netif_ip_info_t *static_ip = nullptr)
+    /// @brief Connect to AP
+    /// @param ssid SSID
+    /// @param pass password
+    /// @param use_dhcp DHCP or static_ip
+    /// @param static_ip static IP
+    /// @param bssid known AP - directed connect on one channel, nullptr - scan
+    /// @param channel channel of bssid
+    /// @return true if started
+    bool connect(const char *ssid, const char *pass, bool use_dhcp = true, esp_netif_ip_info_t *static_ip = nullptr,
+                 const uint8_t *bssid = nullptr, uint8_t channel = 0)
     {
         // station mode
         ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
 
         // SSID nad password
-        wifi_config_t wifi_config = {};
-        strncpy((char *)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid));
-        strncpy((char *)wifi_config.sta.password, pass, sizeof(wifi_config.sta.password));
-        ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+        _config = {};
+        strncpy((char *)_config.sta.ssid, ssid, sizeof(_config.sta.ssid));
+        strncpy((char *)_config.sta.password, pass, sizeof(_config.sta.password));
+
+        // known AP skips the all-channel scan, a failure falls back to it (onDisconnect)
+        _directed = bssid != nullptr && channel != 0;
+        if (_directed)
+        {
+            memcpy(_config.sta.bssid, bssid, sizeof(_config.sta.bssid));
+            _config.sta.bssid_set = true;
+            _config.sta.channel = channel;
+        }
+        ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &_config));
 
         // sets DHCP or static IP
         if (!use_dhcp && static_ip != nullptr)
@@ -128,6 +147,9 @@ public:
             return false;
         }
 
+        // no fallback & no callback for a requested disconnect
+        _directed = false;
+        _requested = true;
         esp_err_t ret = esp_wifi_disconnect();
         if (ret != ESP_OK)
         {
@@ -153,8 +175,26 @@ public:
 
     void onDisconnect()
     {
+        if (_directed)
+        {
+            // cached AP moved or gone - forget it & scan all channels
+            _directed = false;
+            ESP_LOGW("WiFiClient", "directed connect failed, scanning");
+            _config.sta.bssid_set = false;
+            _config.sta.channel = 0;
+            if (esp_wifi_set_config(WIFI_IF_STA, &_config) == ESP_OK && esp_wifi_connect() == ESP_OK)
+            {
+                return;
+            }
+        }
+
         _isConnected = false;
         ESP_LOGI("WiFiClient", "Wi-Fi disconnected");
+        if (_requested)
+        {
+            _requested = false;
+            return;
+        }
         if (_disconnectedCallback)
         {
             _disconnectedCallback();
@@ -164,6 +204,8 @@ public:
     void onGotIP(const ip_event_got_ip_t &event)
     {
         _isConnected = true;
+        _directed = false;
+        _requested = false;
         char ipStr[16];
         esp_ip4addr_ntoa(&event.ip_info.ip, ipStr, sizeof(ipStr));
         ESP_LOGI("WiFiClient", "Got IP: %s", ipStr);
@@ -199,7 +241,10 @@ public:
 
 private:
     bool _isConnected;                                ///< connection state
+    bool _directed{false};                            ///< connecting to the cached BSSID
+    bool _requested{false};                           ///< disconnect() in progress
     esp_netif_t *_espNetif;                           ///<
+    wifi_config_t _config{};                          ///< STA configuration of the last connect
     WiFiConnectedCallback _connectedCallback{};       ///< connect callback
     WiFiDisconnectedCallback _disconnectedCallback{}; ///< disconnect callback
 };
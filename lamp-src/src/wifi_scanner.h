@@ -8,17 +8,20 @@
 #pragma once
 
 #include <string.h>
-#include <functional>
-#include "nvs_flash.h"
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <utility>
 #include "esp_wifi.h"
 #include "esp_log.h"
 #include "esp_event.h"
-#include "esp_netif.h"
+#include "esp_timer.h"
 /*
 
     WiFiScanner wifiScanner;
-    wifiScanner.scan();
-    wifiScanner.printScanResults();
+    wifiScanner.start();        // Wi-Fi runs in STA or APSTA mode
+    ...
+    wifiScanner.forEach([](const APInfo &ap) { printf("%s %d\n", ap.ap_name, ap.rssi); });
 
 */
 
@@ -27,89 +30,231 @@ struct APInfo{
     int8_t  rssi;     ///< Rssi
 };
 
-using ScanResultCallback = std::function<void(const APInfo&)>;
-
-
+/// @brief Asynchronous Wi-Fi scan, one channel at a time
+///
+/// Every channel is a separate non-blocking scan, WIFI_EVENT_SCAN_DONE merges its
+/// results and starts the next channel, so the AP keeps serving between them and
+/// the list grows while the scan continues. Results are kept in a bounded table,
+/// one entry per SSID with the best RSSI, sorted by RSSI. Rounds repeat after a
+/// pause until stop(). Handlers run in the event loop & esp_timer tasks.
 class WiFiScanner
 {
 public:
-    WiFiScanner()
+    static constexpr size_t _maxAPs{16};                ///< table size, weaker APs are dropped
+
+    WiFiScanner() = default;
+
+    ~WiFiScanner()
     {
+        stop();
+        if (_timer)
+        {
+            esp_timer_delete(_timer);
+        }
     }
 
-     /// @brief Initialize Wifi scanner
-    /// @param coreInit true if  WiFiClient used as standalone and needs to initialize NVS, Netinf, EventLoop
-    /// @return true if success
-    void init(bool coreInit = false)
+    WiFiScanner(const WiFiScanner &) = delete;
+    WiFiScanner &operator=(const WiFiScanner &) = delete;
+
+    /// @brief Clear results & start scan rounds, Wi-Fi must be started in STA or APSTA mode
+    /// @return true if started
+    bool start()
     {
-        if (coreInit)
+        stop();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _count = 0;
+            _version++;
+        }
+
+        if (!_timer)
         {
-            // initialize NVS
-            esp_err_t ret = nvs_flash_init();
-            if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
+            esp_timer_create_args_t args{};
+            args.callback = &WiFiScanner::onTimer;
+            args.arg = this;
+            args.dispatch_method = ESP_TIMER_TASK;
+            args.name = "scan";
+            if (esp_timer_create(&args, &_timer) != ESP_OK)
             {
-                ESP_ERROR_CHECK(nvs_flash_erase());
-                ret = nvs_flash_init();
+                ESP_LOGE("WiFiScanner", "timer failed");
+                return false;
             }
-            ESP_ERROR_CHECK(ret);
+        }
+        if (esp_event_handler_instance_register(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, &WiFiScanner::eventHandler, this, &_handler) != ESP_OK)
+        {
+            ESP_LOGE("WiFiScanner", "event handler failed");
+            return false;
+        }
 
-            esp_netif_init();
-            ESP_ERROR_CHECK(esp_event_loop_create_default());
+        _running = true;
+        _channel = 1;
+        scanChannel();
+        return true;
+    }
+
+    /// @brief Stop scanning, results are kept
+    void stop()
+    {
+        if (!_running.exchange(false))
+        {
+            return;
+        }
+        if (_timer)
+        {
+            esp_timer_stop(_timer);
+        }
+        esp_wifi_scan_stop();
+        if (_handler)
+        {
+            esp_event_handler_instance_unregister(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, _handler);
+            _handler = nullptr;
         }
+    }
 
-        _cl = esp_netif_create_default_wifi_sta();
+    /// @brief Results, strongest first
+    /// @param fn callable(const APInfo&), called with the table locked - must not block
+    template <typename F>
+    void forEach(F fn) const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (size_t i = 0; i < _count; ++i)
+        {
+            fn(_table[i]);
+        }
+    }
 
-        wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-        ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-        ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-        ESP_ERROR_CHECK(esp_wifi_start());
+    /// @brief Changes with every change of the results
+    uint32_t version() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _version;
     }
 
-    void down() {
-       esp_wifi_stop();
-       esp_wifi_deinit();
-       esp_wifi_set_mode(WIFI_MODE_NULL);
-       if (_cl) {
-         esp_netif_destroy(_cl);
-         _cl = nullptr;
-       }
+private:
+    static void eventHandler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+    {
+        if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_SCAN_DONE)
+        {
+            static_cast<WiFiScanner *>(arg)->onScanDone();
+        }
     }
 
-    void scan()
+    static void onTimer(void *arg)
     {
-        wifi_scan_config_t scan_config = {
-            .ssid = nullptr,
-            .bssid = nullptr,
-            .channel = 0,
-            .show_hidden = true,
-            .scan_type = WIFI_SCAN_TYPE_ACTIVE,
-            .scan_time {{100,500},500}};
-        ESP_ERROR_CHECK(esp_wifi_scan_start(&scan_config, true)); // true for block scan
+        static_cast<WiFiScanner *>(arg)->scanChannel();
     }
 
-    void debugScanResults()
+    /// @brief Merge channel results, continue with the next channel
+    void onScanDone()
     {
-        uint16_t number = 20;
-        wifi_ap_record_t ap_records[number];
-        ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&number, ap_records));
-        for (int i = 0; i < number; i++)  {       
-            printf("SSID: %s, RSSI: %d\n", ap_records[i].ssid, ap_records[i].rssi);
+        if (!_running)
+        {
+            return;
+        }
+
+        uint16_t number = _records.size();
+        if (esp_wifi_scan_get_ap_records(&number, _records.data()) == ESP_OK)
+        {
+            for (uint16_t i = 0; i < number; ++i)
+            {
+                merge(_records[i]);
+            }
+        }
+
+        if (++_channel > _lastChannel)
+        {
+            _channel = 1;
+            esp_timer_start_once(_timer, _roundPauseMs * 1000);
+        }
+        else
+        {
+            scanChannel();
         }
     }
 
-    void processResults(ScanResultCallback callback) {
-    uint16_t number = 20;
-    wifi_ap_record_t ap_records[number];
-    ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&number, ap_records));
-
-    for (int i = 0; i < number; i++) {
-        APInfo info;
-        strncpy(info.ap_name, (const char*)ap_records[i].ssid, sizeof(info.ap_name) - 1);
-        info.ap_name[sizeof(info.ap_name) - 1] = '\0'; 
-        info.rssi = ap_records[i].rssi;
-        callback(info);
+    void scanChannel()
+    {
+        if (!_running)
+        {
+            return;
+        }
+
+        wifi_scan_config_t scan_config{};
+        scan_config.channel = _channel;
+        scan_config.show_hidden = false;
+        scan_config.scan_type = WIFI_SCAN_TYPE_ACTIVE;
+        scan_config.scan_time.active.min = _dwellMinMs;
+        scan_config.scan_time.active.max = _dwellMaxMs;
+        if (esp_wifi_scan_start(&scan_config, false) != ESP_OK)
+        {
+            // STA busy (connecting) - try the same channel later
+            esp_timer_start_once(_timer, _retryMs * 1000);
+        }
     }
-}
-  private:
-  esp_netif_t * _cl{nullptr};
+
+    /// @brief One entry per SSID with the best RSSI, table sorted by RSSI
+    void merge(const wifi_ap_record_t &rec)
+    {
+        const char *ssid = reinterpret_cast<const char *>(rec.ssid);
+        if (ssid[0] == '\0')
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        size_t pos = 0;
+        while (pos < _count && strncmp(_table[pos].ap_name, ssid, sizeof(_table[pos].ap_name)) != 0)
+        {
+            ++pos;
+        }
+
+        if (pos < _count)
+        {
+            if (rec.rssi <= _table[pos].rssi)
+            {
+                return;
+            }
+        }
+        else if (_count < _table.size())
+        {
+            pos = _count++;
+            strncpy(_table[pos].ap_name, ssid, sizeof(_table[pos].ap_name) - 1);
+            _table[pos].ap_name[sizeof(_table[pos].ap_name) - 1] = '\0';
+        }
+        else if (rec.rssi > _table[_count - 1].rssi)
+        {
+            // full - replaces the weakest
+            pos = _count - 1;
+            strncpy(_table[pos].ap_name, ssid, sizeof(_table[pos].ap_name) - 1);
+            _table[pos].ap_name[sizeof(_table[pos].ap_name) - 1] = '\0';
+        }
+        else
+        {
+            return;
+        }
+        _table[pos].rssi = rec.rssi;
+
+        // stronger entry moves up, the rest stays sorted
+        for (; pos > 0 && _table[pos - 1].rssi < _table[pos].rssi; --pos)
+        {
+            std::swap(_table[pos - 1], _table[pos]);
+        }
+        _version++;
+    }
+
+    static constexpr uint8_t _lastChannel{13};          ///< channels 1 .. 13
+    static constexpr uint32_t _dwellMinMs{50};          ///< active scan per channel
+    static constexpr uint32_t _dwellMaxMs{120};
+    static constexpr uint32_t _roundPauseMs{5000};      ///< between scan rounds
+    static constexpr uint32_t _retryMs{500};            ///< scan start failed
+
+    std::array<wifi_ap_record_t, 8> _records{};        ///< results of one channel
+    std::array<APInfo, _maxAPs> _table{};              ///< merged results
+    size_t _count{0};
+    uint32_t _version{0};
+    mutable std::mutex _mutex;                         ///< table
+    std::atomic<bool> _running{false};
+    uint8_t _channel{1};                               ///< channel being scanned
+    esp_timer_handle_t _timer{nullptr};
+    esp_event_handler_instance_t _handler{nullptr};
 };
@@ -0,0 +1,210 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   wifi_supervisor.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+/// @brief Request of the supervisor
+struct WifiAction {
+	uint8_t network;	///< connect to this network (index in priority order)
+};
+
+/// @brief Station connection supervisor
+///
+/// No hardware and no OS dependency - the input is a timeline of link events
+/// and clock ticks in milliseconds, randomness comes from the caller, so it can be
+/// driven by a simulated event stream on a host. The caller reports link up /
+/// down, calls tick() at the deadline() and connects when emit is called.
+///
+/// A failed attempt (link down or no result within connectTimeoutMs) is retried
+/// after an exponential back-off with jitter. After failoverAfter failures in a row
+/// the next network of the priority list is tried. A lost link is retried at once
+/// on the same network. Time from the loss to the next link up is the recovery time.
+template <size_t N>
+class WifiSupervisor
+{
+public:
+	/// @brief Retry timing
+	struct Timing {
+		uint32_t backoffMinMs{1000};		///< first retry delay
+		uint32_t backoffMaxMs{60000};		///< longest retry delay
+		uint8_t jitterPercent{25};			///< delay +- jitterPercent
+		uint32_t connectTimeoutMs{15000};	///< attempt without result is a failure
+		uint8_t failoverAfter{3};			///< failures before the next network
+	};
+
+	/// @brief Connection state
+	enum class State : uint8_t {
+		Idle,		///< stopped
+		Connecting,	///< attempt in progress
+		Connected,	///< link up
+		Backoff		///< waiting before the next attempt
+	};
+
+	/// @brief Random source, uniform 32 bits
+	using Random = uint32_t (*)();
+
+	explicit WifiSupervisor(Random random, const Timing &timing = Timing{}) : _random(random), _timing(timing) {}
+
+	/// @brief Start with the first network
+	/// @param networks configured networks, priority order, max. N
+	/// @param now time [ms]
+	/// @param emit callable(const WifiAction&)
+	template <typename F>
+	void start(size_t networks, uint32_t now, F &&emit)
+	{
+		_networks = std::min(networks, N);
+		_network = 0;
+		_failures = 0;
+		_attempts = 0;
+		_outage = false;
+		if (_networks == 0) {
+			_state = State::Idle;
+			return;
+		}
+		connect(now, emit);
+	}
+
+	/// @brief Stop, no more actions
+	void stop()
+	{
+		_state = State::Idle;
+		_outage = false;
+	}
+
+	/// @brief Link is up (got IP)
+	/// @param now time [ms]
+	void up(uint32_t now)
+	{
+		if (_state != State::Connecting) {
+			return;
+		}
+		_state = State::Connected;
+		_failures = 0;
+		_attempts = 0;
+		if (_outage) {
+			const uint32_t ms = now - _lost;
+			_recoveries++;
+			_lastRecoveryMs = ms;
+			_maxRecoveryMs = std::max(_maxRecoveryMs, ms);
+			_outage = false;
+		}
+	}
+
+	/// @brief Link is down or the attempt failed
+	/// @param now time [ms]
+	/// @param emit callable(const WifiAction&)
+	template <typename F>
+	void down(uint32_t now, F &&emit)
+	{
+		switch (_state) {
+			case State::Connected:
+				// lost link - the AP may be back at once
+				_outage = true;
+				_lost = now;
+				connect(now, emit);
+				break;
+			case State::Connecting:
+				failure(now);
+				break;
+			default:
+				break;
+		}
+	}
+
+	/// @brief Time based transitions
+	/// @param now time [ms]
+	/// @param emit callable(const WifiAction&)
+	template <typename F>
+	void tick(uint32_t now, F &&emit)
+	{
+		if (!due(now)) {
+			return;
+		}
+		if (_state == State::Backoff) {
+			connect(now, emit);
+		} else if (_state == State::Connecting) {
+			failure(now);
+		}
+	}
+
+	/// @brief Time to the next tick()
+	/// @param now time [ms]
+	/// @param ms output, 0 - overdue
+	/// @return false if nothing is pending
+	bool deadline(uint32_t now, uint32_t &ms) const
+	{
+		if (_state != State::Connecting && _state != State::Backoff) {
+			return false;
+		}
+		const int32_t left = static_cast<int32_t>(_next - now);
+		ms = left > 0 ? static_cast<uint32_t>(left) : 0;
+		return true;
+	}
+
+	State state() const { return _state; }
+	size_t network() const { return _network; }
+	uint32_t recoveries() const { return _recoveries; }
+	uint32_t lastRecoveryMs() const { return _lastRecoveryMs; }
+	uint32_t maxRecoveryMs() const { return _maxRecoveryMs; }
+
+private:
+	template <typename F>
+	void connect(uint32_t now, F &&emit)
+	{
+		_state = State::Connecting;
+		_next = now + _timing.connectTimeoutMs;
+		emit(WifiAction{static_cast<uint8_t>(_network)});
+	}
+
+	void failure(uint32_t now)
+	{
+		_attempts++;
+		if (++_failures >= _timing.failoverAfter && _networks > 1) {
+			_failures = 0;
+			_network = (_network + 1) % _networks;
+		}
+		_state = State::Backoff;
+		_next = now + backoff();
+	}
+
+	/// @brief Delay of the next attempt, grows with failures over all networks
+	uint32_t backoff() const
+	{
+		const uint32_t shift = std::min<uint32_t>(_attempts - 1, 16);
+		const uint64_t base = std::min<uint64_t>(static_cast<uint64_t>(_timing.backoffMinMs) << shift, _timing.backoffMaxMs);
+		const uint32_t spread = static_cast<uint32_t>(base * _timing.jitterPercent / 100);
+		if (spread == 0) {
+			return static_cast<uint32_t>(base);
+		}
+		// base - spread ... base + spread, retries of many lamps don't hit the AP at once
+		return static_cast<uint32_t>(base - spread + _random() % (2 * spread + 1));
+	}
+
+	bool due(uint32_t now) const
+	{
+		// wrap safe, the clock wraps after 49 days
+		return static_cast<int32_t>(now - _next) >= 0;
+	}
+
+	Random _random;
+	Timing _timing;
+	State _state{State::Idle};
+	size_t _networks{0};		///< configured networks
+	size_t _network{0};			///< current network
+	uint32_t _failures{0};		///< failures on the current network
+	uint32_t _attempts{0};		///< failures since the last link up
+	uint32_t _next{0};			///< deadline [ms]
+	bool _outage{false};		///< link was lost, not recovered yet
+	uint32_t _lost{0};			///< time of the loss [ms]
+	uint32_t _recoveries{0};
+	uint32_t _lastRecoveryMs{0};
+	uint32_t _maxRecoveryMs{0};
+};
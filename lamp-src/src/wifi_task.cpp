@@ -13,21 +13,55 @@
 #include <ctype.h>
 
 #include "wifi_task.h"
-#include "key_val.h"
+#include "config.h"
 #include "literals.h"
 #include "application.h"
-#include "wifi_scanner.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
+#include "key_val.h"
+#include "esp_random.h"
+#include "wifi_supervisor.h"
+#include "boot_phases.h"
 
-WifiTask::WifiTask()
+WifiTask::WifiTask() : Reactor(2 + _eventsDepth)
 {
-	_queue = xQueueCreate(2, sizeof(int));
+	listen(_switch.handle());
+	_events = _eventsMem.create();
+	listen(_events);
 }
 
 WifiTask::~WifiTask()
 {
 	done();
-	if (_queue)
-		vQueueDelete(_queue);
+}
+
+bool WifiTask::loadLink(const char *ssid, Link &link)
+{
+	size_t length = sizeof(link);
+	return KeyVal::getInstance().readBlob(literals::kv_wlink, &link, length) && length == sizeof(link) &&
+		   link.channel != 0 && strncmp(link.ssid, ssid, sizeof(link.ssid)) == 0;
+}
+
+void WifiTask::storeLink()
+{
+	wifi_ap_record_t ap{};
+	if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK)
+	{
+		return;
+	}
+
+	Link link{};
+	memcpy(link.ssid, ap.ssid, sizeof(link.ssid) - 1);
+	memcpy(link.bssid, ap.bssid, sizeof(link.bssid));
+	link.channel = ap.primary;
+
+	// unchanged AP - no flash write
+	Link old{};
+	if (loadLink(link.ssid, old) && memcmp(old.bssid, link.bssid, sizeof(link.bssid)) == 0 && old.channel == link.channel)
+	{
+		return;
+	}
+	KeyVal::getInstance().writeBlob(literals::kv_wlink, &link, sizeof(link));
 }
 
 void WifiTask::loop()
@@ -41,27 +75,89 @@ void WifiTask::loop()
 			.gw = { .addr = 0 }
 		};
 	bool processit = true;
-	int receivedMode = static_cast<int>(Mode::Stop);
+	Mode receivedMode = Mode::Stop;
+	std::array<Network, _maxNetworks> networks{};	///< priority order
+	size_t networkCount = 0;
+	WifiSupervisor<_maxNetworks> supervisor([]() -> uint32_t { return esp_random(); });
 
-	while (true)
-	{ // Loop forever
+	auto nowMs = []()
+	{
+		return static_cast<uint32_t>(esp_timer_get_time() / 1000);
+	};
+
+	// supervisor request - (re)connect to a network of the list
+	auto connectTo = [&](const WifiAction &action)
+	{
+		const auto &net = networks[action.network];
+		if (wfcli.isConnected())
+		{
+			wfcli.disconnect();
+		}
+
+		staticip.ip.addr = net.ip;
+		staticip.netmask.addr = net.mask;
+		staticip.gw.addr = net.gw;
+		const bool dhcp = staticip.ip.addr == 0 || staticip.netmask.addr == 0;
+
+		// AP of the last association, DHCP reuses its lease (CONFIG_LWIP_DHCP_RESTORE_LAST_IP)
+		Link link{};
+		const bool cached = loadLink(net.ssid, link);
 
-		auto res = xQueueReceive(_queue, (void *)&receivedMode, 0);
-		if (res == pdTRUE)
+		ESP_LOGI("WifiTask", "connecting to '%s'%s", net.ssid, cached ? " (cached AP)" : "");
+		if (!wfcli.connect(net.ssid, net.pass, dhcp, dhcp ? nullptr : &staticip, cached ? link.bssid : nullptr, link.channel))
 		{
-			processit = true;
+			Bus<BlinkMode>::publish(BlinkMode::ERROR);
 		}
+	};
+
+	// timer for the supervisor deadline, statistics for /metrics
+	auto schedule = [&]()
+	{
+		uint32_t ms = 0;
+		if (supervisor.deadline(nowMs(), ms))
+		{
+			// round up to whole ticks, an early wake-up would only re-arm
+			armTimer(ms + portTICK_PERIOD_MS - 1);
+		}
+		else
+		{
+			disarmTimer();
+		}
+		_recoveries.store(supervisor.recoveries(), std::memory_order_relaxed);
+		_lastRecoveryMs.store(supervisor.lastRecoveryMs(), std::memory_order_relaxed);
+		_maxRecoveryMs.store(supervisor.maxRecoveryMs(), std::memory_order_relaxed);
+		_network.store(static_cast<uint8_t>(supervisor.network()), std::memory_order_relaxed);
+	};
+
+	// Wi-Fi parameters of the configured network, RAM copy (RTC memory after a soft reset)
+	auto params = [&]()
+	{
+		const auto cfg = Config::getInstance().get();
+		Network wifi{};
+		wifi.ip = cfg.ip;
+		wifi.mask = cfg.mask;
+		wifi.gw = cfg.gw;
+		Config::setString(wifi.ssid, cfg.ssid);
+		Config::setString(wifi.pass, cfg.pass);
+		return wifi;
+	};
 
-		if (processit)
+	// mode switch, Stop continues with AP or Client in the same call
+	auto process = [&]()
+	{
+		while (processit)
 		{
 			processit = false;
-			Mode mode = static_cast<Mode>(receivedMode);
+			Mode mode = receivedMode;
 
 			// Stop mode & check initial configuration
 			if (mode == Mode::Stop)
 			{
 
 				// stop all previous wifi modes
+				supervisor.stop();
+				schedule();
+				_scanner.stop();
 				wftt.stop();
 				if (wfcli.isConnected())
 				{
@@ -69,27 +165,25 @@ void WifiTask::loop()
 				}
 
 				// valid configuration?
-				KeyVal &kv = KeyVal::getInstance();
-
-				const auto &apname = kv.readString(literals::kv_ssid);
-				if (apname.empty())
+				if (params().ssid[0] == '\0')
 				{
 					// no valid configuration & switch to AP
-					receivedMode = static_cast<int>(Mode::AP);
+					receivedMode = Mode::AP;
 					processit = true;
-					Application::getInstance()->getLEDTask()->mode(BlinkMode::AP_MODE);
+					Bus<BlinkMode>::publish(BlinkMode::AP_MODE);
 				}
 				else
 				{
 					// switch to Client
-					receivedMode = static_cast<int>(Mode::Client);
+					receivedMode = Mode::Client;
 					processit = true;
-					Application::getInstance()->getLEDTask()->mode(BlinkMode::CLIENT);
+					Bus<BlinkMode>::publish(BlinkMode::CLIENT);
 				}
 			}
 			else if (mode == Mode::Client)
 			{
 
+				_scanner.stop();
 				wftt.stop();
 				if (wfcli.isConnected())
 				{
@@ -98,65 +192,101 @@ void WifiTask::loop()
 
 				wfcli.init(false);
 
-				KeyVal &kv = KeyVal::getInstance();
-				esp_netif_str_to_ip4(kv.readString(literals::kv_ip).c_str(), &staticip.ip);
-				esp_netif_str_to_ip4(kv.readString(literals::kv_mask).c_str(), &staticip.netmask);
-				esp_netif_str_to_ip4(kv.readString(literals::kv_gtw).c_str(), &staticip.gw);
-
-				bool cntok = false;
-				if (staticip.ip.addr == 0 || staticip.netmask.addr == 0)
+				// the configured network first, then the backups (DHCP)
+				networks[0] = params();
+				networkCount = 1;
+				const auto cfg = Config::getInstance().get();
+				for (const auto &backup : cfg.backup)
 				{
-					// DHCP mode
-					cntok = wfcli.connect(kv.readString(literals::kv_ssid), kv.readString(literals::kv_passwd), true, nullptr);
+					if (backup.ssid[0] != '\0' && networkCount < networks.size())
+					{
+						auto &net = networks[networkCount++];
+						net = Network{};
+						Config::setString(net.ssid, backup.ssid);
+						Config::setString(net.pass, backup.pass);
+					}
 				}
-				else
+
+				supervisor.start(networkCount, nowMs(), connectTo);
+				schedule();
+
+				// wall clock for the history log, SNTP retries until the link is up
+				if (!esp_sntp_enabled())
 				{
-					// static IP mode
-					cntok = wfcli.connect(kv.readString(literals::kv_ssid), kv.readString(literals::kv_passwd), false, &staticip);
+					esp_sntp_setoperatingmode(SNTP_OPMODE_POLL);
+					esp_sntp_setservername(0, literals::ntp_server);
+					esp_sntp_init();
 				}
 
-				if (!cntok)
-					Application::getInstance()->getLEDTask()->mode(BlinkMode::ERROR);
-
 				// startup web server for client
-				Application::getInstance()->getWebTask()->command(WebTask::Mode::Control);
+				Bus<WebMode>::publish(WebMode::Control);
 			}
 			else if (mode == Mode::AP)
 			{
+				supervisor.stop();
+				schedule();
 				if (wfcli.isConnected())
 				{
 					wfcli.disconnect();
 				}
-				// scan APs for info
-				WiFiScanner scanner;
-				scanner.init(false);
-				scanner.scan();
-
-				// clear web task AP info
-				Application::getInstance()->getWebTask()->command(WebTask::Mode::ClearAPInfo);
-				ScanResultCallback callback = [](const APInfo &info)
-				{
-					// send each AP into WebTask
-					Application::getInstance()->getWebTask()->apInfo(info);
-				};
-				scanner.processResults(callback);
-				scanner.down();
-
-				// AP start
-				wftt.start(literals::ap_name, literals::ap_passwd);
-				Application::getInstance()->getWebTask()->command(WebTask::Mode::Setting);
+				// AP + STA, the scan runs in the background & the setting page shows the list as it grows
+				wftt.start(literals::ap_name, literals::ap_passwd, true);
+				_scanner.start();
+				Bus<WebMode>::publish(WebMode::Setting);
 			}
 		}
+	};
 
-		vTaskDelay(500 / portTICK_PERIOD_MS);
-	}
-}
+	on<Mode>(_switch.handle(), [&](const Mode &mode)
+	{
+		receivedMode = mode;
+		processit = true;
+		process();
+	});
 
-void WifiTask::switchMode(Mode mode)
-{
-	if (_queue)
+	// link events from the event loop task
+	on<LinkEvent>(_events, [&](const LinkEvent &ev)
 	{
-		int modeToSend = static_cast<int>(mode);
-		xQueueSendToBack(_queue, (void *)&modeToSend, 0);
-	}
-}
\ No newline at end of file
+		if (ev == LinkEvent::Up)
+		{
+			supervisor.up(nowMs());
+			Bus<BlinkMode>::publish(BlinkMode::CLIENT);
+		}
+		else
+		{
+			if (supervisor.state() == WifiSupervisor<_maxNetworks>::State::Connected)
+			{
+				Bus<BlinkMode>::publish(BlinkMode::ERROR);
+			}
+			supervisor.down(nowMs(), connectTo);
+		}
+		schedule();
+	});
+
+	// connect timeout & back-off
+	onTimer([&]()
+	{
+		supervisor.tick(nowMs(), connectTo);
+		schedule();
+	});
+
+	// IP address - remember the AP for the directed connect of the next boot
+	wfcli.registerConnectedCallback([this](const ip_event_got_ip_t &)
+	{
+		BootPhases::mark(BootPhase::GotIp);
+		storeLink();
+		const LinkEvent ev = LinkEvent::Up;
+		xQueueSendToBack(_events, &ev, 0);
+	});
+
+	// lost link or failed attempt, not a requested disconnect
+	wfcli.registerDisconnectedCallback([this]()
+	{
+		const LinkEvent ev = LinkEvent::Down;
+		xQueueSendToBack(_events, &ev, 0);
+	});
+
+	// initial configuration check
+	process();
+	dispatch();
+}
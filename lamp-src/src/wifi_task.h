@@ -7,30 +7,89 @@
 
 #pragma once
 
+#include <atomic>
 #include "hardware.h"
-#include "rptask.h"
+#include "reactor.h"
+#include "bus.h"
 #include "access_point.h"
 #include "wifi_client.h"
+#include "wifi_scanner.h"
 #include "literals.h"
 
+enum class WifiMode {
+	AP,     // Access Point 
+	Client, // STA
+	Stop    // Stopped
+};
+
+template <>
+struct Topic<WifiMode> {
+	static constexpr const char *name = "wifi_mode";
+	static constexpr bool latest = false;
+	static constexpr size_t depth = 2;
+	static constexpr size_t subscribers = 1;
+};
 
-class WifiTask : public RPTask
+class WifiTask : public Reactor
 {
 public:
- enum class Mode {
-	    AP,     // Access Point 
-        Client, // STA
-        Stop    // Stopped
-    };
+	using Mode = WifiMode;
 
 	WifiTask();
 	virtual ~WifiTask();
-	void switchMode(Mode mode);
+
+	/// @brief Lost links recovered by the supervisor
+	uint32_t recoveries() const { return _recoveries.load(std::memory_order_relaxed); }
+
+	/// @brief Time from the loss to link up [ms], last & max.
+	uint32_t lastRecoveryMs() const { return _lastRecoveryMs.load(std::memory_order_relaxed); }
+	uint32_t maxRecoveryMs() const { return _maxRecoveryMs.load(std::memory_order_relaxed); }
+
+	/// @brief Network in use, 0 - configured, 1.. - backups
+	uint8_t network() const { return _network.load(std::memory_order_relaxed); }
+
+	/// @brief Networks around, filled in AP mode
+	const WiFiScanner &scanner() const { return _scanner; }
 
 protected:
 	void loop() override;
 
 private:
+	/// @brief Last successful association, NVS blob
+	struct Link {
+		char ssid[33];			///< network of the cached AP
+		uint8_t bssid[6];
+		uint8_t channel;		///< 0 - invalid
+	};
+
+	/// @brief Network of the connect list
+	struct Network {
+		uint32_t ip;			///< static IP, 0 - DHCP
+		uint32_t mask;
+		uint32_t gw;
+		char ssid[33];			///< '\0' - not configured, AP mode
+		char pass[65];
+	};
+
+	/// @brief Link event from WiFiClient callbacks
+	enum class LinkEvent : uint8_t {
+		Up,		///< got IP
+		Down	///< lost link or failed attempt
+	};
+
+	static bool loadLink(const char *ssid, Link &link);
+	static void storeLink();
+
+	static constexpr size_t _maxNetworks{3};	///< configured + backups
+	static constexpr size_t _eventsDepth{4};
+
 	Mode            _mode {Mode::Stop};
-	QueueHandle_t 	_queue;
+	Mailbox<WifiMode> _switch;		///< mode switch requests
+	QueueMemory<LinkEvent, _eventsDepth> _eventsMem;
+	QueueHandle_t	_events{nullptr};	///< link events
+	std::atomic<uint32_t> _recoveries{0};
+	std::atomic<uint32_t> _lastRecoveryMs{0};
+	std::atomic<uint32_t> _maxRecoveryMs{0};
+	std::atomic<uint8_t> _network{0};
+	WiFiScanner		_scanner;			///< background scan in AP mode
 };
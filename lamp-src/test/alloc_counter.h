@@ -0,0 +1,48 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   alloc_counter.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <cstdio>
+
+/// @brief Heap allocations of the process, counted by the replaced operator new (alloc_counter.cpp)
+uint64_t allocations();
+
+/// @brief Benchmark result line - time & allocations per operation
+///
+///     auto r = measure(100000, [&](uint64_t i) { parser.parseByte(bytes[i % 13]); });
+///     report("parser", "byte", r, 100000);
+struct BenchResult {
+	double ns;				///< total time [ns]
+	uint64_t allocs;		///< total allocations
+};
+
+/// @brief Run fn(i) for i = 0 .. n-1
+template <typename F>
+BenchResult measure(uint64_t n, F &&fn)
+{
+	const uint64_t allocs = allocations();
+	const auto begin = std::chrono::steady_clock::now();
+	for (uint64_t i = 0; i < n; ++i) {
+		fn(i);
+	}
+	const auto end = std::chrono::steady_clock::now();
+	return BenchResult{std::chrono::duration<double, std::nano>(end - begin).count(), allocations() - allocs};
+}
+
+/// @brief Print per unit numbers
+/// @param name benchmark
+/// @param unit unit of the operation (frame, byte, op)
+/// @param r result
+/// @param units operations measured
+inline void report(const char *name, const char *unit, const BenchResult &r, uint64_t units)
+{
+	std::printf("%-28s %10.1f ns/%-5s %8.3f allocs/%s\n", name, r.ns / units, unit,
+				static_cast<double>(r.allocs) / units, unit);
+}
@@ -0,0 +1,85 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   bench_pending_writes.cpp
+/// @author Petr Vanek
+
+#include <string>
+#include <vector>
+#include "alloc_counter.h"
+#include "pending_writes.h"
+
+/// @brief Result must be used, or the optimizer drops the loop
+static volatile uint32_t _sink;
+
+static constexpr uint64_t _lookups{1000000};
+static constexpr uint32_t _updates{20};		///< writes of every key per batch
+
+/// @brief Counts store operations only
+struct CountingStorage {
+	bool write(const std::string &, const StoredValue &)
+	{
+		writes++;
+		return true;
+	}
+
+	bool commit()
+	{
+		commits++;
+		return true;
+	}
+
+	uint64_t writes{0};
+	uint64_t commits{0};
+};
+
+static std::vector<std::string> keys(size_t n)
+{
+	std::vector<std::string> rc;
+	for (size_t i = 0; i < n; ++i) {
+		rc.push_back("key" + std::to_string(i));
+	}
+	return rc;
+}
+
+int main()
+{
+	std::printf("%-28s %13s %17s\n", "benchmark", "time", "allocations");
+
+	for (size_t n : {16, 256, 4096}) {
+		const auto names = keys(n);
+		PendingWrites<CountingStorage> pending;
+		CountingStorage storage;
+		uint32_t age = 0;
+		char name[40];
+
+		// batch - every key written _updates times, then one flush
+		auto r = measure(n * _updates, [&](uint64_t i) {
+			pending.stage(names[i % n], StoredValue{StoredValue::Kind::U32, static_cast<uint32_t>(i), {}}, 0, age);
+		});
+		std::snprintf(name, sizeof(name), "stage %zu keys", n);
+		report(name, "write", r, n * _updates);
+
+		// lookup of a pending value, hash map - flat over the key count
+		StoredValue v;
+		r = measure(_lookups, [&](uint64_t i) {
+			pending.find(names[(i * 7919) % n], v);
+			_sink = v.num;
+		});
+		std::snprintf(name, sizeof(name), "lookup %zu keys", n);
+		report(name, "op", r, _lookups);
+
+		r = measure(1, [&](uint64_t) {
+			pending.flush(storage, 0);
+		});
+		std::snprintf(name, sizeof(name), "flush %zu keys", n);
+		report(name, "key", r, n);
+		std::printf("%-28s %10llu writes %9llu commits (%llu updates)\n", "", static_cast<unsigned long long>(storage.writes),
+					static_cast<unsigned long long>(storage.commits), static_cast<unsigned long long>(n * _updates));
+		if (storage.writes != n || storage.commits != 1) {
+			return 1;
+		}
+	}
+	return 0;
+}
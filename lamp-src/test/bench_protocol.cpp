@@ -0,0 +1,100 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   bench_protocol.cpp
+/// @author Petr Vanek
+
+#include <vector>
+#include "alloc_counter.h"
+#include "parser.h"
+#include "http_request.h"
+
+using lamp::Packet;
+using lamp::PacketParser;
+
+/// @brief Result must be used, or the optimizer drops the loop
+static volatile uint32_t _sink;
+
+static constexpr uint64_t _frames{1000000};
+static constexpr uint64_t _forms{200000};
+
+/// @brief Frames with varying data, as received from the UART
+static std::vector<uint8_t> stream(size_t frames)
+{
+	std::vector<uint8_t> rc;
+	rc.reserve(frames * 13);
+	Packet p;
+	for (size_t i = 0; i < frames; ++i) {
+		p.prepare();
+		p.setIdentification(std::array<uint8_t, 7>{0xC2, 0x1C, 0x00, 0x9D, 0x1B, 0x00, 0x0E});
+		p.setCommand(Packet::Command::On);
+		p.setIntensity(static_cast<uint8_t>(i % 0x18));
+		p.setYellow2White(static_cast<uint8_t>((i / 0x18) % 0x18));
+		p.computeChecksum();
+		rc.insert(rc.end(), p.getContnet().begin(), p.getContnet().end());
+	}
+	return rc;
+}
+
+int main()
+{
+	std::printf("%-28s %13s %17s\n", "benchmark", "time", "allocations");
+
+	// encode - command, values & checksum of a transmitted frame
+	Packet tx;
+	tx.prepare();
+	auto r = measure(_frames, [&](uint64_t i) {
+		tx.setCommand(Packet::Command::On);
+		tx.setIntensity(static_cast<uint8_t>(i));
+		tx.setYellow2White(static_cast<uint8_t>(i >> 8));
+		tx.computeChecksum();
+		_sink = tx.getContnet()[11];
+	});
+	report("packet encode+checksum", "frame", r, _frames);
+
+	r = measure(_frames, [&](uint64_t) {
+		_sink = tx.validateChecksum();
+	});
+	report("packet validate", "frame", r, _frames);
+
+	// parser - one byte at a time, as in LC12STask
+	const auto bytes = stream(4096);
+	PacketParser prs;
+	uint32_t parsed = 0;
+	r = measure(_frames * 13, [&](uint64_t i) {
+		parsed += prs.parseByte(bytes[i % bytes.size()]) ? 1 : 0;
+	});
+	_sink = parsed;
+	report("parser", "frame", r, _frames);
+	report("parser", "byte", r, _frames * 13);
+
+	// parser with noise between frames
+	std::vector<uint8_t> noisy;
+	for (size_t i = 0; i < bytes.size(); i += 13) {
+		noisy.insert(noisy.end(), bytes.begin() + i, bytes.begin() + i + 13);
+		noisy.insert(noisy.end(), {0xFF, 0x00, 0x7E});
+	}
+	prs.clear();
+	r = measure(noisy.size() * 64, [&](uint64_t i) {
+		parsed += prs.parseByte(noisy[i % noisy.size()]) ? 1 : 0;
+	});
+	_sink = parsed;
+	report("parser noisy stream", "byte", r, noisy.size() * 64);
+
+	// setting form of the AP page
+	const std::string form = "ssid=My+Home+Net&pass=p%40ss%21word&ip=192.168.2.222&gtw=192.168.2.1"
+							 "&mask=255.255.255.0&mqtt=mqtt%3A%2F%2F192.168.2.10&ssid2=&pass2=&ssid3=&pass3=";
+	r = measure(_forms, [&](uint64_t) {
+		auto data = HttpReqest::parseFormData(form);
+		_sink = static_cast<uint32_t>(data.size());
+	});
+	report("parseFormData (10 fields)", "op", r, _forms);
+	report("parseFormData (10 fields)", "byte", r, _forms * form.size());
+
+	r = measure(_forms, [&](uint64_t) {
+		_sink = static_cast<uint32_t>(HttpReqest::urlDecode("p%40ss%21word+x").size());
+	});
+	report("urlDecode", "op", r, _forms);
+	return 0;
+}
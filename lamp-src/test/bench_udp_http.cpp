@@ -0,0 +1,112 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   bench_udp_http.cpp
+/// @author Petr Vanek
+
+#include <vector>
+#include <algorithm>
+#include "alloc_counter.h"
+#include "loopback.h"
+#include "lamp_udp_client.h"
+
+/// @brief Set-state round trip over 127.0.0.1 - UDP protocol against the web page requests
+///
+/// The web page sets the state with three POSTs (/command, /slider brightness,
+/// /slider hue), UDP with one datagram. Both servers are emulated, the numbers
+/// are the cost of the network path on the host, not of the lamp.
+
+static constexpr int _rounds{5000};
+
+/// @brief Latency percentiles [us]
+static void print(const char *name, std::vector<double> &us)
+{
+	std::sort(us.begin(), us.end());
+	std::printf("%-34s p50 %8.1f us  p99 %8.1f us\n", name, us[us.size() / 2], us[us.size() * 99 / 100]);
+}
+
+static int connectTo(uint16_t port)
+{
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	int one = 1;
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if (connect(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0) {
+		std::abort();
+	}
+	return sock;
+}
+
+/// @brief POST & wait for the complete empty reply
+static void post(int sock, const char *uri, const std::string &body)
+{
+	char req[512];
+	const int len = std::snprintf(req, sizeof(req),
+		"POST %s HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n\r\n%s",
+		uri, body.size(), body.c_str());
+	send(sock, req, static_cast<size_t>(len), 0);
+
+	std::string in;
+	char buf[256];
+	while (in.find("\r\n\r\n") == std::string::npos) {
+		const ssize_t n = recv(sock, buf, sizeof(buf), 0);
+		if (n <= 0) {
+			std::abort();
+		}
+		in.append(buf, static_cast<size_t>(n));
+	}
+}
+
+static void setStateHttp(int sock)
+{
+	post(sock, "/command", R"({"command":"ON","brightness":"23","hue":"14"})");
+	post(sock, "/slider", R"({"slider":"brightness","value":"23"})");
+	post(sock, "/slider", R"({"slider":"hue","value":"14"})");
+}
+
+template <typename F>
+static std::vector<double> rounds(F &&fn)
+{
+	std::vector<double> us;
+	us.reserve(_rounds);
+	for (int i = 0; i < _rounds; ++i) {
+		auto r = measure(1, [&](uint64_t) { fn(i); });
+		us.push_back(r.ns / 1000.0);
+	}
+	return us;
+}
+
+int main()
+{
+	UdpLamp udpLamp;
+	HttpLamp httpLamp;
+
+	lamp::UdpClient udp("127.0.0.1", udpLamp.port());
+	auto us = rounds([&](int i) {
+		if (!udp.setState(true, static_cast<uint8_t>(i % 0x18), 0x0E)) {
+			std::abort();
+		}
+	});
+	print("udp set state", us);
+
+	// browser - keep-alive connection
+	int sock = connectTo(httpLamp.port());
+	us = rounds([&](int) { setStateHttp(sock); });
+	close(sock);
+	print("http set state (keep-alive)", us);
+
+	// script - new connection per request
+	us = rounds([&](int) {
+		for (int i = 0; i < 3; ++i) {
+			int s = connectTo(httpLamp.port());
+			post(s, "/slider", R"({"slider":"brightness","value":"23"})");
+			close(s);
+		}
+	});
+	print("http set state (connection/req)", us);
+	return 0;
+}
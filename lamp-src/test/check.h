@@ -0,0 +1,61 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   check.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+/// @brief Minimal test helpers - a failed check is reported and counted, the test goes on
+///
+///     CHECK(parser.errors() == 1);
+///     CHECK_EQ(value, 0x26);
+///     return testResult();
+
+/// @brief Number of failed checks
+inline int &checkFailures()
+{
+	static int failures = 0;
+	return failures;
+}
+
+inline void checkFailed(const char *file, int line, const char *expr)
+{
+	std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expr);
+	checkFailures()++;
+}
+
+template <typename A, typename B>
+inline void checkEqual(const A &a, const B &b, const char *file, int line, const char *expr)
+{
+	if (!(a == b)) {
+		std::fprintf(stderr, "%s:%d: CHECK_EQ(%s) failed: %s != %s\n", file, line, expr,
+					 std::to_string(a).c_str(), std::to_string(b).c_str());
+		checkFailures()++;
+	}
+}
+
+inline void checkEqual(const std::string &a, const std::string &b, const char *file, int line, const char *expr)
+{
+	if (a != b) {
+		std::fprintf(stderr, "%s:%d: CHECK_EQ(%s) failed: \"%s\" != \"%s\"\n", file, line, expr, a.c_str(), b.c_str());
+		checkFailures()++;
+	}
+}
+
+#define CHECK(expr) do { if (!(expr)) checkFailed(__FILE__, __LINE__, #expr); } while (0)
+#define CHECK_EQ(a, b) checkEqual((a), (b), __FILE__, __LINE__, #a ", " #b)
+
+/// @brief Exit code of the test executable
+inline int testResult()
+{
+	if (checkFailures() != 0) {
+		std::fprintf(stderr, "%d check(s) failed\n", checkFailures());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,212 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   loopback.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <thread>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include "udp_protocol.h"
+
+/// @brief Lamp emulation on 127.0.0.1 for host tests & benchmarks
+///
+/// UdpLamp answers the binary protocol like UdpTask (duplicate detection per client,
+/// reply with the state before the request), HttpLamp answers POST requests like
+/// httpd with an empty 200. No RF - only the network path is measured.
+
+/// @brief Bound loopback socket
+/// @param type SOCK_DGRAM / SOCK_STREAM
+/// @param port output - assigned port
+inline int loopbackSocket(int type, uint16_t &port)
+{
+	int sock = socket(AF_INET, type, 0);
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	if (sock < 0 || bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0 ||
+		getsockname(sock, reinterpret_cast<struct sockaddr *>(&addr), &len) != 0) {
+		std::abort();
+	}
+	port = ntohs(addr.sin_port);
+	return sock;
+}
+
+/// @brief Wait for data, false after the stop flag was set
+inline bool waitReadable(int fd, const std::atomic<bool> &stop)
+{
+	struct pollfd p = {fd, POLLIN, 0};
+	while (!stop.load()) {
+		if (poll(&p, 1, 20) > 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+class UdpLamp
+{
+public:
+	UdpLamp()
+	{
+		_sock = loopbackSocket(SOCK_DGRAM, _port);
+		_thread = std::thread([this]() { run(); });
+	}
+
+	~UdpLamp()
+	{
+		_stop = true;
+		_thread.join();
+		close(_sock);
+	}
+
+	uint16_t port() const { return _port; }
+
+private:
+	struct Client {
+		uint32_t addr{0};
+		uint16_t port{0};
+		uint32_t seq{0};
+		bool valid{false};
+	};
+
+	void run()
+	{
+		using lamp::UdpMessage;
+		uint8_t buf[UdpMessage::_size + 1];
+		while (waitReadable(_sock, _stop)) {
+			struct sockaddr_in from = {};
+			socklen_t fromLen = sizeof(from);
+			const ssize_t len = recvfrom(_sock, buf, sizeof(buf), 0, reinterpret_cast<struct sockaddr *>(&from), &fromLen);
+			if (len <= 0) {
+				continue;
+			}
+
+			UdpMessage msg;
+			auto status = UdpMessage::Status::Invalid;
+			const auto before = _state;
+			if (msg.parse(buf, static_cast<size_t>(len))) {
+				auto &cl = client(from.sin_addr.s_addr, from.sin_port);
+				if (msg.getType() != UdpMessage::Type::Query && cl.valid && !UdpMessage::newer(msg.getSequence(), cl.seq)) {
+					status = UdpMessage::Status::Duplicate;
+				} else {
+					status = UdpMessage::Status::Ok;
+					if (msg.getType() == UdpMessage::Type::SetState) {
+						_state = {msg.arg(0), msg.arg(1), msg.arg(2)};
+					}
+					if (msg.getType() != UdpMessage::Type::Query) {
+						cl.seq = msg.getSequence();
+						cl.valid = true;
+					}
+				}
+			}
+
+			auto reply = UdpMessage::make(UdpMessage::Type::State, msg.getSequence(), before[0], before[1], before[2]);
+			reply.setStatus(status);
+			sendto(_sock, reply.getContnet().data(), reply.getContnet().size(), 0,
+				   reinterpret_cast<struct sockaddr *>(&from), fromLen);
+		}
+	}
+
+	Client &client(uint32_t addr, uint16_t port)
+	{
+		for (auto &c : _clients) {
+			if (c.addr == addr && c.port == port) {
+				return c;
+			}
+		}
+		auto &c = _clients[_next++ % _clients.size()];
+		c = Client{addr, port, 0, false};
+		return c;
+	}
+
+	int _sock{-1};
+	uint16_t _port{0};
+	std::atomic<bool> _stop{false};
+	std::thread _thread;
+	std::array<uint8_t, 3> _state{};		///< on, intensity, hue
+	std::array<Client, 4> _clients{};
+	size_t _next{0};
+};
+
+class HttpLamp
+{
+public:
+	HttpLamp()
+	{
+		_sock = loopbackSocket(SOCK_STREAM, _port);
+		listen(_sock, 8);
+		_thread = std::thread([this]() { run(); });
+	}
+
+	~HttpLamp()
+	{
+		_stop = true;
+		_thread.join();
+		close(_sock);
+	}
+
+	uint16_t port() const { return _port; }
+
+private:
+	void run()
+	{
+		while (waitReadable(_sock, _stop)) {
+			int conn = accept(_sock, nullptr, nullptr);
+			if (conn >= 0) {
+				serve(conn);
+				close(conn);
+			}
+		}
+	}
+
+	/// @brief Requests of one connection, keep-alive until the client closes
+	void serve(int conn)
+	{
+		int one = 1;
+		setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		std::string in;
+		char buf[1024];
+		while (waitReadable(conn, _stop)) {
+			const ssize_t len = recv(conn, buf, sizeof(buf), 0);
+			if (len <= 0) {
+				return;
+			}
+			in.append(buf, static_cast<size_t>(len));
+
+			// complete requests - headers & Content-Length body
+			size_t end;
+			while ((end = in.find("\r\n\r\n")) != std::string::npos) {
+				size_t body = 0;
+				const auto cl = in.find("Content-Length: ");
+				if (cl != std::string::npos && cl < end) {
+					body = std::strtoul(in.c_str() + cl + 16, nullptr, 10);
+				}
+				if (in.size() < end + 4 + body) {
+					break;
+				}
+				in.erase(0, end + 4 + body);
+				static const char reply[] = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+				send(conn, reply, sizeof(reply) - 1, 0);
+			}
+		}
+	}
+
+	int _sock{-1};
+	uint16_t _port{0};
+	std::atomic<bool> _stop{false};
+	std::thread _thread;
+};
@@ -0,0 +1,238 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_button_fsm.cpp
+/// @author Petr Vanek
+
+#include <vector>
+#include "check.h"
+#include "button_fsm.h"
+
+enum Button : size_t { A, B, X, Count };
+
+using Type = ButtonEvent::Type;
+
+/// @brief Raw contact transition
+struct Raw {
+	uint32_t ms;
+	size_t button;
+	bool down;
+};
+
+/// @brief Emitted event with its time
+struct Emitted {
+	uint32_t ms;
+	Type type;
+	uint8_t button;
+	uint16_t count;
+};
+
+/// @brief Replays raw contact timelines the way ButtonTask samples them
+///
+/// The first raw edge disables the pin interrupt and starts the debounce timer,
+/// edges inside the window are not seen, the timer reads the settled level and
+/// enables the interrupt again. tick() runs at deadline(), time steps by 1 ms.
+class Bench
+{
+public:
+	static constexpr uint32_t debounceMs = 20;
+
+	explicit Bench(uint32_t start = 0, const ButtonFsm<Count>::Timing &timing = {}) : fsm(timing), now(start)
+	{
+		fsm.repeat(A, true);
+		fsm.repeat(B, true);
+		fsm.chord(A, B);
+	}
+
+	/// @brief Play raw edges (times relative to the start), then run until the relative time
+	void play(const std::vector<Raw> &raw, uint32_t until)
+	{
+		size_t next = 0;
+		for (uint32_t t = 0; t <= until; ++t, ++now) {
+			auto emit = [this](const ButtonEvent &ev) {
+				events.push_back(Emitted{now, ev.type, ev.button, ev.count});
+			};
+
+			for (; next < raw.size() && raw[next].ms == t; ++next) {
+				auto &c = contacts[raw[next].button];
+				if (c.level != raw[next].down && c.armed) {
+					c.armed = false;
+					c.sampleAt = now + debounceMs;
+				}
+				c.level = raw[next].down;
+			}
+			for (size_t b = 0; b < Count; ++b) {
+				auto &c = contacts[b];
+				if (!c.armed && c.sampleAt == now) {
+					c.armed = true;
+					fsm.level(b, c.level, now, emit);
+				}
+			}
+			uint32_t ms = 0;
+			if (fsm.deadline(now, ms) && ms == 0) {
+				fsm.tick(now, emit);
+			}
+		}
+	}
+
+	ButtonFsm<Count> fsm;
+	uint32_t now;						///< bench clock [ms]
+	std::vector<Emitted> events;
+
+private:
+	struct Contact {
+		bool level{false};		///< raw level, true - pressed
+		bool armed{true};		///< interrupt enabled
+		uint32_t sampleAt{0};	///< debounce timer expiration
+	};
+	Contact contacts[Count];
+};
+
+static bool is(const Emitted &e, Type type, size_t button, uint32_t ms)
+{
+	return e.type == type && e.button == button && e.ms == ms;
+}
+
+/// @brief Contact bounce inside the debounce window gives one click
+static void bounce()
+{
+	Bench bench;
+	bench.play({{0, X, true}, {1, X, false}, {3, X, true}, {5, X, false}, {6, X, true},
+				{200, X, false}, {202, X, true}, {204, X, false}}, 600);
+	CHECK_EQ(bench.events.size(), 1u);
+	if (bench.events.size() == 1) {
+		// released at the sample of the release bounce
+		CHECK(is(bench.events[0], Type::Click, X, 220));
+	}
+	CHECK(!bench.fsm.pressed(X));
+
+	// spike shorter than the window - the sample sees the released level
+	Bench spike;
+	spike.play({{0, X, true}, {2, X, false}}, 600);
+	CHECK(spike.events.empty());
+	CHECK(!spike.fsm.pressed(X));
+
+	// bounce past the window - the repeated pressed sample is ignored
+	Bench late;
+	late.play({{0, X, true}, {25, X, false}, {26, X, true}, {100, X, false}}, 600);
+	CHECK_EQ(late.events.size(), 1u);
+}
+
+static void shortPress()
+{
+	Bench bench;
+	bench.play({{0, X, true}, {150, X, false}}, 2000);
+	CHECK_EQ(bench.events.size(), 1u);
+	if (bench.events.size() == 1) {
+		CHECK(is(bench.events[0], Type::Click, X, 170));
+	}
+
+	// repeat button clicks before the repeat delay
+	Bench a;
+	a.play({{0, A, true}, {300, A, false}}, 2000);
+	CHECK_EQ(a.events.size(), 1u);
+	if (a.events.size() == 1) {
+		CHECK(is(a.events[0], Type::Click, A, 320));
+	}
+}
+
+static void longPress()
+{
+	Bench bench;
+	bench.play({{0, X, true}, {1500, X, false}}, 3000);
+	CHECK_EQ(bench.events.size(), 1u);
+	if (bench.events.size() == 1) {
+		// 800 ms from the debounced press, no click on release
+		CHECK(is(bench.events[0], Type::LongPress, X, 820));
+	}
+	CHECK(!bench.fsm.pressed(X));
+	uint32_t ms;
+	CHECK(!bench.fsm.deadline(bench.now, ms));
+}
+
+/// @brief No double-click gesture - two clicks, the first one is not delayed
+static void doubleClick()
+{
+	Bench bench;
+	bench.play({{0, X, true}, {80, X, false}, {150, X, true}, {230, X, false}}, 1000);
+	CHECK_EQ(bench.events.size(), 2u);
+	if (bench.events.size() == 2) {
+		CHECK(is(bench.events[0], Type::Click, X, 100));
+		CHECK(is(bench.events[1], Type::Click, X, 250));
+	}
+}
+
+/// @brief Auto-repeat accelerates, release after the hold is silent
+static void releaseAfterHold()
+{
+	Bench bench;
+	bench.play({{0, A, true}, {1500, A, false}}, 3000);
+
+	// press sampled at 20, first repeat 400 ms later, then 250, 200, 160, 128, 102, 81 ...
+	const uint32_t expected[] = {420, 670, 870, 1030, 1158, 1260, 1341, 1405, 1456, 1496};
+	CHECK_EQ(bench.events.size(), sizeof(expected) / sizeof(expected[0]));
+	for (size_t i = 0; i < bench.events.size() && i < sizeof(expected) / sizeof(expected[0]); ++i) {
+		CHECK(is(bench.events[i], Type::Repeat, A, expected[i]));
+		CHECK_EQ(bench.events[i].count, i + 1);
+	}
+	CHECK(!bench.fsm.pressed(A));
+	uint32_t ms;
+	CHECK(!bench.fsm.deadline(bench.now, ms));
+
+	// interval stops at repeatMinMs
+	Bench hold;
+	hold.play({{0, B, true}, {5000, B, false}}, 6000);
+	CHECK(hold.events.size() > 20);
+	const size_t n = hold.events.size();
+	CHECK_EQ(hold.events[n - 1].ms - hold.events[n - 2].ms, 40u);
+	CHECK(hold.events[n - 1].ms <= 5020);
+}
+
+static void chord()
+{
+	Bench bench;
+	bench.play({{0, A, true}, {10, B, true}, {1200, A, false}, {1210, B, false}}, 2000);
+	CHECK_EQ(bench.events.size(), 1u);
+	if (bench.events.size() == 1) {
+		// held 800 ms since the second button
+		CHECK(is(bench.events[0], Type::Chord, A, 830));
+	}
+
+	// released early - neither a chord nor clicks
+	Bench early;
+	early.play({{0, A, true}, {10, B, true}, {300, B, false}, {320, A, false}}, 2000);
+	CHECK(early.events.empty());
+
+	// the second button after the first one repeated is not a chord
+	Bench late;
+	late.play({{0, A, true}, {500, B, true}, {600, B, false}, {700, A, false}}, 2000);
+	CHECK(!late.events.empty());
+	for (const auto &e : late.events) {
+		CHECK(e.type != Type::Chord);
+	}
+}
+
+/// @brief The millisecond clock wraps after 49 days
+static void wrap()
+{
+	Bench bench(0xFFFFFFFFu - 500);
+	bench.play({{0, X, true}, {1500, X, false}}, 2000);
+	CHECK_EQ(bench.events.size(), 1u);
+	if (bench.events.size() == 1) {
+		CHECK(bench.events[0].type == Type::LongPress);
+		CHECK_EQ(bench.events[0].ms, 0xFFFFFFFFu - 500 + 820);
+	}
+}
+
+int main()
+{
+	bounce();
+	shortPress();
+	longPress();
+	doubleClick();
+	releaseAfterHold();
+	chord();
+	wrap();
+	return testResult();
+}
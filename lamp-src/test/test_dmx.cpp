@@ -0,0 +1,248 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_dmx.cpp
+/// @author Petr Vanek
+
+#include <vector>
+#include "check.h"
+#include "dmx.h"
+
+using lamp::DmxData;
+using lamp::DmxDecoder;
+using Mapper = lamp::DmxMapper<4>;
+
+static constexpr uint32_t frameUs = 13540;
+static const char *lampA = "c21c009d1b000e";
+static const char *lampB = "c21c009d1b000f";
+
+/// @brief ArtDmx packet, same layout as tools/dmx_send.py
+static std::vector<uint8_t> artNet(uint16_t universe, uint8_t sequence, const std::vector<uint8_t> &data)
+{
+	const uint8_t head[18] = {'A', 'r', 't', '-', 'N', 'e', 't', 0, 0x00, 0x50, 0, 14, sequence, 0,
+							  static_cast<uint8_t>(universe & 0xFF), static_cast<uint8_t>((universe >> 8) & 0x7F),
+							  static_cast<uint8_t>(data.size() >> 8), static_cast<uint8_t>(data.size())};
+	std::vector<uint8_t> p(sizeof(head) + data.size());
+	std::copy(std::begin(head), std::end(head), p.begin());
+	std::copy(data.begin(), data.end(), p.begin() + sizeof(head));
+	return p;
+}
+
+/// @brief E1.31 data packet, same layout as tools/dmx_send.py
+static std::vector<uint8_t> sacn(uint16_t universe, uint8_t sequence, const std::vector<uint8_t> &data)
+{
+	std::vector<uint8_t> p(126 + data.size(), 0);
+	const uint8_t id[] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7'};
+	p[1] = 0x10;
+	std::copy(std::begin(id), std::end(id), p.begin() + 4);
+	p[21] = 0x04;				// root vector
+	p[43] = 0x02;				// framing vector
+	p[108] = 100;				// priority
+	p[111] = sequence;
+	p[113] = static_cast<uint8_t>(universe >> 8);
+	p[114] = static_cast<uint8_t>(universe);
+	p[117] = 0x02;				// DMP vector
+	p[118] = 0xA1;
+	p[122] = 1;
+	p[123] = static_cast<uint8_t>((data.size() + 1) >> 8);
+	p[124] = static_cast<uint8_t>(data.size() + 1);
+	std::copy(data.begin(), data.end(), p.begin() + 126);
+	return p;
+}
+
+static void decodeArtNet()
+{
+	DmxData dmx;
+	auto p = artNet(0x0123, 7, {255, 128, 0, 1});
+	CHECK(DmxDecoder::artNet(p.data(), p.size(), dmx));
+	CHECK_EQ(dmx.universe, 0x0123);
+	CHECK_EQ(dmx.length, 4u);
+	CHECK_EQ(dmx.data[0], 255);
+	CHECK_EQ(dmx.data[1], 128);
+	CHECK_EQ(dmx.sequence, 7);
+	CHECK(dmx.sequenced);
+
+	// sequence 0 - source does not number its frames
+	p = artNet(1, 0, {1, 2});
+	CHECK(DmxDecoder::artNet(p.data(), p.size(), dmx));
+	CHECK(!dmx.sequenced);
+
+	// short: header only, data length over the datagram
+	p = artNet(1, 1, {1, 2});
+	CHECK(!DmxDecoder::artNet(p.data(), 17, dmx));
+	CHECK(!DmxDecoder::artNet(p.data(), p.size() - 1, dmx));
+
+	// other opcode (OpPoll), bad ID, over 512 channels
+	p = artNet(1, 1, {1, 2});
+	p[9] = 0x20;
+	CHECK(!DmxDecoder::artNet(p.data(), p.size(), dmx));
+	p = artNet(1, 1, {1, 2});
+	p[0] = 'a';
+	CHECK(!DmxDecoder::artNet(p.data(), p.size(), dmx));
+	p = artNet(1, 1, std::vector<uint8_t>(514, 0));
+	CHECK(!DmxDecoder::artNet(p.data(), p.size(), dmx));
+}
+
+static void decodeSacn()
+{
+	DmxData dmx;
+	auto p = sacn(0x0102, 200, {10, 20, 30});
+	CHECK(DmxDecoder::sacn(p.data(), p.size(), dmx));
+	CHECK_EQ(dmx.universe, 0x0102);
+	CHECK_EQ(dmx.length, 3u);
+	CHECK_EQ(dmx.data[2], 30);
+	CHECK_EQ(dmx.sequence, 200);
+	CHECK(dmx.sequenced);
+
+	// short: below the header, property count over the datagram
+	CHECK(!DmxDecoder::sacn(p.data(), 125, dmx));
+	CHECK(!DmxDecoder::sacn(p.data(), p.size() - 1, dmx));
+
+	// stream terminated, non-zero start code, wrong vector
+	p = sacn(1, 1, {1});
+	p[112] = 0x40;
+	CHECK(!DmxDecoder::sacn(p.data(), p.size(), dmx));
+	p = sacn(1, 1, {1});
+	p[125] = 0xCC;
+	CHECK(!DmxDecoder::sacn(p.data(), p.size(), dmx));
+	p = sacn(1, 1, {1});
+	p[21] = 0x08;
+	CHECK(!DmxDecoder::sacn(p.data(), p.size(), dmx));
+}
+
+static void configure()
+{
+	Mapper m;
+	CHECK(m.configure(std::string("1/50/") + lampA + ":1:2," + lampB + ":3:4", frameUs));
+	CHECK_EQ(m.universe(), 1);
+	CHECK_EQ(m.lamps(), 2u);
+
+	CHECK(!m.configure("1/50/", frameUs));
+	CHECK(!m.configure("1/0/c21c009d1b000e:1:2", frameUs));
+	CHECK(!m.configure("x/50/c21c009d1b000e:1:2", frameUs));
+	CHECK(!m.configure("1/50/c21c009d1b000g:1:2", frameUs));
+	CHECK(!m.configure("1/50/c21c009d1b000e:0:2", frameUs));
+	CHECK(!m.configure("1/50/c21c009d1b000e:1:513", frameUs));
+}
+
+/// @brief Decoded packet into the mapper
+static bool feed(Mapper &m, const std::vector<uint8_t> &p, bool isArtNet = true)
+{
+	DmxData dmx;
+	if (!(isArtNet ? DmxDecoder::artNet(p.data(), p.size(), dmx) : DmxDecoder::sacn(p.data(), p.size(), dmx))) {
+		return false;
+	}
+	return m.update(dmx);
+}
+
+static void mapping()
+{
+	Mapper m;
+	CHECK(m.configure(std::string("1/100/") + lampA + ":1:2," + lampB + ":3:4", frameUs));
+	int64_t now = 1000000;
+	Mapper::Output out;
+
+	CHECK(feed(m, artNet(1, 1, {255, 0, 0, 128})));
+	CHECK(m.next(now, out));
+	CHECK(out.id == lamp::Packet::stringToID(lampA));
+	CHECK(out.on);
+	CHECK_EQ(out.intensity, 0x17);
+	CHECK_EQ(out.hue, 0x00);
+	CHECK(m.next(now, out));
+	CHECK(out.id == lamp::Packet::stringToID(lampB));
+	CHECK(!out.on);
+	CHECK(!m.next(now, out));
+
+	// same quantized value - nothing to send
+	CHECK(feed(m, artNet(1, 2, {254, 1, 0, 129})));
+	CHECK(!m.pending());
+
+	// wrong universe is ignored
+	CHECK(!feed(m, artNet(2, 3, {0, 0, 255, 255})));
+	CHECK(!m.pending());
+
+	// channel beyond the frame length - lamp B is left as is
+	CHECK(feed(m, artNet(1, 4, {0, 0})));
+	CHECK(m.next(now, out));
+	CHECK(out.id == lamp::Packet::stringToID(lampA));
+	CHECK(!out.on);
+	CHECK(!m.pending());
+}
+
+static void sequence()
+{
+	Mapper m;
+	CHECK(m.configure(std::string("1/100/") + lampA + ":1:2", frameUs));
+
+	CHECK(feed(m, sacn(1, 10, {255, 0}), false));
+	// duplicate & late frames up to 20 behind are dropped
+	CHECK(!feed(m, sacn(1, 10, {0, 0}), false));
+	CHECK(!feed(m, sacn(1, 9, {0, 0}), false));
+	CHECK(!feed(m, sacn(1, 247, {0, 0}), false));
+	CHECK(feed(m, sacn(1, 11, {255, 0}), false));
+	// wrap 255 -> 0
+	CHECK(feed(m, sacn(1, 120, {255, 0}), false));
+	CHECK(feed(m, sacn(1, 230, {255, 0}), false));
+	CHECK(feed(m, sacn(1, 255, {255, 0}), false));
+	CHECK(feed(m, sacn(1, 0, {255, 0}), false));
+	CHECK(!feed(m, sacn(1, 254, {0, 0}), false));
+	// big step back - restarted source
+	CHECK(feed(m, sacn(1, 200, {255, 0}), false));
+
+	// the late frame did not change the output
+	Mapper::Output out;
+	CHECK(m.next(1000000, out));
+	CHECK(out.on);
+
+	// Art-Net without sequence is always accepted
+	CHECK(feed(m, artNet(1, 0, {0, 0})));
+	CHECK(feed(m, artNet(1, 0, {255, 0})));
+	// reconfiguration forgets the sequence
+	CHECK(m.configure(std::string("1/100/") + lampA + ":1:2", frameUs));
+	CHECK(feed(m, sacn(1, 90, {255, 0}), false));
+}
+
+static void airtime()
+{
+	Mapper m;
+	CHECK(m.configure(std::string("1/50/") + lampA + ":1:2," + lampB + ":3:4", frameUs));
+	int64_t now = 1000000;
+	Mapper::Output out;
+	uint8_t seq = 1;
+
+	// burst budget 100 ms holds 7 frames, then 50 % duty cycle
+	int sent = 0;
+	for (int i = 0; i < 20; ++i) {
+		uint8_t v = static_cast<uint8_t>(i % 2 ? 255 : 20);
+		CHECK(feed(m, artNet(1, seq++, {v, v, v, v})));
+		while (m.next(now, out)) {
+			sent++;
+		}
+	}
+	CHECK_EQ(sent, 7);
+	CHECK(m.pending());
+	CHECK(m.waitUs() > 0);
+
+	// lamps are served round-robin
+	CHECK(feed(m, artNet(1, seq++, {128, 128, 128, 128})));
+	now += m.waitUs();
+	CHECK(m.next(now, out));
+	std::array<uint8_t, 7> first = out.id;
+	now += m.waitUs();
+	CHECK(m.next(now, out));
+	CHECK(out.id != first);
+	CHECK(!m.pending());
+	CHECK_EQ(m.waitUs(), 2u * frameUs);
+}
+
+int main()
+{
+	decodeArtNet();
+	decodeSacn();
+	configure();
+	mapping();
+	sequence();
+	airtime();
+	return testResult();
+}
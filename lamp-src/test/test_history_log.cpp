@@ -0,0 +1,299 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_history_log.cpp
+/// @author Petr Vanek
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <vector>
+#include "check.h"
+#include "history_ring.h"
+
+/// @brief NOR flash in RAM - writes clear bits only, erase sets whole blocks to 0xFF
+struct FakeFlash {
+	explicit FakeFlash(size_t blocks) : image(blocks * HistoryRing<FakeFlash>::_blockSize, 0xFF), erases(blocks, 0) {}
+
+	bool read(size_t offset, void *dst, size_t len)
+	{
+		if (offset + len > image.size()) {
+			return false;
+		}
+		readBlocks.insert(offset / HistoryRing<FakeFlash>::_blockSize);
+		memcpy(dst, &image[offset], len);
+		return true;
+	}
+
+	bool write(size_t offset, const void *src, size_t len)
+	{
+		if (offset + len > image.size()) {
+			return false;
+		}
+		const auto *p = static_cast<const uint8_t *>(src);
+		// power loss - only the first bytes reach the flash
+		const size_t n = tear ? std::min(tear, len) : len;
+		for (size_t i = 0; i < n; ++i) {
+			image[offset + i] &= p[i];
+		}
+		if (tear) {
+			tear = 0;
+			return false;
+		}
+		return true;
+	}
+
+	bool erase(size_t offset, size_t len)
+	{
+		if (offset + len > image.size()) {
+			return false;
+		}
+		std::fill_n(image.begin() + offset, len, 0xFF);
+		erases[offset / HistoryRing<FakeFlash>::_blockSize]++;
+		return true;
+	}
+
+	std::vector<uint8_t> image;
+	std::vector<size_t> erases;			///< per block
+	std::set<size_t> readBlocks;		///< blocks read since clear
+	size_t tear{0};						///< next write stops after the bytes, 0 - none
+};
+
+using Ring = HistoryRing<FakeFlash>;
+
+static constexpr size_t _slots{Ring::_slots};
+static constexpr uint32_t _noLimit{UINT32_MAX};
+
+static HistoryRecord record(uint32_t time, bool clock = false)
+{
+	HistoryRecord rec{};
+	rec.time = time;
+	rec.id = {0xC2, 0x1C, 0x00, 0x9D, 0x1B, 0x00, 0x0E};
+	rec.command = 1;
+	rec.intensity = time & 0x1F;
+	rec.hue = time % 0x18;
+	rec.flags = clock ? HistoryRecord::Clock : 0;
+	rec.check = Ring::check(rec);
+	return rec;
+}
+
+/// @brief Read everything from the cursor, small batches
+static std::vector<uint32_t> readAll(const Ring &ring, Ring::Cursor &cur, uint32_t from = 0, uint32_t to = _noLimit)
+{
+	std::vector<uint32_t> rc;
+	HistoryRecord batch[7];
+	size_t n;
+	while ((n = ring.read(cur, from, to, batch, 7)) > 0) {
+		for (size_t i = 0; i < n; ++i) {
+			rc.push_back(batch[i].time);
+		}
+	}
+	return rc;
+}
+
+static std::vector<uint32_t> sequence(uint32_t first, size_t count)
+{
+	std::vector<uint32_t> rc(count);
+	for (size_t i = 0; i < count; ++i) {
+		rc[i] = first + i;
+	}
+	return rc;
+}
+
+/// @brief Blank flash gets the first block, too small a ring is refused
+static void empty()
+{
+	FakeFlash small(1);
+	Ring none;
+	CHECK(!none.open(small, 1));
+	CHECK(!none.isOpen());
+	HistoryRecord out;
+	Ring::Cursor cur;
+	CHECK_EQ(none.read(cur, 0, _noLimit, &out, 1), 0u);
+	CHECK(!none.append(record(1)));
+
+	FakeFlash flash(4);
+	Ring ring;
+	CHECK(ring.open(flash, 4));
+	CHECK_EQ(ring.headSeq(), 1u);
+	CHECK_EQ(flash.erases[0], 1u);
+	CHECK_EQ(ring.read(cur, 0, _noLimit, &out, 1), 0u);
+
+	// more blocks than the index - the rest is unused
+	FakeFlash big(Ring::_maxBlocks + 4);
+	Ring limited;
+	CHECK(limited.open(big, Ring::_maxBlocks + 4));
+	CHECK_EQ(limited.blocks(), Ring::_maxBlocks);
+}
+
+/// @brief Records come back in write order, across blocks and after a reboot
+static void order()
+{
+	FakeFlash flash(4);
+	Ring ring;
+	CHECK(ring.open(flash, 4));
+	const size_t count = 2 * _slots + 90;
+	for (uint32_t i = 0; i < count; ++i) {
+		CHECK(ring.append(record(i)));
+	}
+	CHECK_EQ(ring.headSeq(), 3u);
+
+	Ring::Cursor cur;
+	CHECK(readAll(ring, cur) == sequence(0, count));
+
+	// index rebuilt from flash, appends continue in the head block
+	Ring again;
+	CHECK(again.open(flash, 4));
+	CHECK_EQ(again.headSeq(), 3u);
+	CHECK(again.append(record(count)));
+	CHECK_EQ(flash.erases[3], 0u);
+	Ring::Cursor cur2;
+	CHECK(readAll(again, cur2) == sequence(0, count + 1));
+}
+
+/// @brief A full ring overwrites its oldest block, blocks wear evenly
+static void wrap()
+{
+	FakeFlash flash(4);
+	Ring ring;
+	CHECK(ring.open(flash, 4));
+	const size_t count = 6 * _slots + 10;			// blocks 1 - 7, 4 kept
+	for (uint32_t i = 0; i < count; ++i) {
+		CHECK(ring.append(record(i)));
+	}
+	CHECK_EQ(ring.headSeq(), 7u);
+
+	Ring::Cursor cur;
+	CHECK(readAll(ring, cur) == sequence(3 * _slots, 3 * _slots + 10));
+	const auto wear = std::minmax_element(flash.erases.begin(), flash.erases.end());
+	CHECK(*wear.second - *wear.first <= 1);
+
+	// the head is the block with the newest sequence, not the last one in the partition
+	Ring again;
+	CHECK(again.open(flash, 4));
+	CHECK_EQ(again.headSeq(), 7u);
+	Ring::Cursor cur2;
+	CHECK(readAll(again, cur2) == sequence(3 * _slots, 3 * _slots + 10));
+}
+
+/// @brief A cursor continues with new records, from the oldest one when its block is gone
+static void cursor()
+{
+	FakeFlash flash(3);
+	Ring ring;
+	CHECK(ring.open(flash, 3));
+	for (uint32_t i = 0; i < 20; ++i) {
+		CHECK(ring.append(record(i)));
+	}
+
+	Ring::Cursor cur;
+	HistoryRecord batch[5];
+	CHECK_EQ(ring.read(cur, 0, _noLimit, batch, 5), 5u);
+	CHECK_EQ(batch[4].time, 4u);
+	CHECK(readAll(ring, cur) == sequence(5, 15));
+
+	// end of log, new records continue from there
+	for (uint32_t i = 20; i < 30; ++i) {
+		CHECK(ring.append(record(i)));
+	}
+	CHECK(readAll(ring, cur) == sequence(20, 10));
+
+	// the block under the cursor is overwritten
+	Ring::Cursor stale;
+	CHECK_EQ(ring.read(stale, 0, _noLimit, batch, 5), 5u);
+	for (uint32_t i = 30; i < 3 * _slots + 5; ++i) {
+		CHECK(ring.append(record(i)));
+	}
+	CHECK(readAll(ring, stale) == sequence(_slots, 2 * _slots + 5));
+}
+
+/// @brief Time range - unix time records only, blocks outside the range are not read
+static void range()
+{
+	FakeFlash flash(4);
+	Ring ring;
+	CHECK(ring.open(flash, 4));
+	// uptime records before SNTP, then unix time
+	for (uint32_t i = 0; i < 50; ++i) {
+		CHECK(ring.append(record(i)));
+	}
+	const uint32_t t0 = 1700000000;
+	for (uint32_t i = 50; i < 3 * _slots; ++i) {
+		CHECK(ring.append(record(t0 + i, true)));
+	}
+
+	Ring::Cursor cur;
+	CHECK(readAll(ring, cur, t0 + 100, t0 + 199) == sequence(t0 + 100, 100));
+
+	// the last block only
+	flash.readBlocks.clear();
+	Ring::Cursor last;
+	CHECK(readAll(ring, last, t0 + 2 * _slots + 10, _noLimit) == sequence(t0 + 2 * _slots + 10, _slots - 10));
+	CHECK(flash.readBlocks == std::set<size_t>{2});
+
+	// uptime records are not on the time line
+	Ring::Cursor open;
+	CHECK(readAll(ring, open, 1, t0 + 60) == sequence(t0 + 50, 11));
+
+	// out of range
+	flash.readBlocks.clear();
+	Ring::Cursor none;
+	CHECK(readAll(ring, none, t0 + 10 * _slots, _noLimit).empty());
+	CHECK(flash.readBlocks.empty());
+
+	// without a range all records, uptime ones included
+	Ring::Cursor all;
+	CHECK_EQ(readAll(ring, all).size(), 3 * _slots);
+}
+
+/// @brief Torn writes are skipped by the check byte, the slot stays used
+static void torn()
+{
+	FakeFlash flash(3);
+	Ring ring;
+	CHECK(ring.open(flash, 3));
+	CHECK(ring.append(record(1)));
+	flash.tear = 6;
+	CHECK(!ring.append(record(2)));
+	CHECK(ring.append(record(3)));
+	flash.tear = sizeof(HistoryRecord) - 1;			// all but the check byte
+	CHECK(!ring.append(record(4)));
+	CHECK(ring.append(record(5)));
+
+	Ring::Cursor cur;
+	CHECK(readAll(ring, cur) == (std::vector<uint32_t>{1, 3, 5}));
+
+	// the scan after a reboot keeps the slots, the next record goes after them
+	Ring again;
+	CHECK(again.open(flash, 3));
+	CHECK(again.append(record(6)));
+	Ring::Cursor cur2;
+	CHECK(readAll(again, cur2) == (std::vector<uint32_t>{1, 3, 5, 6}));
+
+	// corrupted record in flash
+	flash.image[sizeof(HistoryRecord)] = 0x00;		// time of the first record, block 0 after the header
+	Ring::Cursor cur3;
+	CHECK(readAll(again, cur3) == (std::vector<uint32_t>{3, 5, 6}));
+
+	// torn header - the erased block is reused, the ring starts again
+	FakeFlash blank(3);
+	Ring fresh;
+	blank.tear = 2;
+	CHECK(!fresh.open(blank, 3));
+	CHECK(fresh.open(blank, 3));
+	CHECK(fresh.append(record(7)));
+	Ring::Cursor cur4;
+	CHECK(readAll(fresh, cur4) == (std::vector<uint32_t>{7}));
+}
+
+int main()
+{
+	empty();
+	order();
+	wrap();
+	cursor();
+	range();
+	torn();
+	return testResult();
+}
@@ -0,0 +1,65 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_http_request.cpp
+/// @author Petr Vanek
+
+#include "check.h"
+#include "http_request.h"
+
+static std::string value(const std::string &body, const std::string &key)
+{
+	return HttpReqest::getValue(HttpReqest::parseFormData(body), key);
+}
+
+static void pairs()
+{
+	auto form = HttpReqest::parseFormData("ssid=home&pass=secret&mqtt=");
+	CHECK_EQ(form.size(), 3u);
+	CHECK_EQ(HttpReqest::getValue(form, "ssid"), std::string("home"));
+	CHECK_EQ(HttpReqest::getValue(form, "pass"), std::string("secret"));
+	// empty value & missing key
+	CHECK(form.count("mqtt") == 1);
+	CHECK_EQ(HttpReqest::getValue(form, "mqtt"), std::string(""));
+	CHECK_EQ(HttpReqest::getValue(form, "ip"), std::string(""));
+}
+
+static void separators()
+{
+	// no '=' - skipped, empty pairs - skipped, empty key is a key
+	auto form = HttpReqest::parseFormData("flag&&a=1&=v&");
+	CHECK_EQ(form.size(), 2u);
+	CHECK_EQ(HttpReqest::getValue(form, "a"), std::string("1"));
+	CHECK_EQ(HttpReqest::getValue(form, ""), std::string("v"));
+
+	// '=' in the value belongs to the value, the last duplicate wins
+	CHECK_EQ(value("k=a=b", "k"), std::string("a=b"));
+	CHECK_EQ(value("k=1&k=2", "k"), std::string("2"));
+	CHECK(HttpReqest::parseFormData("").empty());
+}
+
+static void decoding()
+{
+	CHECK_EQ(value("s=My+Home+Net", "s"), std::string("My Home Net"));
+	CHECK_EQ(value("s=a%21b%3Dc%26d", "s"), std::string("a!b=c&d"));
+	CHECK_EQ(value("s=%c3%a1", "s"), std::string("\xc3\xa1"));
+	CHECK_EQ(value("s=%2B", "s"), std::string("+"));
+
+	// truncated & invalid escapes are kept as they are
+	CHECK_EQ(value("s=100%", "s"), std::string("100%"));
+	CHECK_EQ(value("s=%4", "s"), std::string("%4"));
+	CHECK_EQ(value("s=%4&t=1", "s"), std::string("%4"));
+	CHECK_EQ(value("s=%G1", "s"), std::string("%G1"));
+
+	// keys are not decoded
+	CHECK_EQ(value("a+b=1", "a+b"), std::string("1"));
+}
+
+int main()
+{
+	pairs();
+	separators();
+	decoding();
+	return testResult();
+}
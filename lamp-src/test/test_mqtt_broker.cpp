@@ -0,0 +1,511 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_mqtt_broker.cpp
+/// @author Petr Vanek
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "check.h"
+#include "mqtt_protocol.h"
+
+/// MQTT round trip through a local Mosquitto - retained state, commands from the set
+/// topic, availability & last will, with the topics and payloads of MqttTask.
+///
+///     test_mqtt_broker <path to mosquitto>
+///
+/// Without the broker path the test exits with 77, CTest reports it as skipped.
+
+using lamp::MqttProtocol;
+using lamp::MqttRequest;
+using lamp::MqttRequestSlot;
+
+static constexpr int _skipped{77};
+static constexpr int _waitMs{2000};		///< max. wait for a broker reply
+
+static const std::string _dev{"lamp_test01"};
+static const std::string _topicState{"lamp/" + _dev + "/state"};
+static const std::string _topicSet{"lamp/" + _dev + "/set"};
+static const std::string _topicAvail{"lamp/" + _dev + "/availability"};
+static const char *_lampId{"c21c009d1b000e"};
+
+/// @brief Free loopback port, the broker binds it
+static uint16_t freePort()
+{
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	if (sock < 0 || bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0 ||
+		getsockname(sock, reinterpret_cast<struct sockaddr *>(&addr), &len) != 0) {
+		std::abort();
+	}
+	close(sock);
+	return ntohs(addr.sin_port);
+}
+
+static int connectTo(uint16_t port)
+{
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (sock >= 0 && connect(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == 0) {
+		int one = 1;
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		return sock;
+	}
+	if (sock >= 0) {
+		close(sock);
+	}
+	return -1;
+}
+
+/// @brief Mosquitto child process on a free loopback port
+class Broker
+{
+public:
+	explicit Broker(const char *path) : _port(freePort())
+	{
+		_pid = fork();
+		if (_pid == 0) {
+			int null = open("/dev/null", O_WRONLY);
+			dup2(null, STDOUT_FILENO);
+			dup2(null, STDERR_FILENO);
+			const std::string port = std::to_string(_port);
+			execl(path, path, "-p", port.c_str(), static_cast<char *>(nullptr));
+			_exit(127);
+		}
+	}
+
+	~Broker()
+	{
+		if (_pid > 0) {
+			kill(_pid, SIGTERM);
+			waitpid(_pid, nullptr, 0);
+		}
+	}
+
+	/// @brief Wait until the broker accepts connections
+	bool ready() const
+	{
+		for (int i = 0; i < 100 && _pid > 0; ++i) {
+			int sock = connectTo(_port);
+			if (sock >= 0) {
+				close(sock);
+				return true;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		}
+		return false;
+	}
+
+	uint16_t port() const { return _port; }
+
+private:
+	uint16_t _port;
+	pid_t _pid{-1};
+};
+
+/// @brief Received PUBLISH
+struct Message {
+	std::string topic;
+	std::string payload;
+	bool retained{false};
+};
+
+/// @brief Minimal MQTT 3.1.1 client - QoS 0/1, retain, last will, no reconnect
+class Client
+{
+public:
+	~Client()
+	{
+		drop();
+	}
+
+	/// @brief Connect with a clean session
+	/// @param willTopic last will, empty - none
+	bool open(uint16_t port, const std::string &id, const std::string &willTopic = {}, const std::string &willMsg = {})
+	{
+		_sock = connectTo(port);
+		if (_sock < 0) {
+			return false;
+		}
+		std::string body;
+		addString(body, "MQTT");
+		body += static_cast<char>(4);							// protocol level 3.1.1
+		uint8_t flags = 0x02;									// clean session
+		if (!willTopic.empty()) {
+			flags |= 0x04 | 0x08 | 0x20;						// will, QoS 1, retain
+		}
+		body += static_cast<char>(flags);
+		body += std::string("\x00\x3C", 2);						// keep alive 60 s
+		addString(body, id);
+		if (!willTopic.empty()) {
+			addString(body, willTopic);
+			addString(body, willMsg);
+		}
+		uint8_t type;
+		std::string reply;
+		return send(0x10, body) && read(type, reply) && type == 0x20 && reply.size() == 2 && reply[1] == 0;
+	}
+
+	bool subscribe(const std::string &filter)
+	{
+		std::string body;
+		addId(body);
+		addString(body, filter);
+		body += static_cast<char>(0);							// QoS 0
+		uint8_t type;
+		std::string reply;
+		return send(0x82, body) && read(type, reply) && type == 0x90 && reply.size() == 3 && reply[2] == 0;
+	}
+
+	/// @brief Publish, QoS 1 waits for PUBACK
+	bool publish(const std::string &topic, const std::string &payload, bool retain, int qos = 0)
+	{
+		std::string body;
+		addString(body, topic);
+		if (qos) {
+			addId(body);
+		}
+		body += payload;
+		if (!send(static_cast<uint8_t>(0x30 | (qos << 1) | (retain ? 1 : 0)), body)) {
+			return false;
+		}
+		uint8_t type;
+		std::string reply;
+		return qos == 0 || (read(type, reply) && type == 0x40);
+	}
+
+	/// @brief Next PUBLISH
+	/// @param ms max. wait
+	bool receive(Message &msg, int ms = _waitMs)
+	{
+		uint8_t type;
+		std::string body;
+		while (read(type, body, ms)) {
+			if ((type & 0xF0) != 0x30 || body.size() < 2) {
+				continue;
+			}
+			const size_t len = (static_cast<uint8_t>(body[0]) << 8) | static_cast<uint8_t>(body[1]);
+			const int qos = (type >> 1) & 0x03;
+			size_t pos = 2 + len + (qos ? 2 : 0);
+			if (pos > body.size()) {
+				return false;
+			}
+			msg.topic = body.substr(2, len);
+			msg.payload = body.substr(pos);
+			msg.retained = type & 0x01;
+			if (qos == 1) {
+				send(0x40, body.substr(2 + len, 2));
+			}
+			return true;
+		}
+		return false;
+	}
+
+	/// @brief Next PUBLISH of the topic, others are skipped
+	bool receive(const std::string &topic, Message &msg, int ms = _waitMs)
+	{
+		while (receive(msg, ms)) {
+			if (msg.topic == topic) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/// @brief Clean disconnect, the broker drops the last will
+	void disconnect()
+	{
+		if (_sock >= 0) {
+			send(0xE0, {});
+			drop();
+		}
+	}
+
+	/// @brief Connection lost - no DISCONNECT, the broker publishes the last will
+	void drop()
+	{
+		if (_sock >= 0) {
+			close(_sock);
+			_sock = -1;
+		}
+	}
+
+private:
+	static void addString(std::string &out, const std::string &s)
+	{
+		out += static_cast<char>(s.size() >> 8);
+		out += static_cast<char>(s.size() & 0xFF);
+		out += s;
+	}
+
+	void addId(std::string &out)
+	{
+		++_id;
+		out += static_cast<char>(_id >> 8);
+		out += static_cast<char>(_id & 0xFF);
+	}
+
+	bool send(uint8_t type, const std::string &body)
+	{
+		std::string packet(1, static_cast<char>(type));
+		size_t len = body.size();
+		do {
+			uint8_t digit = len % 128;
+			len /= 128;
+			packet += static_cast<char>(len ? digit | 0x80 : digit);
+		} while (len);
+		packet += body;
+		return ::send(_sock, packet.data(), packet.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(packet.size());
+	}
+
+	bool readBytes(void *out, size_t n, int ms)
+	{
+		auto *p = static_cast<char *>(out);
+		const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+		while (n) {
+			const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(end - std::chrono::steady_clock::now()).count();
+			struct pollfd pfd = {_sock, POLLIN, 0};
+			if (left <= 0 || poll(&pfd, 1, static_cast<int>(left)) <= 0) {
+				return false;
+			}
+			ssize_t got = recv(_sock, p, n, 0);
+			if (got <= 0) {
+				return false;
+			}
+			p += got;
+			n -= got;
+		}
+		return true;
+	}
+
+	bool read(uint8_t &type, std::string &body, int ms = _waitMs)
+	{
+		if (_sock < 0 || !readBytes(&type, 1, ms)) {
+			return false;
+		}
+		size_t len = 0;
+		for (int shift = 0; shift < 28; shift += 7) {
+			uint8_t digit;
+			if (!readBytes(&digit, 1, ms)) {
+				return false;
+			}
+			len |= static_cast<size_t>(digit & 0x7F) << shift;
+			if (!(digit & 0x80)) {
+				break;
+			}
+		}
+		body.resize(len);
+		return len == 0 || readBytes(&body[0], len, ms);
+	}
+
+	int _sock{-1};
+	uint16_t _id{0};
+};
+
+/// @brief Lamp side - the MQTT part of MqttTask, LC12STask replaced by a state
+class Lamp
+{
+public:
+	/// @brief Connect like MqttTask::start() & the connected event
+	bool start(uint16_t port)
+	{
+		return _client.open(port, _dev, _topicAvail, "offline") && _client.subscribe(_topicSet) &&
+			   _client.publish(_topicAvail, "online", true, 1) && publishState();
+	}
+
+	/// @brief Commands queued by the broker, then one apply - the batch of MqttTask
+	/// @param count commands to receive
+	bool serve(size_t count)
+	{
+		Message msg;
+		for (size_t i = 0; i < count; ++i) {
+			if (!_client.receive(_topicSet, msg)) {
+				return false;
+			}
+			MqttRequest r;
+			if (MqttProtocol::parseCommand(msg.payload.data(), msg.payload.size(), r)) {
+				_slot.put(r);
+			}
+		}
+
+		MqttRequest r;
+		uint32_t seq;
+		if (_slot.take(r, seq)) {
+			_on = r.on;
+			if (r.on && r.intensity >= 0) {
+				_intensity = static_cast<uint8_t>(r.intensity);
+			}
+			if (r.on && r.hue >= 0) {
+				_hue = static_cast<uint8_t>(r.hue);
+			}
+			_slot.applied(seq);
+			_applied++;
+		}
+		return publishState();
+	}
+
+	/// @brief Like MqttTask::stop()
+	void stop()
+	{
+		_client.publish(_topicAvail, "offline", true, 1);
+		_client.disconnect();
+	}
+
+	void crash()
+	{
+		_client.drop();
+	}
+
+	std::string state() const
+	{
+		char buf[128];
+		size_t len = MqttProtocol::statePayload(buf, sizeof(buf), _on, _intensity, _hue, _lampId);
+		return std::string(buf, len);
+	}
+
+	size_t applied() const { return _applied; }
+
+private:
+	bool publishState()
+	{
+		return _client.publish(_topicState, state(), true);
+	}
+
+	Client _client;
+	MqttRequestSlot _slot;
+	bool _on{false};
+	uint8_t _intensity{0x10};
+	uint8_t _hue{0x00};
+	size_t _applied{0};
+};
+
+/// @brief A late subscriber gets the retained availability & state
+static void retained(const Broker &broker)
+{
+	Lamp lamp;
+	CHECK(lamp.start(broker.port()));
+
+	Client ha;
+	CHECK(ha.open(broker.port(), "ha_retained"));
+	CHECK(ha.subscribe("lamp/" + _dev + "/+"));
+	Message avail, state;
+	CHECK(ha.receive(_topicAvail, avail));
+	CHECK_EQ(avail.payload, std::string("online"));
+	CHECK(avail.retained);
+
+	Client ha2;
+	CHECK(ha2.open(broker.port(), "ha_state"));
+	CHECK(ha2.subscribe(_topicState));
+	CHECK(ha2.receive(_topicState, state));
+	CHECK_EQ(state.payload, lamp.state());
+	CHECK(state.retained);
+	CHECK(state.payload.find("\"state\":\"OFF\"") != std::string::npos);
+	lamp.stop();
+}
+
+/// @brief Commands through the broker, merged in the slot, the newest state is published
+static void commands(const Broker &broker)
+{
+	Lamp lamp;
+	CHECK(lamp.start(broker.port()));
+
+	Client ha;
+	CHECK(ha.open(broker.port(), "ha_commands"));
+	CHECK(ha.subscribe(_topicState));
+	Message msg;
+	CHECK(ha.receive(_topicState, msg));
+
+	// burst - brightness then color_temp alone, a malformed one between them
+	CHECK(ha.publish(_topicSet, "{\"state\":\"ON\",\"brightness\":3}", false));
+	CHECK(ha.publish(_topicSet, "{\"brightness\":9}", false));
+	CHECK(ha.publish(_topicSet, "{\"brightness\":", false));
+	CHECK(ha.publish(_topicSet, "{\"color_temp\":300}", false));
+	CHECK(lamp.serve(4));
+	CHECK_EQ(lamp.applied(), 1u);
+
+	CHECK(ha.receive(_topicState, msg));
+	CHECK(!msg.retained);			// live delivery
+	CHECK_EQ(msg.payload, lamp.state());
+	CHECK(msg.payload.find("\"state\":\"ON\",\"brightness\":9") != std::string::npos);
+	char mireds[32];
+	snprintf(mireds, sizeof(mireds), "\"color_temp\":%d", MqttProtocol::hueToMireds(MqttProtocol::miredsToHue(300)));
+	CHECK(msg.payload.find(mireds) != std::string::npos);
+
+	// OFF replaces the pending ON
+	CHECK(ha.publish(_topicSet, "{\"brightness\":20}", false, 1));
+	CHECK(ha.publish(_topicSet, "{\"state\":\"OFF\"}", false, 1));
+	CHECK(lamp.serve(2));
+	CHECK(ha.receive(_topicState, msg));
+	CHECK(msg.payload.find("\"state\":\"OFF\"") != std::string::npos);
+	CHECK(msg.payload.find("\"brightness\":9") != std::string::npos);
+	lamp.stop();
+}
+
+/// @brief Availability - offline by the client on stop, by the broker (last will) on a lost link
+static void availability(const Broker &broker)
+{
+	Client ha;
+	CHECK(ha.open(broker.port(), "ha_availability"));
+	CHECK(ha.subscribe(_topicAvail));
+	Message msg;
+	// retained by stop() of the previous test
+	CHECK(ha.receive(_topicAvail, msg));
+	CHECK_EQ(msg.payload, std::string("offline"));
+
+	Lamp lamp;
+	CHECK(lamp.start(broker.port()));
+	CHECK(ha.receive(_topicAvail, msg));
+	CHECK_EQ(msg.payload, std::string("online"));
+
+	lamp.crash();
+	CHECK(ha.receive(_topicAvail, msg));
+	CHECK_EQ(msg.payload, std::string("offline"));
+
+	// the will is retained too
+	Client late;
+	CHECK(late.open(broker.port(), "ha_late"));
+	CHECK(late.subscribe(_topicAvail));
+	CHECK(late.receive(_topicAvail, msg));
+	CHECK_EQ(msg.payload, std::string("offline"));
+	CHECK(msg.retained);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2 || argv[1][0] == '\0') {
+		std::printf("mosquitto not found, skipped\n");
+		return _skipped;
+	}
+
+	Broker broker(argv[1]);
+	if (!broker.ready()) {
+		std::fprintf(stderr, "%s does not start\n", argv[1]);
+		return 1;
+	}
+
+	retained(broker);
+	commands(broker);
+	availability(broker);
+	return testResult();
+}
@@ -0,0 +1,219 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_mqtt_protocol.cpp
+/// @author Petr Vanek
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include "check.h"
+#include "mqtt_protocol.h"
+
+using lamp::MqttProtocol;
+using lamp::MqttRequest;
+using lamp::MqttRequestSlot;
+
+static bool parse(const std::string &json, MqttRequest &r)
+{
+	r = MqttRequest{};
+	return MqttProtocol::parseCommand(json.data(), json.size(), r);
+}
+
+static void command()
+{
+	MqttRequest r;
+	CHECK(parse("{\"state\": \"ON\", \"brightness\": 12, \"color_temp\": 300}", r));
+	CHECK(r.valid);
+	CHECK(r.on);
+	CHECK_EQ(r.intensity, 12);
+	CHECK_EQ(r.hue, MqttProtocol::miredsToHue(300));
+
+	CHECK(parse("{\"state\":\"OFF\"}", r));
+	CHECK(r.valid);
+	CHECK(!r.on);
+	CHECK_EQ(r.intensity, -1);
+	CHECK_EQ(r.hue, -1);
+
+	// brightness or color_temp switch ON, whatever the key order
+	CHECK(parse("{\"brightness\":5,\"state\":\"OFF\"}", r));
+	CHECK(r.on);
+	CHECK_EQ(r.intensity, 5);
+	CHECK(parse("{ \"color_temp\" : 500 }", r));
+	CHECK(r.on);
+	CHECK_EQ(r.hue, 0x00);
+	CHECK_EQ(r.intensity, -1);
+
+	// brightness clamped to 0 - 23, fractions truncated
+	CHECK(parse("{\"brightness\":255}", r));
+	CHECK_EQ(r.intensity, 0x17);
+	CHECK(parse("{\"brightness\":-4}", r));
+	CHECK_EQ(r.intensity, 0);
+	CHECK(parse("{\"brightness\":7.9}", r));
+	CHECK_EQ(r.intensity, 7);
+
+	// unknown keys ignored
+	CHECK(parse("{\"transition\":2,\"effect\":\"none\",\"flash\":null,\"x\":true,\"state\":\"ON\"}", r));
+	CHECK(r.valid);
+	CHECK(r.on);
+	CHECK(parse("{\"transition\":2}", r));
+	CHECK(!r.valid);
+	CHECK(parse("{}", r));
+	CHECK(!r.valid);
+}
+
+static void malformed()
+{
+	MqttRequest r;
+	CHECK(!parse("", r));
+	CHECK(!parse("ON", r));
+	CHECK(!parse("{\"state\":\"ON\"", r));
+	CHECK(!parse("{\"state\" \"ON\"}", r));
+	CHECK(!parse("{state:\"ON\"}", r));
+	CHECK(!parse("{\"brightness\":}", r));
+	CHECK(!parse("{\"brightness\":1x}", r));
+	CHECK(!parse("{\"color\":{\"r\":1}}", r));
+	CHECK(!parse("{\"state\":\"O\\\"N\"}", r));
+
+	// payload is not terminated
+	const char payload[] = "{\"brightness\":12}99";
+	r = MqttRequest{};
+	CHECK(MqttProtocol::parseCommand(payload, strlen(payload) - 2, r));
+	CHECK_EQ(r.intensity, 12);
+	r = MqttRequest{};
+	CHECK(!MqttProtocol::parseCommand(payload, 14, r));
+}
+
+static void state()
+{
+	char buf[128];
+	size_t len = MqttProtocol::statePayload(buf, sizeof(buf), true, 0x17, 0x00, "c21c009d1b000e");
+	CHECK_EQ(std::string(buf, len),
+			 std::string("{\"state\":\"ON\",\"brightness\":23,\"color_temp\":500,\"color_mode\":\"color_temp\",\"id\":\"c21c009d1b000e\"}"));
+	len = MqttProtocol::statePayload(buf, sizeof(buf), false, 0, 0x17, "c21c009d1b000e");
+	CHECK(std::string(buf, len).find("\"state\":\"OFF\",\"brightness\":0,\"color_temp\":153") != std::string::npos);
+
+	// too small - nothing to publish
+	CHECK_EQ(MqttProtocol::statePayload(buf, 64, true, 1, 1, "c21c009d1b000e"), 0u);
+}
+
+static void mireds()
+{
+	CHECK_EQ(MqttProtocol::miredsToHue(MqttProtocol::_miredsWarm), 0x00);
+	CHECK_EQ(MqttProtocol::miredsToHue(MqttProtocol::_miredsCold), 0x17);
+	CHECK_EQ(MqttProtocol::miredsToHue(1000), 0x00);
+	CHECK_EQ(MqttProtocol::miredsToHue(0), 0x17);
+	for (uint8_t hue = 0; hue <= 0x17; ++hue) {
+		CHECK_EQ(MqttProtocol::miredsToHue(MqttProtocol::hueToMireds(hue)), hue);
+	}
+}
+
+static MqttRequest request(bool on, int intensity, int hue, int64_t recvUs)
+{
+	MqttRequest r;
+	r.valid = true;
+	r.on = on;
+	r.intensity = intensity;
+	r.hue = hue;
+	r.recvUs = recvUs;
+	return r;
+}
+
+static void slot()
+{
+	MqttRequestSlot s;
+	MqttRequest r;
+	uint32_t seq;
+	CHECK(!s.take(r, seq));
+
+	// invalid command is not stored
+	s.put(MqttRequest{});
+	CHECK(!s.take(r, seq));
+
+	// brightness alone keeps the pending color_temp & the oldest receive time
+	s.put(request(true, -1, 3, 100));
+	s.put(request(true, 9, -1, 200));
+	CHECK(s.take(r, seq));
+	CHECK_EQ(r.intensity, 9);
+	CHECK_EQ(r.hue, 3);
+	CHECK_EQ(r.recvUs, 100);
+	s.applied(seq);
+	CHECK(!s.take(r, seq));
+
+	// OFF replaces the pending command
+	s.put(request(true, 9, 3, 300));
+	s.put(request(false, -1, -1, 400));
+	CHECK(s.take(r, seq));
+	CHECK(!r.on);
+	CHECK_EQ(r.recvUs, 400);
+	s.applied(seq);
+
+	// command received while the taken one is queued stays pending
+	s.put(request(true, 1, -1, 500));
+	CHECK(s.take(r, seq));
+	s.put(request(false, -1, -1, 600));
+	s.applied(seq);
+	CHECK(s.take(r, seq));
+	CHECK(!r.on);
+	CHECK_EQ(r.recvUs, 600);
+	s.applied(seq);
+	CHECK(!s.take(r, seq));
+
+	// the same command again is a new one
+	s.put(request(true, 1, 1, 700));
+	CHECK(s.take(r, seq));
+	s.put(request(true, 1, 1, 700));
+	s.applied(seq);
+	CHECK(s.take(r, seq));
+
+	s.clear();
+	CHECK(!s.take(r, seq));
+}
+
+/// @brief Event handler thread against the applying task - the last command is never lost
+static void race()
+{
+	MqttRequestSlot s;
+	std::atomic<bool> done{false};
+	constexpr int commands = 20000;
+
+	std::thread handler([&]() {
+		for (int i = 1; i <= commands; ++i) {
+			s.put(request(true, i % 24, -1, i));
+		}
+		done = true;
+	});
+
+	MqttRequest r;
+	uint32_t seq;
+	int64_t last = 0;
+	int intensity = -1;
+	bool ordered = true;
+	while (!done || s.take(r, seq)) {
+		if (s.take(r, seq)) {
+			ordered = ordered && r.recvUs >= last;
+			last = r.recvUs;
+			intensity = r.intensity;
+			s.applied(seq);
+		}
+	}
+	handler.join();
+
+	CHECK(ordered);
+	// the newest command was applied last
+	CHECK(!s.take(r, seq));
+	CHECK_EQ(intensity, commands % 24);
+}
+
+int main()
+{
+	command();
+	malformed();
+	state();
+	mireds();
+	slot();
+	race();
+	return testResult();
+}
@@ -0,0 +1,110 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_packet.cpp
+/// @author Petr Vanek
+
+#include "check.h"
+#include "packet.h"
+
+using lamp::Packet;
+
+static const std::array<uint8_t, 7> _id{0xC2, 0x1C, 0x00, 0x9D, 0x1B, 0x00, 0x0E};
+
+/// @brief Frames from the lamp remote (packet.h)
+static void encodeKnownFrames()
+{
+	Packet on;
+	on.prepare();
+	on.setIdentification(_id);
+	on.setCommand(Packet::Command::On);
+	on.setIntensity(0x17);
+	on.setYellow2White(0x0E);
+	on.computeChecksum();
+	const std::array<uint8_t, 13> onFrame{0x53, 0xC2, 0x1C, 0x00, 0x9D, 0x1B, 0x00, 0x0E, 0x01, 0x17, 0x0E, 0x26, 0x00};
+	CHECK(on.getContnet() == onFrame);
+	CHECK(on.validateChecksum());
+
+	// Off forces 0x10 into intensity & hue
+	Packet off;
+	off.prepare();
+	off.setIdentification(_id);
+	off.setIntensity(0x17);
+	off.setCommand(Packet::Command::Off);
+	off.computeChecksum();
+	const std::array<uint8_t, 13> offFrame{0x53, 0xC2, 0x1C, 0x00, 0x9D, 0x1B, 0x00, 0x0E, 0x10, 0x10, 0x10, 0x30, 0x00};
+	CHECK(off.getContnet() == offFrame);
+}
+
+static void checksum()
+{
+	Packet p;
+	p.prepare();
+	p.setCommand(Packet::Command::On);
+	p.setIntensity(0xF0);
+	p.setYellow2White(0x20);
+	p.computeChecksum();
+	// 8 bit sum wraps
+	CHECK_EQ(p.getContnet()[11], 0x11);
+	CHECK(p.validateChecksum());
+
+	p.setChSum(0x12);
+	CHECK(!p.validateChecksum());
+
+	// ID & head are not covered
+	p.computeChecksum();
+	p.setIdentification(_id);
+	p.setHead(0x00);
+	CHECK(p.validateChecksum());
+}
+
+static void commands()
+{
+	Packet p;
+	p.setCommand(Packet::Command::On);
+	CHECK(p.getCommnad() == Packet::Command::On);
+	p.setCommand(Packet::Command::Automatic);
+	CHECK(p.getCommnad() == Packet::Command::Automatic);
+	p.setCommand(Packet::Command::Startup);
+	CHECK(p.getCommnad() == Packet::Command::Unknown);
+}
+
+static void identification()
+{
+	CHECK_EQ(Packet::arrayToString(_id), std::string("c21c009d1b000e"));
+	CHECK(Packet::stringToID("c21c009d1b000e") == _id);
+	CHECK(Packet::stringToID("C21C009D1B000E") == _id);
+
+	// short string - missing bytes are 0
+	const std::array<uint8_t, 7> shortId{0xC2, 0x1C, 0, 0, 0, 0, 0};
+	CHECK(Packet::stringToID("c21c") == shortId);
+	CHECK(Packet::stringToID("") == (std::array<uint8_t, 7>{}));
+
+	Packet p;
+	p.setIdentification(std::string("c21c009d1b000e"));
+	CHECK(p.getIdentification() == _id);
+	CHECK_EQ(p.getMagic(), 0x0E);
+}
+
+static void setByte()
+{
+	Packet p;
+	for (size_t i = 0; i < 13; ++i) {
+		p.setByte(i, static_cast<uint8_t>(i + 1));
+	}
+	// out of range is ignored
+	p.setByte(13, 0xFF);
+	CHECK_EQ(p.getContnet()[0], 1);
+	CHECK_EQ(p.getContnet()[12], 13);
+}
+
+int main()
+{
+	encodeKnownFrames();
+	checksum();
+	commands();
+	identification();
+	setByte();
+	return testResult();
+}
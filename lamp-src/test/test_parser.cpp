@@ -0,0 +1,137 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_parser.cpp
+/// @author Petr Vanek
+
+#include <vector>
+#include "check.h"
+#include "parser.h"
+
+using lamp::Packet;
+using lamp::PacketParser;
+
+static Packet frame(uint8_t intensity, uint8_t hue)
+{
+	Packet p;
+	p.prepare();
+	p.setIdentification(std::array<uint8_t, 7>{0xC2, 0x1C, 0x00, 0x9D, 0x1B, 0x00, 0x0E});
+	p.setCommand(Packet::Command::On);
+	p.setIntensity(intensity);
+	p.setYellow2White(hue);
+	p.computeChecksum();
+	return p;
+}
+
+/// @brief Feed bytes, count completed frames
+static int feed(PacketParser &prs, const std::vector<uint8_t> &bytes)
+{
+	int frames = 0;
+	for (auto b : bytes) {
+		frames += prs.parseByte(b) ? 1 : 0;
+	}
+	return frames;
+}
+
+static std::vector<uint8_t> bytes(const Packet &p)
+{
+	return std::vector<uint8_t>(p.getContnet().begin(), p.getContnet().end());
+}
+
+/// @brief Encode & parse gives the same frame, complete only with the last byte
+static void roundTrip()
+{
+	PacketParser prs;
+	const auto p = frame(0x17, 0x0E);
+	const auto &data = p.getContnet();
+	for (size_t i = 0; i < data.size() - 1; ++i) {
+		CHECK(!prs.parseByte(data[i]));
+	}
+	CHECK(prs.parseByte(data.back()));
+	CHECK(prs.getPacket().getContnet() == data);
+	CHECK_EQ(prs.errors(), 0u);
+
+	// back to back frames
+	const auto q = frame(0x05, 0x03);
+	CHECK_EQ(feed(prs, bytes(q)), 1);
+	CHECK(prs.getPacket().getContnet() == q.getContnet());
+}
+
+/// @brief Anything but the head is skipped while waiting for a frame
+static void waitingForHead()
+{
+	PacketParser prs;
+	CHECK_EQ(feed(prs, {0x00, 0xFF, 0x10, 0x52, 0x54}), 0);
+	CHECK_EQ(prs.errors(), 0u);
+	CHECK_EQ(feed(prs, bytes(frame(1, 2))), 1);
+}
+
+/// @brief ID (1 - 7), data (8 - 10), checksum (11) & end (12) states accept any value
+static void payloadStates()
+{
+	PacketParser prs;
+	auto p = frame(0x53, 0x53);
+	// head value inside ID & data does not restart the frame
+	p.setIdentification(std::array<uint8_t, 7>{0x53, 0x53, 0x53, 0x53, 0x53, 0x53, 0x53});
+	p.computeChecksum();
+	CHECK_EQ(feed(prs, bytes(p)), 1);
+	CHECK(prs.getPacket().getContnet() == p.getContnet());
+}
+
+/// @brief Bad checksum & end mark are counted and dropped
+static void invalidFrames()
+{
+	PacketParser prs;
+	auto bad = bytes(frame(0x17, 0x0E));
+	bad[11] ^= 0x01;
+	CHECK_EQ(feed(prs, bad), 0);
+	CHECK_EQ(prs.errors(), 1u);
+
+	auto noEnd = bytes(frame(0x17, 0x0E));
+	noEnd[12] = 0x01;
+	CHECK_EQ(feed(prs, noEnd), 0);
+	CHECK_EQ(prs.errors(), 2u);
+
+	// the parser is back in WaitingForHead
+	CHECK_EQ(feed(prs, bytes(frame(0x10, 0x11))), 1);
+	CHECK_EQ(prs.errors(), 2u);
+}
+
+/// @brief A broken stream resynchronizes on a later head
+static void resync()
+{
+	PacketParser prs;
+	auto good = bytes(frame(0x02, 0x03));
+
+	// truncated frame followed by a complete one - the truncated one eats bytes of
+	// the next frame and fails, the frame after it parses
+	std::vector<uint8_t> stream(good.begin(), good.begin() + 6);
+	stream.insert(stream.end(), good.begin(), good.end());
+	stream.insert(stream.end(), good.begin(), good.end());
+	CHECK_EQ(feed(prs, stream), 1);
+	CHECK_EQ(prs.errors(), 1u);
+	CHECK(prs.getPacket().getContnet() == frame(0x02, 0x03).getContnet());
+}
+
+/// @brief clear() drops a partial frame
+static void clearState()
+{
+	PacketParser prs;
+	auto good = bytes(frame(0x02, 0x03));
+	feed(prs, std::vector<uint8_t>(good.begin(), good.begin() + 9));
+	prs.clear();
+	CHECK_EQ(feed(prs, good), 1);
+	CHECK_EQ(prs.errors(), 0u);
+}
+
+int main()
+{
+	roundTrip();
+	waitingForHead();
+	payloadStates();
+	invalidFrames();
+	resync();
+	clearState();
+	return testResult();
+}
@@ -0,0 +1,174 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_pending_writes.cpp
+/// @author Petr Vanek
+
+#include <functional>
+#include <map>
+#include <string>
+#include "check.h"
+#include "pending_writes.h"
+
+/// @brief Store in RAM, counts writes & commits, fails on request
+struct FakeStorage {
+	bool write(const std::string &key, const StoredValue &value)
+	{
+		writes++;
+		if (onWrite) {
+			onWrite(key);
+		}
+		if (key == failKey) {
+			return false;
+		}
+		staged[key] = value.kind == StoredValue::Kind::U32 ? std::to_string(value.num) : value.str;
+		return true;
+	}
+
+	bool commit()
+	{
+		commits++;
+		if (failCommit) {
+			staged.clear();
+			return false;
+		}
+		for (const auto &item : staged) {
+			stored[item.first] = item.second;
+		}
+		staged.clear();
+		return true;
+	}
+
+	std::map<std::string, std::string> staged;		///< written, not committed
+	std::map<std::string, std::string> stored;		///< committed
+	size_t writes{0};
+	size_t commits{0};
+	std::string failKey;
+	bool failCommit{false};
+	std::function<void(const std::string &)> onWrite;
+};
+
+using Pending = PendingWrites<FakeStorage>;
+
+static StoredValue num(uint32_t v)
+{
+	return StoredValue{StoredValue::Kind::U32, v, {}};
+}
+
+static StoredValue str(const std::string &v)
+{
+	return StoredValue{StoredValue::Kind::Str, 0, v};
+}
+
+/// @brief Writes of one key coalesce, a batch is one commit
+static void batch()
+{
+	Pending p;
+	FakeStorage fs;
+	uint32_t age = 0;
+	CHECK(p.flush(fs, 0));
+	CHECK_EQ(fs.commits, 0u);
+
+	for (uint32_t i = 0; i < 100; ++i) {
+		p.stage("level", num(i), 10 + i, age);
+		p.stage("cfg", str("v" + std::to_string(i)), 10 + i, age);
+	}
+	CHECK_EQ(p.pending(), 2u);
+	CHECK_EQ(age, 99u);
+
+	StoredValue v;
+	CHECK(p.find("level", v));
+	CHECK_EQ(v.num, 99u);
+	CHECK(!p.find("ssid", v));
+
+	CHECK(p.flush(fs, 200));
+	CHECK_EQ(fs.writes, 2u);
+	CHECK_EQ(fs.commits, 1u);
+	CHECK(fs.stored["level"] == "99");
+	CHECK(fs.stored["cfg"] == "v99");
+	CHECK_EQ(p.pending(), 0u);
+	CHECK(!p.find("level", v));
+
+	// age starts with the first write after the flush
+	p.stage("level", num(1), 500, age);
+	CHECK_EQ(age, 0u);
+	p.stage("level", num(2), 530, age);
+	CHECK_EQ(age, 30u);
+}
+
+/// @brief Readers see the batch being written, writers continue into a new one
+static void duringFlush()
+{
+	Pending p;
+	FakeStorage fs;
+	uint32_t age = 0;
+	p.stage("a", num(1), 0, age);
+
+	bool seen = false;
+	fs.onWrite = [&](const std::string &) {
+		StoredValue v;
+		seen = p.find("a", v) && v.num == 1;
+		p.stage("a", num(2), 5, age);
+		fs.onWrite = nullptr;
+	};
+	CHECK(p.flush(fs, 10));
+	CHECK(seen);
+	CHECK(fs.stored["a"] == "1");
+
+	// the newer value is pending, the next flush writes it
+	StoredValue v;
+	CHECK(p.find("a", v));
+	CHECK_EQ(v.num, 2u);
+	CHECK(p.flush(fs, 20));
+	CHECK(fs.stored["a"] == "2");
+}
+
+/// @brief Failed writes stay pending, a newer write wins
+static void failures()
+{
+	Pending p;
+	FakeStorage fs;
+	uint32_t age = 0;
+
+	// rejected key only
+	p.stage("a", num(1), 0, age);
+	p.stage("b", num(2), 0, age);
+	fs.failKey = "b";
+	CHECK(!p.flush(fs, 100));
+	CHECK(fs.stored["a"] == "1");
+	CHECK_EQ(fs.stored.count("b"), 0u);
+	CHECK_EQ(p.pending(), 1u);
+	// age of the returned key starts at the flush
+	p.stage("c", num(3), 150, age);
+	CHECK_EQ(age, 50u);
+	fs.failKey.clear();
+	CHECK(p.flush(fs, 200));
+	CHECK(fs.stored["b"] == "2");
+	CHECK(fs.stored["c"] == "3");
+
+	// failed commit - the whole batch, a value written meanwhile wins
+	p.stage("a", num(10), 300, age);
+	p.stage("b", num(20), 300, age);
+	fs.failCommit = true;
+	fs.onWrite = [&](const std::string &) {
+		p.stage("a", num(11), 305, age);
+		fs.onWrite = nullptr;
+	};
+	CHECK(!p.flush(fs, 310));
+	CHECK(fs.stored["a"] == "1");
+	CHECK_EQ(p.pending(), 2u);
+	fs.failCommit = false;
+	CHECK(p.flush(fs, 400));
+	CHECK(fs.stored["a"] == "11");
+	CHECK(fs.stored["b"] == "20");
+	CHECK_EQ(p.pending(), 0u);
+}
+
+int main()
+{
+	batch();
+	duringFlush();
+	failures();
+	return testResult();
+}
@@ -0,0 +1,99 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_rate_limiter.cpp
+/// @author Petr Vanek
+
+#include "check.h"
+#include "rate_limiter.h"
+
+static constexpr uint32_t _a{0x0A000001};
+static constexpr uint32_t _b{0x0A000002};
+static constexpr uint32_t _c{0x0A000003};
+
+/// @brief Admitted requests of one client in n calls
+template <typename L>
+static int admitted(L &limiter, uint32_t addr, int64_t nowUs, int n)
+{
+	int rc = 0;
+	for (int i = 0; i < n; ++i) {
+		rc += limiter.admit(addr, nowUs) ? 1 : 0;
+	}
+	return rc;
+}
+
+static void burst()
+{
+	TokenBucketLimiter<4> limiter(10, 20);
+	CHECK_EQ(admitted(limiter, _a, 1000, 25), 20);
+	CHECK_EQ(limiter.rejected(), 5u);
+
+	// other clients have their own bucket
+	CHECK_EQ(admitted(limiter, _b, 1000, 20), 20);
+
+	// 10 / s - one token after 100 ms
+	CHECK(!limiter.admit(_a, 1000 + 99000));
+	CHECK(limiter.admit(_a, 1000 + 100000));
+}
+
+/// @brief Requests faster than one token unit keep the partial refill
+static void fractionalRefill()
+{
+	TokenBucketLimiter<4> limiter(10, 20);
+	int64_t now = 1000;
+	admitted(limiter, _a, now, 20);
+
+	// 1 s of requests every 150 us (1.5 token units) - 10 tokens are earned
+	int ok = 0;
+	for (int i = 0; i < 6667; ++i) {
+		now += 150;
+		ok += limiter.admit(_a, now) ? 1 : 0;
+	}
+	CHECK(ok >= 9 && ok <= 10);
+
+	// 3 requests / s of a 1 / s limit - exactly one token per second
+	TokenBucketLimiter<4> slow(1, 1);
+	now = 1000;
+	CHECK(slow.admit(_a, now));
+	ok = 0;
+	for (int i = 0; i < 30; ++i) {
+		now += 333334;
+		ok += slow.admit(_a, now) ? 1 : 0;
+	}
+	CHECK_EQ(ok, 10);
+}
+
+/// @brief A client hitting its empty bucket is not idle - the quiet one is recycled
+static void lruKeepsActiveClient()
+{
+	TokenBucketLimiter<2> limiter(10, 5);
+	CHECK_EQ(admitted(limiter, _a, 1000, 5), 5);
+	CHECK_EQ(admitted(limiter, _b, 2000, 1), 1);
+
+	// A keeps hitting the empty bucket, faster than one token unit
+	for (int64_t t = 3000; t < 50000; t += 50) {
+		limiter.admit(_a, t);
+	}
+
+	// C takes B's slot, A stays limited
+	CHECK(limiter.admit(_c, 60000));
+	CHECK(!limiter.admit(_a, 61000));
+}
+
+static void fullBucketDoesNotSave()
+{
+	TokenBucketLimiter<4> limiter(10, 2);
+	CHECK_EQ(admitted(limiter, _a, 1000, 2), 2);
+	// a long pause refills only the burst
+	CHECK_EQ(admitted(limiter, _a, 100000000, 5), 2);
+}
+
+int main()
+{
+	burst();
+	fractionalRefill();
+	lruKeepsActiveClient();
+	fullBucketDoesNotSave();
+	return testResult();
+}
@@ -0,0 +1,101 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_udp_protocol.cpp
+/// @author Petr Vanek
+
+#include "check.h"
+#include "loopback.h"
+#include "lamp_udp_client.h"
+
+using lamp::UdpMessage;
+
+static void layout()
+{
+	const auto m = UdpMessage::make(UdpMessage::Type::SetState, 0x04030201, 1, 0x17, 0x0E);
+	const UdpMessage::Buffer expected{0x4C, 0x01, 0x01, 0x00, 0x01, 0x02, 0x03, 0x04, 0x01, 0x17, 0x0E, 0x00};
+	CHECK(m.getContnet() == expected);
+
+	UdpMessage p;
+	CHECK(p.parse(expected.data(), expected.size()));
+	CHECK(p.getType() == UdpMessage::Type::SetState);
+	CHECK_EQ(p.getSequence(), 0x04030201u);
+	CHECK_EQ(p.arg(1), 0x17);
+
+	// length, magic & version
+	CHECK(!p.parse(expected.data(), expected.size() - 1));
+	auto bad = expected;
+	bad[0] = 0x4D;
+	CHECK(!p.parse(bad.data(), bad.size()));
+	bad = expected;
+	bad[1] = 0x02;
+	CHECK(!p.parse(bad.data(), bad.size()));
+}
+
+static void sequence()
+{
+	CHECK(UdpMessage::newer(2, 1));
+	CHECK(!UdpMessage::newer(1, 1));
+	CHECK(!UdpMessage::newer(1, 2));
+	// serial number arithmetic over the wrap
+	CHECK(UdpMessage::newer(0x00000001, 0xFFFFFFF0));
+	CHECK(!UdpMessage::newer(0xFFFFFFF0, 0x00000001));
+}
+
+/// @brief Client against the loopback lamp - reply state, duplicates
+static void client()
+{
+	UdpLamp lamp;
+	lamp::UdpClient cli("127.0.0.1", lamp.port());
+	lamp::UdpClient::State st;
+
+	CHECK(cli.setState(true, 0x17, 0x0E, &st));
+	CHECK(st.status == UdpMessage::Status::Ok);
+	// reply shows the state before the request
+	CHECK(!st.on);
+	CHECK(cli.query(&st));
+	CHECK(st.on);
+	CHECK_EQ(st.intensity, 0x17);
+	CHECK_EQ(st.hue, 0x0E);
+
+	// the same sequence number from the same socket is not applied again
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(lamp.port());
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	struct timeval tv = {1, 0};
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	const auto msg = UdpMessage::make(UdpMessage::Type::SetState, 100, 0, 1, 1);
+	UdpMessage reply;
+	uint8_t buf[UdpMessage::_size];
+	for (auto expected : {UdpMessage::Status::Ok, UdpMessage::Status::Duplicate}) {
+		sendto(sock, msg.getContnet().data(), msg.getContnet().size(), 0, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+		const ssize_t len = recv(sock, buf, sizeof(buf), 0);
+		CHECK(len == static_cast<ssize_t>(sizeof(buf)) && reply.parse(buf, sizeof(buf)));
+		CHECK(reply.getStatus() == expected);
+		CHECK_EQ(reply.getSequence(), 100u);
+	}
+	close(sock);
+}
+
+/// @brief Restarted clients don't start with the same sequence number
+static void randomStart()
+{
+	uint32_t seqs[4];
+	for (auto &seq : seqs) {
+		lamp::UdpClient cli("127.0.0.1");
+		seq = cli.sequence();
+	}
+	CHECK(!(seqs[0] == seqs[1] && seqs[1] == seqs[2] && seqs[2] == seqs[3]));
+}
+
+int main()
+{
+	layout();
+	sequence();
+	client();
+	randomStart();
+	return testResult();
+}
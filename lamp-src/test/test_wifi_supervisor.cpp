@@ -0,0 +1,308 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_wifi_supervisor.cpp
+/// @author Petr Vanek
+
+#include <vector>
+#include "check.h"
+#include "wifi_supervisor.h"
+
+using Supervisor = WifiSupervisor<3>;
+using State = Supervisor::State;
+
+/// @brief Fake random source, returns the set value
+static uint32_t randomValue = 0;
+static uint32_t fakeRandom()
+{
+	return randomValue;
+}
+
+/// @brief Connect request with its time
+struct Attempt {
+	uint32_t ms;
+	uint8_t network;
+};
+
+/// @brief Supervisor on a fake clock, ticks exactly at the deadlines
+class Bench
+{
+	/// @brief Records the connect requests
+	auto emitter()
+	{
+		return [this](const WifiAction &a) { attempts.push_back(Attempt{now, a.network}); };
+	}
+
+public:
+	explicit Bench(const Supervisor::Timing &timing, uint32_t start = 1000) : sup(&fakeRandom, timing), now(start) {}
+
+	void start(size_t networks)
+	{
+		sup.start(networks, now, emitter());
+	}
+
+	/// @brief Advance the clock, ticks on the way
+	void advance(uint32_t ms)
+	{
+		const uint32_t end = now + ms;
+		uint32_t left;
+		while (sup.deadline(now, left) && static_cast<int32_t>(end - (now + left)) >= 0) {
+			now += left;
+			sup.tick(now, emitter());
+		}
+		now = end;
+	}
+
+	/// @brief Advance to the next deadline and tick
+	void next()
+	{
+		uint32_t left = 0;
+		CHECK(sup.deadline(now, left));
+		now += left;
+		sup.tick(now, emitter());
+	}
+
+	void down() { sup.down(now, emitter()); }
+	void up() { sup.up(now); }
+
+	/// @brief Delay from the last failure to the next attempt
+	uint32_t retryDelay()
+	{
+		uint32_t left = 0;
+		CHECK(sup.state() == State::Backoff);
+		CHECK(sup.deadline(now, left));
+		return left;
+	}
+
+	Supervisor sup;
+	uint32_t now;					///< fake clock [ms]
+	std::vector<Attempt> attempts;
+};
+
+static Supervisor::Timing noJitter()
+{
+	Supervisor::Timing t;
+	t.jitterPercent = 0;
+	return t;
+}
+
+static void idle()
+{
+	Bench bench(noJitter());
+	bench.start(0);
+	CHECK(bench.sup.state() == State::Idle);
+	CHECK(bench.attempts.empty());
+	uint32_t ms;
+	CHECK(!bench.sup.deadline(bench.now, ms));
+
+	// events without an attempt are ignored
+	bench.up();
+	bench.down();
+	CHECK(bench.sup.state() == State::Idle);
+	CHECK(bench.attempts.empty());
+}
+
+/// @brief Disconnects and timeouts double the delay up to the cap
+static void backoff()
+{
+	Bench bench(noJitter());
+	bench.start(1);
+	CHECK_EQ(bench.attempts.size(), 1u);
+	CHECK(bench.sup.state() == State::Connecting);
+
+	const uint32_t expected[] = {1000, 2000, 4000, 8000, 16000, 32000, 60000, 60000, 60000};
+	for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+		if (i % 2) {
+			// no result within connectTimeoutMs
+			uint32_t ms = 0;
+			CHECK(bench.sup.deadline(bench.now, ms));
+			CHECK_EQ(ms, 15000u);
+			bench.next();
+		} else {
+			bench.advance(300);
+			bench.down();
+		}
+		CHECK_EQ(bench.retryDelay(), expected[i]);
+		const uint32_t failedAt = bench.now;
+		bench.next();
+		CHECK(bench.sup.state() == State::Connecting);
+		CHECK_EQ(bench.attempts.back().ms - failedAt, expected[i]);
+		// one network - never rotates
+		CHECK_EQ(bench.attempts.back().network, 0);
+	}
+	CHECK_EQ(bench.attempts.size(), 10u);
+
+	// link up resets the back-off
+	bench.up();
+	CHECK(bench.sup.state() == State::Connected);
+	uint32_t ms;
+	CHECK(!bench.sup.deadline(bench.now, ms));
+	bench.down();
+	bench.down();
+	CHECK_EQ(bench.retryDelay(), 1000u);
+}
+
+/// @brief Delay stays within base +- jitterPercent
+static void jitter()
+{
+	Supervisor::Timing t;
+	t.jitterPercent = 25;
+
+	const uint32_t randoms[] = {0, 1, 250, 499, 500, 501, 12345, 0x7FFFFFFF, 0xFFFFFFFF};
+	for (uint32_t r : randoms) {
+		randomValue = r;
+		Bench bench(t);
+		bench.start(1);
+		bench.down();
+		const uint32_t first = bench.retryDelay();
+		CHECK(first >= 750 && first <= 1250);
+
+		bench.next();
+		bench.down();
+		const uint32_t second = bench.retryDelay();
+		CHECK(second >= 1500 && second <= 2500);
+	}
+
+	// both ends are reachable
+	randomValue = 0;
+	Bench low(t);
+	low.start(1);
+	low.down();
+	CHECK_EQ(low.retryDelay(), 750u);
+	randomValue = 500;
+	Bench high(t);
+	high.start(1);
+	high.down();
+	CHECK_EQ(high.retryDelay(), 1250u);
+
+	// jitter around the cap
+	randomValue = 0xFFFFFFFF;
+	Supervisor::Timing capped = t;
+	capped.backoffMaxMs = 4000;
+	Bench cap(capped);
+	cap.start(1);
+	for (int i = 0; i < 8; ++i) {
+		cap.down();
+		const uint32_t d = cap.retryDelay();
+		CHECK(d >= 750 && d <= 5000);
+		cap.next();
+	}
+	cap.down();
+	CHECK(cap.retryDelay() >= 3000);
+	randomValue = 0;
+}
+
+/// @brief failoverAfter failures in a row move to the next network, the list wraps
+static void rotation()
+{
+	Bench bench(noJitter());
+	bench.start(3);
+	CHECK_EQ(bench.attempts.back().network, 0);
+
+	const uint8_t networks[] = {0, 0, 1, 1, 1, 2, 2, 2, 0, 0, 0};
+	for (uint8_t expected : networks) {
+		bench.down();
+		bench.next();
+		CHECK_EQ(bench.attempts.back().network, expected);
+	}
+	CHECK_EQ(bench.sup.network(), 0u);
+
+	// back-off keeps growing over the networks
+	bench.down();
+	CHECK_EQ(bench.retryDelay(), 60000u);
+
+	// a backup network connects - it stays there, a lost link retries it at once
+	bench.next();
+	bench.down();
+	bench.next();
+	bench.down();
+	bench.next();
+	CHECK_EQ(bench.attempts.back().network, 1);
+	bench.up();
+	const size_t count = bench.attempts.size();
+	bench.advance(5000);
+	bench.down();
+	CHECK_EQ(bench.attempts.size(), count + 1);
+	CHECK_EQ(bench.attempts.back().network, 1);
+	CHECK_EQ(bench.attempts.back().ms, bench.now);
+}
+
+static void recovery()
+{
+	Bench bench(noJitter());
+	bench.start(2);
+	bench.advance(2000);
+	bench.up();
+	CHECK_EQ(bench.sup.recoveries(), 0u);
+
+	// lost and back on the immediate retry
+	bench.advance(60000);
+	bench.down();
+	CHECK(bench.sup.state() == State::Connecting);
+	bench.advance(1500);
+	bench.up();
+	CHECK_EQ(bench.sup.recoveries(), 1u);
+	CHECK_EQ(bench.sup.lastRecoveryMs(), 1500u);
+	CHECK_EQ(bench.sup.maxRecoveryMs(), 1500u);
+
+	// lost, the retry times out, back after the back-off
+	bench.advance(60000);
+	bench.down();
+	bench.next();				// 15 s timeout
+	bench.next();				// 1 s back-off
+	bench.advance(500);
+	bench.up();
+	CHECK_EQ(bench.sup.recoveries(), 2u);
+	CHECK_EQ(bench.sup.lastRecoveryMs(), 16500u);
+	CHECK_EQ(bench.sup.maxRecoveryMs(), 16500u);
+
+	// shorter outage keeps the maximum
+	bench.advance(60000);
+	bench.down();
+	bench.advance(200);
+	bench.up();
+	CHECK_EQ(bench.sup.recoveries(), 3u);
+	CHECK_EQ(bench.sup.lastRecoveryMs(), 200u);
+	CHECK_EQ(bench.sup.maxRecoveryMs(), 16500u);
+
+	// repeated got IP is not a recovery
+	bench.up();
+	CHECK_EQ(bench.sup.recoveries(), 3u);
+
+	// stopped during an outage - no recovery, no actions
+	bench.down();
+	bench.sup.stop();
+	const size_t count = bench.attempts.size();
+	bench.advance(100000);
+	CHECK_EQ(bench.attempts.size(), count);
+	bench.start(2);
+	bench.up();
+	CHECK_EQ(bench.sup.recoveries(), 3u);
+}
+
+/// @brief Deadlines over the 49 day wrap of the millisecond clock
+static void wrap()
+{
+	Bench bench(noJitter(), 0xFFFFFFFFu - 5000);
+	bench.start(1);
+	bench.advance(10000);
+	CHECK(bench.sup.state() == State::Connecting);
+	bench.advance(5000);
+	CHECK(bench.sup.state() == State::Backoff);
+	CHECK_EQ(bench.retryDelay(), 1000u);
+	bench.next();
+	CHECK_EQ(bench.attempts.size(), 2u);
+	CHECK_EQ(bench.attempts.back().ms, 0xFFFFFFFFu - 5000 + 16000);
+}
+
+int main()
+{
+	idle();
+	backoff();
+	jitter();
+	rotation();
+	recovery();
+	wrap();
+	return testResult();
+}
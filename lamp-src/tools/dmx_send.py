@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+#
+# Sends DMX frames to the lamp over Art-Net or E1.31 (sACN), a test source
+# for the DMX receiver without lighting software.
+#
+#   python3 dmx_send.py 192.168.2.222 1=255 2=128
+#   python3 dmx_send.py --sacn --universe 1 239.255.0.1 1=0
+#   python3 dmx_send.py --fade 1 --seconds 10 192.168.2.222 2=200
+#
+# Channels are 1 based, unlisted channels are 0. Frames repeat at --rate Hz,
+# --fade ramps the given channel 0 - 255 - 0 to exercise the downsampling.
+# Layouts are described in lamp-src/src/dmx.h
+
+import argparse
+import math
+import socket
+import struct
+import sys
+import time
+import uuid
+
+ARTNET_PORT = 6454
+SACN_PORT = 5568
+
+
+def artnet(universe, sequence, data):
+    if len(data) % 2:
+        data += b'\0'
+    return (b'Art-Net\0' + struct.pack('<HBBBBBB', 0x5000, 0, 14, sequence, 0,
+                                       universe & 0xFF, (universe >> 8) & 0x7F)
+            + struct.pack('>H', len(data)) + data)
+
+
+def sacn(universe, sequence, data, cid, source='lamp dmx_send'):
+    dmp = struct.pack('>HBBHHH', 0x7000 | (10 + len(data) + 1), 0x02, 0xA1, 0, 1, len(data) + 1) + b'\0' + data
+    framing = (struct.pack('>HI', 0x7000 | (77 + len(dmp)), 0x00000002)
+               + source.encode('ascii')[:63].ljust(64, b'\0')
+               + struct.pack('>BHBBH', 100, 0, sequence, 0, universe) + dmp)
+    root = (struct.pack('>HH', 0x0010, 0x0000) + b'ASC-E1.17\0\0\0'
+            + struct.pack('>HI', 0x7000 | (22 + len(framing)), 0x00000004) + cid + framing)
+    return root
+
+
+def channels(args):
+    data = bytearray(max([ch for ch, _ in args] + [1]))
+    for ch, value in args:
+        data[ch - 1] = value
+    return data
+
+
+def parse_channel(text):
+    ch, _, value = text.partition('=')
+    ch, value = int(ch), int(value)
+    if not 1 <= ch <= 512 or not 0 <= value <= 255:
+        raise argparse.ArgumentTypeError('channel 1 - 512, value 0 - 255: %s' % text)
+    return ch, value
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Art-Net / E1.31 DMX sender')
+    ap.add_argument('host', help='lamp address, broadcast or sACN multicast group')
+    ap.add_argument('channel', nargs='*', type=parse_channel, help='<channel>=<value>')
+    ap.add_argument('--sacn', action='store_true', help='E1.31 instead of Art-Net')
+    ap.add_argument('--universe', type=int, default=1)
+    ap.add_argument('--rate', type=float, default=44.0, help='frames per second')
+    ap.add_argument('--seconds', type=float, default=1.0, help='how long to send')
+    ap.add_argument('--fade', type=int, default=0, help='channel to ramp 0 - 255 - 0 over 2 s')
+    args = ap.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_BROADCAST, 1)
+    port = SACN_PORT if args.sacn else ARTNET_PORT
+    cid = uuid.uuid4().bytes
+    data = channels(args.channel + ([(args.fade, 0)] if args.fade else []))
+
+    frames = max(1, int(args.seconds * args.rate))
+    start = time.monotonic()
+    for n in range(frames):
+        if args.fade:
+            data[args.fade - 1] = int(127.5 - 127.5 * math.cos(math.pi * (time.monotonic() - start)))
+        # Art-Net sequence 0 disables reordering checks, E1.31 wraps 255 -> 0
+        sequence = (n % 255) + 1 if not args.sacn else n % 256
+        packet = sacn(args.universe, sequence, bytes(data), cid) if args.sacn else artnet(args.universe, sequence, bytes(data))
+        sock.sendto(packet, (args.host, port))
+        time.sleep(max(0.0, start + (n + 1) / args.rate - time.monotonic()))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,156 @@
+/*
+ * @file lamp_udp_client.h
+ * @author Petr Vanek (petr@fotoventus.cz)
+ * @brief Host (POSIX) client of the binary UDP control protocol
+ * @version 0.1
+ * @date 2024-03-04
+ *
+ * @copyright Copyright (c) 2024 Petr Vanek
+ *
+ * Header only, build with -I lamp-src/src:
+ *
+ *     lamp::UdpClient cli("192.168.2.222");
+ *     lamp::UdpClient::State st;
+ *     cli.setState(true, 0x17, 0x0E, &st);
+ */
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <random>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "udp_protocol.h"
+
+namespace lamp {
+
+class UdpClient
+{
+public:
+
+    /// @brief Lamp state from reply - the last state known to the lamp when the request
+    /// arrived, a change is applied after the frame is sent (query() shows it)
+    struct State
+    {
+        bool on{false};
+        uint8_t intensity{0};
+        uint8_t hue{0};
+        UdpMessage::Status status{UdpMessage::Status::Invalid};
+    };
+
+    /// @brief CTOR
+    /// @param host lamp IPv4 address
+    /// @param port UDP port
+    /// @param timeoutMs reply timeout
+    /// @param retries number of retransmissions with the same sequence number
+    UdpClient(const std::string &host, uint16_t port = UdpMessage::_port, uint32_t timeoutMs = 200, int retries = 3)
+        : _seq(std::random_device{}()), _retries(retries)
+    {
+        _addr.sin_family = AF_INET;
+        _addr.sin_port = htons(port);
+        inet_pton(AF_INET, host.c_str(), &_addr.sin_addr);
+
+        _sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (_sock >= 0)
+        {
+            struct timeval tv;
+            tv.tv_sec = timeoutMs / 1000;
+            tv.tv_usec = (timeoutMs % 1000) * 1000;
+            setsockopt(_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        }
+    }
+
+    ~UdpClient()
+    {
+        if (_sock >= 0)
+        {
+            close(_sock);
+        }
+    }
+
+    UdpClient(const UdpClient &) = delete;
+    UdpClient &operator=(const UdpClient &) = delete;
+
+    /// @brief Switch on/off with intensity & hue (0x00 - 0x17)
+    bool setState(bool on, uint8_t intensity, uint8_t hue, State *state = nullptr)
+    {
+        return request(UdpMessage::Type::SetState, on ? 1 : 0, intensity, hue, state);
+    }
+
+    /// @brief Relative intensity & hue change
+    bool delta(int8_t intensity, int8_t hue, State *state = nullptr)
+    {
+        return request(UdpMessage::Type::Delta, static_cast<uint8_t>(intensity), static_cast<uint8_t>(hue), 0, state);
+    }
+
+    /// @brief Recall built-in scene
+    bool scene(uint8_t index, State *state = nullptr)
+    {
+        return request(UdpMessage::Type::Scene, index, 0, 0, state);
+    }
+
+    /// @brief Query last known state
+    bool query(State *state)
+    {
+        return request(UdpMessage::Type::Query, 0, 0, 0, state);
+    }
+
+    /// @brief Sequence number of the last request
+    uint32_t sequence() const
+    {
+        return _seq;
+    }
+
+private:
+
+    /// @brief Send request and wait for reply, retransmissions keep the sequence number
+    /// so the lamp applies the request only once
+    bool request(UdpMessage::Type type, uint8_t a, uint8_t b, uint8_t c, State *state)
+    {
+        if (_sock < 0)
+        {
+            return false;
+        }
+
+        const auto msg = UdpMessage::make(type, ++_seq, a, b, c);
+        for (int attempt = 0; attempt <= _retries; ++attempt)
+        {
+            sendto(_sock, msg.getContnet().data(), msg.getContnet().size(), 0,
+                   reinterpret_cast<const struct sockaddr *>(&_addr), sizeof(_addr));
+
+            uint8_t buf[UdpMessage::_size + 1];
+            ssize_t len;
+            while ((len = recv(_sock, buf, sizeof(buf), 0)) > 0)
+            {
+                UdpMessage reply;
+                if (!reply.parse(buf, static_cast<size_t>(len)) || reply.getSequence() != _seq)
+                {
+                    // stale reply of previous request
+                    continue;
+                }
+
+                if (state)
+                {
+                    state->on = reply.arg(0) != 0;
+                    state->intensity = reply.arg(1);
+                    state->hue = reply.arg(2);
+                    state->status = reply.getStatus();
+                }
+                return reply.getStatus() == UdpMessage::Status::Ok ||
+                       reply.getStatus() == UdpMessage::Status::Duplicate;
+            }
+        }
+        return false;
+    }
+
+    int _sock{-1};                  ///< UDP socket
+    struct sockaddr_in _addr{};     ///< lamp address
+    uint32_t _seq;                  ///< sequence number, random start - a restarted client
+                                    ///< must not look like a replay to the lamp
+    int _retries;                   ///< retransmissions
+};
+
+} // namespace lamp
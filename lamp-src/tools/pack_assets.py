@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+#
+# Packs the web assets (lamp-src/data) into the read-only archive served from
+# the "assets" partition.
+#
+#   python3 pack_assets.py ../data assets.bin
+#   parttool.py --port /dev/ttyUSB0 write_partition --partition-name=assets --input assets.bin
+#
+# Layout is described in lamp-src/src/asset_store.h
+
+import argparse
+import os
+import struct
+import sys
+import zlib
+
+MAGIC = b'LPAK'
+VERSION = 1
+HEADER = struct.Struct('<4sHHIIII')
+ENTRY = struct.Struct('<IIIII')
+
+MIME = {
+    '.html': 'text/html',
+    '.htm': 'text/html',
+    '.css': 'text/css',
+    '.js': 'application/javascript',
+    '.json': 'application/json',
+    '.svg': 'image/svg+xml',
+    '.png': 'image/png',
+    '.jpg': 'image/jpeg',
+    '.ico': 'image/x-icon',
+    '.txt': 'text/plain',
+}
+
+
+def fnv1a(path):
+    """FNV-1a of the path, 0 is the empty slot - same as AssetStore::hash()."""
+    h = 0x811C9DC5
+    for b in path.encode('utf-8'):
+        h ^= b
+        h = (h * 0x01000193) & 0xFFFFFFFF
+    return h or 1
+
+
+def collect(root):
+    files = []
+    for base, _, names in os.walk(root):
+        for name in sorted(names):
+            full = os.path.join(base, name)
+            path = '/' + os.path.relpath(full, root).replace(os.sep, '/')
+            with open(full, 'rb') as f:
+                files.append((path, f.read()))
+    return sorted(files)
+
+
+def pack(files):
+    # load factor <= 0.5 keeps the probes short
+    slots = 1
+    while slots < 2 * max(len(files), 1):
+        slots *= 2
+    if slots > 0xFFFF:
+        raise ValueError('too many assets')
+
+    table_end = HEADER.size + slots * ENTRY.size
+    strings = bytearray()
+    offsets = {}
+
+    def string(s):
+        if s not in offsets:
+            offsets[s] = table_end + len(strings)
+            strings.extend(s.encode('utf-8') + b'\0')
+        return offsets[s]
+
+    names = [(path, string(path), string(MIME.get(os.path.splitext(path)[1].lower(), 'application/octet-stream')))
+             for path, _ in files]
+
+    data = bytearray()
+    data_start = (table_end + len(strings) + 3) & ~3
+    entries = [(0, 0, 0, 0, 0)] * slots
+    for (path, content), (_, name, mime) in zip(files, names):
+        h = fnv1a(path)
+        i = h & (slots - 1)
+        while entries[i][0] != 0:
+            i = (i + 1) & (slots - 1)
+        entries[i] = (h, name, data_start + len(data), len(content), mime)
+        data.extend(content)
+        data.extend(b'\0' * (-len(data) & 3))
+
+    body = bytearray()
+    for e in entries:
+        body.extend(ENTRY.pack(*e))
+    body.extend(strings)
+    body.extend(b'\0' * (data_start - table_end - len(strings)))
+    body.extend(data)
+
+    size = HEADER.size + len(body)
+    crc = zlib.crc32(bytes(body)) & 0xFFFFFFFF
+    return HEADER.pack(MAGIC, VERSION, slots, len(files), size, crc, 0) + bytes(body)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Pack web assets for the lamp "assets" partition')
+    parser.add_argument('source', help='asset directory, e.g. lamp-src/data')
+    parser.add_argument('output', help='archive file')
+    parser.add_argument('--size', type=lambda v: int(v, 0), default=0x100000, help='partition size (default 1M)')
+    args = parser.parse_args()
+
+    files = collect(args.source)
+    image = pack(files)
+    if len(image) > args.size:
+        sys.exit('archive %d bytes does not fit the partition (%d)' % (len(image), args.size))
+    with open(args.output, 'wb') as f:
+        f.write(image)
+    print('%d assets, %d bytes' % (len(files), len(image)))
+
+
+if __name__ == '__main__':
+    main()
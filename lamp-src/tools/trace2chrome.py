@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 Petr Vanek, petr@fotoventus.cz
+#
+# Converts the lamp trace buffer (/debug/trace) to Chrome trace JSON
+# (chrome://tracing, https://ui.perfetto.dev).
+#
+#   curl "http://192.168.2.222/debug/trace?enable=1"
+#   ... reproduce the problem ...
+#   curl -o trace.bin http://192.168.2.222/debug/trace
+#   python3 trace2chrome.py trace.bin > trace.json
+#
+# Layout is described in lamp-src/src/trace.h
+
+import json
+import struct
+import sys
+
+
+def cstr(buf, pos):
+    end = buf.index(b'\0', pos)
+    return buf[pos:end].decode('ascii', 'replace'), end + 1
+
+
+def convert(buf):
+    if buf[0:4] != b'LTRC':
+        raise ValueError('not a lamp trace')
+    version, cores, records, now = struct.unpack_from('<BBHq', buf, 4)
+    if version != 1:
+        raise ValueError('unsupported version %d' % version)
+    pos = 16
+
+    (count,) = struct.unpack_from('<B', buf, pos)
+    pos += 1
+    events = []
+    for _ in range(count):
+        name, pos = cstr(buf, pos)
+        events.append(name)
+
+    (count,) = struct.unpack_from('<B', buf, pos)
+    pos += 1
+    tasks = {}
+    for _ in range(count):
+        (handle,) = struct.unpack_from('<I', buf, pos)
+        name, pos = cstr(buf, pos + 4)
+        tasks[handle] = name
+
+    out = []
+    lanes = {}
+    now32 = now & 0xFFFFFFFF
+    for core in range(cores):
+        (head,) = struct.unpack_from('<I', buf, pos)
+        pos += 4
+        ring = buf[pos:pos + 12 * records]
+        pos += 12 * records
+
+        valid = min(head, records)
+        for n in range(head - valid, head):
+            ts, task, event, phase, arg = struct.unpack_from('<IIBBH', ring, (n % records) * 12)
+            # 32 bit timestamp relative to the download time
+            us = now - ((now32 - ts) & 0xFFFFFFFF)
+            tid = lanes.setdefault(task, len(lanes) + 1)
+            # one lane per task - unpinned tasks may begin a span on one core and end it on the other
+            rec = {
+                'name': events[event] if event < len(events) else 'event%d' % event,
+                'ph': chr(phase),
+                'ts': us,
+                'pid': 0,
+                'tid': tid,
+            }
+            if phase == ord('B'):
+                rec['args'] = {'core': core, 'arg': arg}
+            out.append(rec)
+
+    out.append({'name': 'process_name', 'ph': 'M', 'pid': 0, 'args': {'name': 'lamp'}})
+    for task, tid in lanes.items():
+        name = tasks.get(task, 'task 0x%08x' % task)
+        out.append({'name': 'thread_name', 'ph': 'M', 'pid': 0, 'tid': tid, 'args': {'name': name}})
+
+    out.sort(key=lambda r: r.get('ts', 0))
+    return {'traceEvents': out, 'displayTimeUnit': 'ms'}
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write('usage: trace2chrome.py trace.bin > trace.json\n')
+        return 1
+    with open(sys.argv[1], 'rb') as f:
+        json.dump(convert(f.read()), sys.stdout, indent=1)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())